@@ -0,0 +1,11 @@
+@echo off
+rem Builds fedit_bench once for every span/page geometry and runs the geometry benchmark
+rem with each of them, on the given file or on generated text.
+rem   bench_geometry.bat [file]
+if not exist bench_geometry mkdir bench_geometry
+for %%s in (16 32 64 128 256) do (
+	for %%p in (4 16 64 256) do (
+		cl src/fedit_bench.c -nologo -Fe:bench_geometry\fedit_bench_s%%s_p%%p.exe -Fo:bench_geometry\ -O2 -W4 -external:anglebrackets -external:W0 -D_CRT_SECURE_NO_WARNINGS -wd4063 -DED_SPAN_SIZE=%%s -DED_PAGE_SIZE=%%p -link -incremental:no -opt:ref Ws2_32.lib > NUL
+		bench_geometry\fedit_bench_s%%s_p%%p.exe geometry %1
+	)
+)
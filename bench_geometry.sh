@@ -0,0 +1,18 @@
+#!/usr/bin/bash
+# Builds fedit_bench once for every span/page geometry and runs the geometry benchmark
+# with each of them, on the given file or on generated text.
+#   bench_geometry.sh [file]
+mkdir -p bench_geometry
+header=1
+for span in 16 32 64 128 256; do
+	for page in 4 16 64 256; do
+		exe=bench_geometry/fedit_bench_s${span}_p${page}
+		clang src/fedit_bench.c -o $exe -pthread -DED_SPAN_SIZE=$span -DED_PAGE_SIZE=$page -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -O2 || exit 1
+		if [ $header -eq 1 ]; then
+			./$exe geometry "$@" | tail -n 2
+			header=0
+		else
+			./$exe geometry "$@" | tail -n 1
+		fi
+	done
+done
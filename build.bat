@@ -2,5 +2,8 @@
 del *.pdb > NUL 2> NUL
 del *.rdi > NUL 2> NUL
 cl src/fedit.c -nologo -Fe:fedit.exe -Z7 -W4 -external:anglebrackets -external:W0 -D_CRT_SECURE_NO_WARNINGS -wd4063 -link -incremental:no -opt:ref Ws2_32.lib
+cl src/fedit_bench.c -nologo -Fe:fedit_bench.exe -Z7 -O2 -W4 -external:anglebrackets -external:W0 -D_CRT_SECURE_NO_WARNINGS -wd4063 -link -incremental:no -opt:ref Ws2_32.lib
+cl src/fedit_replay.c -nologo -Fe:fedit_replay.exe -Z7 -O2 -W4 -external:anglebrackets -external:W0 -D_CRT_SECURE_NO_WARNINGS -wd4063 -link -incremental:no -opt:ref Ws2_32.lib
+cl -c src/fedit_engine.c -nologo -Fo:fedit_engine.obj -DED_ENGINE_LIBRARY=1 -Z7 -O2 -W4 -external:anglebrackets -external:W0 -D_CRT_SECURE_NO_WARNINGS -wd4063 && lib -nologo fedit_engine.obj -out:fedit_engine.lib
 del *.ilk > NUL 2> NUL
 del *.obj > NUL 2> NUL
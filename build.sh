@@ -1,2 +1,5 @@
 #!/usr/bin/bash
-clang src/fedit.c -o fedit -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -g -O0
+clang src/fedit.c -o fedit -pthread -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -g -O0
+clang src/fedit_bench.c -o fedit_bench -pthread -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -g -O2
+clang src/fedit_replay.c -o fedit_replay -pthread -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -g -O2
+clang -c src/fedit_engine.c -o fedit_engine.o -DED_ENGINE_LIBRARY=1 -pthread -Wall -Wextra -pedantic -Wno-unused-function -Wno-switch -g -O2 && ar rcs libfedit_engine.a fedit_engine.o && rm fedit_engine.o
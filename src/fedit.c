@@ -6,972 +6,149 @@
 ////////////////////////////////
 //~ Editor
 
+#include "fedit_engine.h"
 #include "fedit.h"
 
-#if OS_WINDOWS
-# include "fedit_windows.c"
-#elif OS_LINUX
-# include "fedit_linux.c"
-#endif
-
-// TODO: Review all casts
-
-//- Editor elements allocation functions
-
-static ED_Page *
-ed_push_page(Arena *arena) {
-	ED_Page *page;
-	
-	page = push_type(arena, ED_Page);
-	page->lines = push_array(arena, ED_Line, ED_PAGE_SIZE);
-	
-	return page;
-}
-
-static ED_Page *
-ed_alloc_page(ED_Buffer *buffer) {
-	ED_Page *page = NULL;
-	
-	if (buffer->first_free_page) {
-		page = buffer->first_free_page;
-		stack_pop(buffer->first_free_page);
-		ED_Line *lines = page->lines;
-		memset(lines, 0, ED_PAGE_SIZE);
-		memset(page, 0, sizeof(ED_Page));
-		page->lines = lines;
-	} else {
-		page = ed_push_page(&buffer->arena);
-	}
-	
-	return page;
-}
-
-static ED_Span *
-ed_push_span(Arena *arena) {
-	ED_Span *span;
-	
-	span = push_type(arena, ED_Span);
-	span->data = push_array(arena, u8, ED_SPAN_SIZE);
-	
-	return span;
-}
-
-static ED_Span *
-ed_alloc_span(ED_Buffer *buffer) {
-	ED_Span *span = NULL;
-	
-	if (buffer->first_free_span) {
-		span = buffer->first_free_span;
-		stack_pop(buffer->first_free_span); // Get from free-list
-		u8   *data = span->data;
-		memset(data, 0, ED_SPAN_SIZE);
-		memset(span, 0, sizeof(ED_Span));
-		span->data = data;
-	} else {
-		span = ed_push_span(&buffer->arena); // Push from arena
-	}
-	
-	return span;
-}
-
-//- Main buffer modification functions
-
-static void
-ed_buffer_remove_range(ED_Buffer *buffer, Text_Range range) {
-	ED_Page *start_page = NULL;
-	ED_Line *start_line = NULL;
-	i64 start_line_in_page = 0;
-	
-	{
-		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.start.y);
-		start_page = rel.page;
-		start_line = &start_page->lines[rel.i];
-		start_line_in_page = rel.i;
-	}
-	
-	// Validate arguments
-	assert(!text_point_less_than(range.end, range.start));
-	assert(ed_text_point_exists(buffer, range.start));
-	assert(ed_text_point_exists(buffer, range.end));
-	
-	{
-		// Delete lines from start downwards
-		
-		// i64 lines_remaining = ED_PAGE_SIZE - start_line_in_page - 1;
-		i64 lines_remaining = start_page->line_count - start_line_in_page - 1;
-		i64 line_diff = range.end.y - range.start.y;
-		i64 lines_to_delete = min(line_diff - 1, lines_remaining);
-		lines_to_delete = max(lines_to_delete, 0);
-		
-		for (i64 i = 0; i < lines_to_delete; i += 1) {
-			i64 line_index = i + start_line_in_page + 1;
-			
-			ED_Line *line = &start_page->lines[line_index];
-			while (line->first_span) {
-				ED_Span *span = line->first_span;
-				dll_remove(line->first_span, line->last_span, span);
-				stack_push(buffer->first_free_span, span);
-			}
-			
-			assert(!line->last_span);
-			ED_Span *span = ed_alloc_span(buffer);
-			dll_push_back(line->first_span, line->last_span, span);
-		}
-		
-		memmove(start_page->lines + start_line_in_page + 1, start_page->lines + start_line_in_page + lines_to_delete + 1,
-				(lines_remaining - lines_to_delete) * sizeof(ED_Line));
-		start_page->line_count -= lines_to_delete;
-		buffer->line_count -= lines_to_delete;
-		
-		
-		
-		range.end.y -= cast(i32) lines_to_delete;
-	}
-	
-	ED_Page *end_page = NULL;
-	ED_Line *end_line = NULL;
-	i64 end_line_in_page = 0;
-	
-	{
-		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.end.y);
-		end_page = rel.page;
-		end_line = &end_page->lines[rel.i];
-		end_line_in_page = rel.i;
-	}
-	
-	i64 end_page_original_line_count = end_page->line_count; // For debugging only
-	(void)end_page_original_line_count;
-	
-	{
-		// Delete lines from end upwards
-		
-		i64 lines_remaining = end_line_in_page;
-		i64 line_diff = range.end.y - range.start.y;
-		i64 lines_to_delete = min(line_diff - 1, lines_remaining);
-		lines_to_delete = max(lines_to_delete, 0);
-		
-		for (i64 i = 0; i < lines_to_delete; i += 1) {
-			i64 line_index = i + end_line_in_page - lines_to_delete;
-			
-			ED_Line *line = &end_page->lines[line_index];
-			while (line->first_span) {
-				ED_Span *span = line->first_span;
-				dll_remove(line->first_span, line->last_span, span);
-				stack_push(buffer->first_free_span, span);
-			}
-			
-			assert(!line->last_span);
-			ED_Span *span = ed_alloc_span(buffer);
-			dll_push_back(line->first_span, line->last_span, span);
-			
-			// We remove all spans and then put one back. Is it better if we stop before removing
-			// the last one? TODO.
-			// Same thing above.
-		}
-		
-		memmove(end_page->lines, end_page->lines + lines_to_delete, sizeof(ED_Line) * lines_to_delete);
-		end_page->line_count -= lines_to_delete;
-		buffer->line_count -= lines_to_delete;
-		
-		
-		
-		range.end.y -= cast(i32) lines_to_delete;
-	}
-	
-	assert((start_line_in_page == start_page->line_count - 1 &&
-			end_page->line_count == end_page_original_line_count - end_line_in_page) ||
-		   (start_page == end_page));
-	
-	{
-		// Delete full pages in between
-		
-		if (start_page != end_page) {
-			while (start_page->next != end_page) {
-				ED_Page *page = start_page->next;
-				dll_remove(buffer->first_page, buffer->last_page, page);
-				stack_push(buffer->first_free_page, page);
-				
-				buffer->line_count -= page->line_count;
-				range.end.y -= cast(i32) page->line_count;
-			}
-		}
-	}
-	
-	{
-		// Join lines
-		
-		ED_Span *start_span = NULL;
-		i64 at_in_start_span = 0;
-		
-		{
-			ED_Span_I64 rel = ed_relative_span_from_line_and_pos(start_line, range.start.x);
-			start_span = rel.span;
-			at_in_start_span = rel.i;
-		}
-		
-		ED_Span *end_span = NULL;
-		i64 at_in_end_span = 0;
-		
-		{
-			ED_Span_I64 rel = ed_relative_span_from_line_and_pos(end_line, range.end.x);
-			end_span = rel.span;
-			at_in_end_span = rel.i;
-		}
-		
-		if (start_span == end_span) {
-			assert(at_in_start_span <= at_in_end_span);
-			
-			i64 to_copy = end_span->len - at_in_end_span;
-			// i64 to_copy = (range.end.x - range.start.x);
-			memmove(start_span->data + at_in_start_span, end_span->data + at_in_end_span, to_copy);
-			start_span->len -= (range.end.x - range.start.x);
-			
-			if (to_copy > 0) {
-				assert(start_span->len == at_in_start_span + to_copy);
-			}
-		} else {
-			
-			// Get variables that may have changed
-			// TODO: *CAN* they change? Or are pointers stable after previous modifications?
-			{
-				ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.end.y);
-				end_page = rel.page;
-				end_line = &end_page->lines[rel.i];
-				end_line_in_page = rel.i;
-			}
-			
-			// 1: Concatenate the 2 lines
-			if (range.start.y < range.end.y) {
-				assert(range.start.y == range.end.y - 1);
-				
-				
-				start_line->last_span->next = end_line->first_span;
-				end_line->first_span->prev = start_line->last_span;
-				
-				start_line->last_span = end_line->last_span;
-				end_line->first_span = start_line->first_span;
-				
-				
-#if 1
-				i64 lines_remaining = end_page->line_count - end_line_in_page; // TODO: no -1 here?
-				i64 lines_to_delete = 1;
-				memmove(end_page->lines + end_line_in_page, end_page->lines + end_line_in_page + 1,
-						(lines_remaining - lines_to_delete) * sizeof(ED_Line));
-				end_page->line_count -= lines_to_delete;
-				buffer->line_count -= lines_to_delete;
-				
-				if (end_page->line_count == 0) {
-					dll_remove(buffer->first_page, buffer->last_page, end_page);
-					stack_push(buffer->first_free_page, end_page);
-				}
-#endif
-				
-			}
-			
-			// 2: Remove spans in between
-			while (start_span->next != end_span) {
-				ED_Span *span_to_free = start_span->next;
-				
-				dll_remove(start_line->first_span, start_line->last_span, span_to_free);
-				stack_push(buffer->first_free_span, span_to_free);
-			}
-			
-			// 3: Make sure spans are correct
-			
-			start_span->len = at_in_start_span;
-			
-			
-			
-			// TODO: I see similarities between here and the case in which they're the same span.
-			// Maybe they're the same case.
-			
-			i64 to_copy = end_span->len - at_in_end_span;
-			memmove(end_span->data + 0, end_span->data + at_in_end_span, to_copy);
-			end_span->len = to_copy;
-			
-			allow_break();
-		}
-		
-	}
-	
-	return;
-}
-
-static Point
-ed_buffer_insert_text_at_point(ED_Buffer *buffer, Point point, String text) {
-	
-	// Get all the variables
-	ED_Page *page = NULL;
-	ED_Line *line = NULL;
-	ED_Span *span = NULL;
-	i64 line_in_page = 0;
-	i64 at_in_span = 0;
-	
-	{
-		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, point.y);
-		page = rel.page;
-		line = &rel.page->lines[rel.i];
-		line_in_page = rel.i;
-	}
-	
-	{
-		ED_Span_I64 rel = ed_relative_span_from_line_and_pos(line, point.x);
-		span = rel.span;
-		at_in_span = rel.i;
-	}
-	
-	// Make space for the new lines
-	i64 newline_count = string_count_occurrences(text, '\n');
-	
-	i64 lines_after_cursor = ED_PAGE_SIZE - line_in_page - 1; // TODO: The problem is here
-	i64 dest_index = line_in_page + 1 + newline_count;
-	i64 src_index  = line_in_page + 1;
-	
-	ED_Page *dest_page = page;
-	if (newline_count > 0) {
-		if (page->line_count == ED_PAGE_SIZE) {
-			i64 lines_needed = newline_count;
-			while (lines_needed > 0) {
-				ED_Page *new_page = ed_alloc_page(buffer);
-				dll_insert(buffer->first_page, buffer->last_page, dest_page, new_page);
-				
-				dest_page = new_page;
-				dest_page->line_count = min(newline_count, ED_PAGE_SIZE);
-				
-				lines_needed -= dest_page->line_count;
-			}
-			
-			// dest_index = 0;
-		} else {
-			page->line_count += newline_count;
-			page->line_count = min(page->line_count, ED_PAGE_SIZE);
-		}
-	}
-	
-	// ed_move_lines_across_pages(dest_page, dest_index, page, src_index, lines_after_cursor);
-	ed_move_lines_across_pages(page, dest_index, page, src_index, lines_after_cursor);
-	
-	{
-		ed_render_buffer(buffer); // For debugging only
-	}
-	
-	ed_clear_line_range_across_pages(buffer, page, src_index, src_index + newline_count, true);
-	
-	buffer->line_count += newline_count;
-	
-	{
-		ed_render_buffer(buffer); // For debugging only
-	}
-	
-	
-	// Create a backup of what comes after the cursor
-	Scratch scratch = scratch_begin(0, 0);
-	
-	// TODO: Another problem is here - the original code assumed no newlines.
-	// Now we also need to get a reference to the next span, because in case of
-	// a newline it needs to be appended to the last line, not left where it is.
-	i64 after_in_span = span->len - at_in_span;
-	String temp = string_clone(scratch.arena, string(span->data + at_in_span, after_in_span));
-	
-	// Pretend the span has more space (truncate at the cursor)
-	span->len = at_in_span;
-	
-	{
-		ed_render_buffer(buffer); // For debugging only
-	}
-	
-	// Append the text, overwriting the current span and potentially creating new ones;
-	// At every newline, get the next line, safely assuming that it exists and is empty
-#if 1
-#else
-	i64 appended = 0;
-#endif
-	i64 len_after_last_newline = text.len;
-	
-	while (text.len > 0) {
-		bool has_newline = true;
-		i64 split_index = string_find_first(text, '\n');
-		if (split_index < 0) {
-			split_index = text.len;
-			has_newline = false;
-		}
-		
-		String chunk = string_stop(text, split_index);
-		text = string_skip(text, split_index + 1);
-		
-#if 1
-		ed_span_append_text_without_newlines(buffer, line, span, chunk);
-#else
-		while (appended < chunk.len) {
-			if (span->len == ED_SPAN_SIZE) {
-				ED_Span *new_span = ed_alloc_span(buffer);
-				dll_insert(line->first_span, line->last_span, span, new_span);
-				
-				span = new_span;
-			}
-			
-			i64 space   = ED_SPAN_SIZE - span->len;
-			i64 to_copy = chunk.len - appended;
-			i64 to_copy_now = min(space, to_copy);
-			memcpy(span->data + span->len, chunk.data + appended, to_copy_now);
-			span->len += to_copy_now;
-			
-			appended  += to_copy_now;
-		}
-#endif
-		
-		if (has_newline) {
-			len_after_last_newline = text.len;
-			
-			// Get the next line, safely assuming that it exists and is empty
-			if (line + 1 < page->lines + ED_PAGE_SIZE) {
-				line = line + 1;
-			} else {
-				assert(page->next); // We created it before!
-				
-				line = &page->next->lines[0];
-			}
-			
-			ED_Span *new_span = ed_alloc_span(buffer);
-			dll_push_back(line->first_span, line->last_span, new_span);
-			
-			span = new_span;
-		}
-	}
-	
-	// Copy the backup back into the line
-	ed_span_append_text_without_newlines(buffer, line, span, temp);
-	scratch_end(scratch);
-	
-	if (newline_count > 0) {
-		point.x = 0;
-	}
-	
-	Point new_cursor = {
-		.x = point.x + cast(i32) len_after_last_newline,
-		.y = point.y + cast(i32) newline_count,
-	};
-	
-	assert(ed_text_point_exists(buffer, new_cursor)); // Otherwise the logic is wrong
-	
-	return new_cursor;
-}
-
-static void
-ed_clear_line(ED_Buffer *buffer, ED_Line *line, bool deep_clean) {
-	if (!deep_clean) {
-		while (line->first_span) {
-			ED_Span *span = line->first_span;
-			dll_remove(line->first_span, line->last_span, span);
-			stack_push(buffer->first_free_span, span);
-		}
-		
-		assert(!line->last_span);
-		ED_Span *span = ed_alloc_span(buffer);
-		dll_push_back(line->first_span, line->last_span, span);
-		
-		// We remove all spans and then put one back. Is it better if we stop before removing
-		// the last one? TODO.
-	} else {
-		memset(line, 0, sizeof(ED_Line));
-		
-		ED_Span *span = ed_alloc_span(buffer);
-		dll_push_back(line->first_span, line->last_span, span);
-	}
-}
-
-static void
-ed_clear_line_range_across_pages(ED_Buffer *buffer, ED_Page *page, i64 start, i64 end, bool deep_clean) {
-	i64 count = end - start;
-	
-	i64 cleared = 0;
-	i64 to_clear_now = min(count - cleared, ED_PAGE_SIZE - start);
-	for (int i = 0; i < to_clear_now; i += 1) {
-		ED_Line *line = &page->lines[i + start];
-		ed_clear_line(buffer, line, deep_clean);
-	}
-	cleared += to_clear_now;
-	
-	page = page->next;
-	while (cleared < count) {
-		to_clear_now = min(count - cleared, ED_PAGE_SIZE);
-		for (int i = 0; i < to_clear_now; i += 1) {
-			ED_Line *line = &page->lines[i];
-			ed_clear_line(buffer, line, deep_clean);
-		}
-		cleared += to_clear_now;
-		
-		page = page->next;
-	}
-}
-
-static void
-ed_move_lines_across_pages(ED_Page *dest_page, i64 dest_index, ED_Page *src_page, i64 src_index, i64 count) {
-	Scratch scratch = scratch_begin(0, 0);
-	
-	ED_Line *temp = push_array(scratch.arena, ED_Line, count);
-	
-	// Copy lines to temporary array
-	i64 copied = 0;
-	i64 to_copy_now = max(0, min(count - copied, ED_PAGE_SIZE - src_index));
-	memcpy(temp, src_page->lines + src_index, to_copy_now * sizeof(ED_Line));
-	copied += to_copy_now;
-	
-	ED_Page *page = src_page->next;
-	while (copied < count) {
-		to_copy_now = max(0, min(count - copied, ED_PAGE_SIZE));
-		memcpy(temp + copied, page->lines, to_copy_now * sizeof(ED_Line));
-		copied += to_copy_now;
-		
-		// If the arguments to this function are valid, we should finish before this becomes null
-		page = page->next;
-	}
-	
-	// Copy temporary array back
-	copied = 0;
-	to_copy_now = max(0, min(count - copied, ED_PAGE_SIZE - dest_index));
-	memcpy(dest_page->lines + dest_index, temp, to_copy_now * sizeof(ED_Line));
-	copied += to_copy_now;
-	
-	page = dest_page->next;
-	while (copied < count) {
-		to_copy_now = max(0, min(count - copied, ED_PAGE_SIZE));
-		memcpy(page->lines, temp + copied, to_copy_now * sizeof(ED_Line));
-		copied += to_copy_now;
-		
-		// If the arguments to this function are valid, we should finish before this becomes null
-		page = page->next;
-	}
-	
-	scratch_end(scratch);
-}
-
-//- Buffer modification helper functions
-
-static ED_Span *
-ed_span_append_text_without_newlines(ED_Buffer *buffer, ED_Line *line, ED_Span *span, String text) {
-	assert(string_find_first(text, '\n') < 0); // Validate args
-	
-	i64 appended = 0;
-	
-	while (appended < text.len) {
-		if (span->len == ED_SPAN_SIZE) {
-			ED_Span *new_span = ed_alloc_span(buffer);
-			dll_insert(line->first_span, line->last_span, span, new_span);
-			
-			span = new_span;
-		}
-		
-		i64 space   = ED_SPAN_SIZE - span->len;
-		i64 to_copy = text.len - appended;
-		i64 to_copy_now = min(space, to_copy);
-		memcpy(span->data + span->len, text.data + appended, to_copy_now);
-		span->len += to_copy_now;
-		
-		appended  += to_copy_now;
-	}
-	
-	return span;
-}
-
-//- General helper functions
-
-static i64
-ed_line_len(ED_Line *line) {
-	i64 len = 0;
-	ED_Span *span = line->first_span;
-	while (span) {
-		len += span->len;
-		span = span->next;
-	}
-	return len;
-}
-
-static String
-ed_string_from_line(Arena *arena, ED_Line *line) {
-	i64 len = ed_line_len(line);
-	String result = push_string(arena, len);
-	i64 at = 0;
-	ED_Span *span = line->first_span;
-	while (span) {
-		memcpy(result.data + at, span->data, span->len);
-		at += span->len;
-		
-		span = span->next;
-	}
-	return result;
-}
-
-static ED_Span_I64
-ed_relative_span_from_line_and_pos(ED_Line *line, i64 pos) {
-	assert(pos < ed_line_len(line) + 1); // Validate args
-	
-	ED_Span_I64 result = {0};
-	
-	ED_Span *span = line->first_span;
-	while (span) {
-		// We need to add 1 here because empty spans (and therefore empty lines) are allowed.
-		if (pos < span->len + 1) {
-			result.span = span;
-			result.i    = pos;
-			break;
-		}
-		
-		pos -= span->len;
-		span = span->next;
-	}
-	
-	assert(result.span && result.span->data);
-	
-	return result;
-}
-
-static ED_Page_I64
-ed_relative_from_absolute_line(ED_Buffer *buffer, i64 absolute_line) {
-	assert(absolute_line < buffer->line_count); // Validate args
-	
-	ED_Page_I64 result = {0};
-	
-	i64 line = absolute_line;
-	ED_Page *page = buffer->first_page;
-	while (page) {
-		// We *DON'T* add 1 here because a file must contain at least 1 page with at least 1 line.
-		if (line < page->line_count) {
-			result.page = page;
-			result.i    = line;
-			break;
-		}
-		
-		line -= page->line_count;
-		page  = page->next;
-	}
-	
-	assert(result.page && result.page->lines);
-	
-	return result;
-}
-
-static ED_Line *
-ed_line_from_line_number(ED_Buffer *buffer, i64 line_number) {
-	ED_Page_I64 pair = ed_relative_from_absolute_line(buffer, line_number);
-	ED_Line  *result = &pair.page->lines[pair.i];
-	return result;
-}
-
-//- Editor input processing
-
-static ED_Text_Action
-ed_text_action_from_key(ED_Key key) {
-	ED_Text_Action action = {0};
-	
-	action.delta.direction = -1; // To make sure every case sets it.
-	
-	if (key == ED_Key_ARROW_LEFT  ||
-		key == ED_Key_ARROW_RIGHT ||
-		key == ED_Key_ARROW_UP    ||
-		key == ED_Key_ARROW_DOWN) {
-		action.delta.cross_lines = true;
-	}
-	
-	if (key == ED_Key_PAGE_UP ||
-		key == ED_Key_PAGE_DOWN) {
-		action.delta.clamp_by_window = true;
-	}
-	
-	switch (key) {
-		
-		// Navigation
-		case ED_Key_ARROW_LEFT:  { action.delta.delta = -1; action.delta.direction = Direction_HORIZONTAL; } break;
-		case ED_Key_ARROW_RIGHT: { action.delta.delta = +1; action.delta.direction = Direction_HORIZONTAL; } break;
-		
-		case ED_Key_ARROW_UP:    { action.delta.delta = -1; action.delta.direction = Direction_VERTICAL; } break;
-		case ED_Key_ARROW_DOWN:  { action.delta.delta = +1; action.delta.direction = Direction_VERTICAL; } break;
-		
-		case ED_Key_PAGE_UP:     { action.delta.delta = -1000; action.delta.direction = Direction_VERTICAL; } break;
-		case ED_Key_PAGE_DOWN:   { action.delta.delta = +1000; action.delta.direction = Direction_VERTICAL; } break;
-		
-		case ED_Key_HOME:        { action.delta.delta = -1000; action.delta.direction = Direction_HORIZONTAL; } break; // TODO: I64_MAX
-		case ED_Key_END:         { action.delta.delta = +1000; action.delta.direction = Direction_HORIZONTAL; } break; // TODO: I64_MAX
-		
-		// Deletion
-		case ED_Key_BACKSPACE: {
-			action.flags |= ED_Text_Action_Flags_DELETE;
-			action.delta.delta = -1;
-			action.delta.direction = Direction_HORIZONTAL;
-			action.delta.cross_lines = true;
-		} break;
-		
-		case CTRL_KEY('h'):
-		case ED_Key_DELETE: {
-			action.flags |= ED_Text_Action_Flags_DELETE;
-			action.delta.delta = +1;
-			action.delta.direction = Direction_HORIZONTAL;
-			action.delta.cross_lines = true;
-		} break;
-		
-		// Nothing
-		case CTRL_KEY('l'):
-		case '\x1b': {
-			allow_break();
-			action.delta.direction = Direction_HORIZONTAL; // Just to set it to something
-		} break;
-		
-		// Insertion
-		default: {
-			if (isprint(key) || key == '\t' || key == '\n') {
-				action.character = cast(u8) key;
-				action.delta.direction = Direction_HORIZONTAL;
-			}
-		} break;
-	}
-	
-	return action;
-}
-
-static ED_Text_Operation
-ed_text_operation_from_action(Arena *arena, ED_Buffer *buffer, ED_Text_Action action) {
-	ED_Text_Operation op = {0};
-	
-	// Set defaults
-	op.new_cursor     = buffer->cursor;
-	op.delete_range   = make_text_range(op.new_cursor, op.new_cursor);
-	op.replace_string = string_from_lit("");
-	
-	// Apply delta
-	op.new_cursor = ed_buffer_clamp_delta(buffer, op.new_cursor, action.delta);
-	
-	if (action.flags & ED_Text_Action_Flags_DELETE) {
-		// Mark whole region to be deleted
-		op.delete_range = make_text_range(buffer->cursor, op.new_cursor);
-		
-		// Reset the cursor
-		op.new_cursor = op.delete_range.start;
-	}
-	
-	// Insert text
-	if (action.character != 0) {
-		op.replace_string = string_clone(arena, string(&action.character, 1));
-	}
-	
-	return op;
-}
-
-static void
-ed_buffer_apply_operation(ED_Buffer *buffer, ED_Text_Operation operation) {
-	// Cursor navigation
-	buffer->cursor = operation.new_cursor;
-	
-	//
-	// For now do the separate steps independently. If it's too slow, make them happen together.
-	//
-	
-	// Remove range
-	ed_buffer_remove_range(buffer, operation.delete_range);
-	
-	// Paste replace_string
-	Point point = ed_buffer_insert_text_at_point(buffer, buffer->cursor, operation.replace_string);
-	buffer->cursor = point;
-	
-	return;
-}
-
-//- Editor helper functions
-
-static bool
-ed_buffer_is_in_use(ED_Buffer *buffer) {
-	return buffer->name.len > 0;
-}
-
-static Point
-ed_buffer_clamp_delta(ED_Buffer *buffer, Point point, ED_Delta delta) {
-	Point result = point;
-	
-	// TODO: What if the delta is encoded as a point instead of a scalar + direction?
-	
-	if (delta.delta != 0) { // If this is fast enough we can eliminate this check
-		switch (delta.direction) {
-			case Direction_HORIZONTAL: {
-				result.x += delta.delta;
-				
-				// @Speed: Store these in their respective structures?
-				ED_Line *line = ed_line_from_line_number(buffer, result.y);
-				i64 len = ed_line_len(line);
-				
-				// @Cleanup: Is there a way to simplify this codepath? It should be simple...
-				if (result.x < 0) {
-					if (delta.cross_lines) {
-						// Move to end of previous line
-						if (result.y > 0) {
-							result.y -= 1;
-							result.x = cast(i32) ed_line_len(ed_line_from_line_number(buffer, result.y)); // Get it again because it changed...
-						} else {
-							result.x = 0;
-						}
-					} else {
-						result.x = 0;
-					}
-				} else if (result.x > len) {
-					if (delta.cross_lines) {
-						// Move to start of next line
-						if (result.y < buffer->line_count - 1) {
-							result.y += 1;
-							result.x = 0;
-						} else {
-							result.x = cast(i32) len;
-						}
-					} else {
-						result.x = cast(i32) len;
-					}
-				}
-				
-			} break;
-			
-			case Direction_VERTICAL: {
-				i32 actual_delta = delta.delta;
-				
-				if (delta.clamp_by_window) {
-					actual_delta = clamp(-state.window_size.height, delta.delta, +state.window_size.height);
-				}
-				
-				result.y += actual_delta;
-				result.y = clamp(0, result.y, cast(i32) buffer->line_count - 1);
-				
-				// @Speed: Store these in their respective structures?
-				ED_Line *line = ed_line_from_line_number(buffer, result.y);
-				i64 len = ed_line_len(line);
-				
-				if (result.x > len) {
-					result.x = cast(i32) len;
-				}
-				
-			} break;
-			
-			default: {
-				result.x = 0;
-				result.y = 0;
-				
-				panic();
-			} break;
-		}
-	}
-	
-	return result;
-}
+#include "fedit_engine.c"
+
+#if OS_WINDOWS
+# include "fedit_windows.c"
+#elif OS_LINUX
+# include "fedit_linux.c"
+#endif
 
 //- Editor load/save functions
 
-static void
-ed_init_buffer_contents(ED_Buffer *buffer, SliceU8 contents) {
-	// Assumes that the raw contents encode line breaks as LF.
-	
-	assert(buffer->arena.ptr);
-	
-	buffer->cursor.x = 0;
-	buffer->cursor.y = 0;
-	buffer->vscroll = 0;
-	buffer->hscroll = 0;
-	buffer->page_count = 0;
-	buffer->line_count = 0;
-	buffer->first_page = NULL;
-	buffer->last_page  = NULL;
-	buffer->first_free_page = NULL;
-	buffer->first_free_span = NULL;
-	
-	ED_Page *page = NULL;
-	{
-		page = push_type(&buffer->arena, ED_Page);
-		page->lines = push_array(&buffer->arena, ED_Line, ED_PAGE_SIZE);
-		dll_push_back(buffer->first_page, buffer->last_page, page);
-		buffer->page_count += 1;
+static bool
+ed_load_file(String file_name, bool recover) {
+	// Overwrite previously loaded file. With 'recover', the text comes from its swap file.
+	
+	if (!state.single_buffer) {
+		state.single_buffer = push_type(&state.arena, ED_Buffer);
 	}
 	
-	i64 line_start = 0;
-	i64 line_end = 0;
-	for (i64 byte_index = 0; byte_index <= contents.len; byte_index += 1) {
-		if (byte_index == contents.len || contents.data[byte_index] == '\n') {
-			line_end = byte_index;
-			
-			// Get line
-			ED_Line *line = NULL;
-			{
-				if (page->line_count >= ED_PAGE_SIZE) {
-					page = push_type(&buffer->arena, ED_Page);
-					page->lines = push_array(&buffer->arena, ED_Line, ED_PAGE_SIZE);
-					dll_push_back(buffer->first_page, buffer->last_page, page);
-					buffer->page_count += 1;
-				}
-				
-				line = &page->lines[page->line_count];
-				page->line_count += 1;
-				buffer->line_count += 1;
-			}
-			
-			// Fill line
-			line->first_span = NULL;
-			line->last_span  = NULL;
-			
-			i64 line_len = line_end - line_start;
-			i64 copied = 0;
-			
-			while (copied < line_len || !line->first_span) {
-				// Always allocate from arena here, since the free-list has been cleared
-				// at the top of this function
-				ED_Span *span = ed_push_span(&buffer->arena);
-				dll_push_back(line->first_span, line->last_span, span);
-				
-				// No need to subtract the length (we just allocated it so it will be 0)
-				i64 space   = ED_SPAN_SIZE;
-				i64 to_copy = line_len - copied;
-				i64 to_copy_now = min(space, to_copy);
-				memcpy(span->data, contents.data + line_start + copied, to_copy_now);
-				span->len = to_copy_now;
-				
-				copied   += to_copy_now;
-			}
-			
-			assert(ed_line_len(line) == line_len);
-			
-			// Prepare for next iteration
-			line_start = line_end + 1;
+	// The swap file went with the file loaded before
+	ed_buffer_stop_autosave(state.single_buffer);
+	
+	bool ok = false;
+	if (recover) {
+		ok = ed_buffer_recover_file(state.single_buffer, file_name);
+	} else {
+		ok = ed_buffer_load_file(state.single_buffer, file_name);
+	}
+	
+	file_watch_end(&state.file_watch);
+	if (ok) {
+		state.file_watch = file_watch_begin(state.single_buffer->file_name);
+		
+		// A swap file left behind holds edits that were never saved: it stays until recovered
+		Scratch scratch = scratch_begin(0, 0);
+		if (!recover && file_info(ed_swap_file_name(scratch.arena, file_name)).ok) {
+			ed_set_status_message(string_from_lit("Found a swap file, --recover loads it"));
+		} else {
+			ed_buffer_start_autosave(state.single_buffer);
 		}
+		scratch_end(scratch);
 	}
 	
-	return;
+	return ok;
 }
 
-static bool
-ed_load_file(String file_name) {
-	// Overwrite previously loaded file.
-	
-	bool ok = false;
+static void
+ed_load_stream(Input_Stream input) {
+	// Overwrite previously loaded file, the text comes in while the editor runs
 	
 	if (!state.single_buffer) {
 		state.single_buffer = push_type(&state.arena, ED_Buffer);
 	}
 	
-	if (!state.single_buffer->arena.ptr) {
-		arena_init(&state.single_buffer->arena);
-	} else {
-		arena_reset(&state.single_buffer->arena);
-	}
-	
-	Scratch scratch = scratch_begin(0, 0);
+	ed_buffer_start_streaming(state.single_buffer, input, string_from_lit("*stdin*"));
+	file_watch_end(&state.file_watch);
+}
+
+static void
+ed_set_following(bool following) {
+	ED_Buffer *buffer = state.current_buffer;
+	state.is_following = following && buffer == state.single_buffer && buffer->file_name.len > 0;
 	
-	Read_File_Result read_file_result = read_file(scratch.arena, file_name);
-	if (read_file_result.ok) {
-		// TODO: For now let's pretend that every file is LF
-		ed_init_buffer_contents(state.single_buffer, read_file_result.contents);
+	if (state.is_following) {
+		state.follow_check_now = true;
 		
-		state.single_buffer->file_name = string_clone(&state.single_buffer->arena, file_name);
-		state.single_buffer->name      = state.single_buffer->file_name;
+		buffer->cursor.x = 0;
+		buffer->cursor.y = cast(i32) buffer->line_count - 1;
+	}
+}
+
+static bool
+ed_follow_file(void) {
+	// Takes in what was appended to the file. Returns whether the buffer changed.
+	bool changed = false;
+	ED_Buffer *buffer = state.current_buffer;
+	
+	// The watch is only asked once the whole file is in, so that nothing it reports is lost.
+	// Without a watch the size is checked every time.
+	if (state.is_following && !buffer->loader &&
+		(state.follow_check_now || !state.file_watch.ok || file_watch_poll(&state.file_watch, buffer->file_name))) {
+		state.follow_check_now = false;
+		
+		bool pinned = (buffer->cursor.y == buffer->line_count - 1);
+		
+		i64 appended = ed_buffer_append_file_tail(buffer);
+		if (appended < 0 && file_size(buffer->file_name) >= 0) {
+			// Truncated or replaced: start over with what is there now. The name lives in the
+			// buffer's arena, which loading resets.
+			Scratch scratch = scratch_begin(0, 0);
+			String file_name = string_clone(scratch.arena, buffer->file_name);
+			
+			if (ed_load_file(file_name, false)) {
+				ed_set_status_message(string_from_lit("The file was replaced, reloaded it"));
+			}
+			pinned = true;
+			appended = 1;
+			
+			scratch_end(scratch);
+		}
 		
-		ok = true;
-	} else {
-		;
+		if (appended > 0) {
+			if (pinned) {
+				buffer->cursor.x = 0;
+				buffer->cursor.y = cast(i32) buffer->line_count - 1;
+			}
+			changed = true;
+		}
 	}
 	
-	scratch_end(scratch);
-	return ok;
+	return changed;
+}
+
+static bool
+ed_check_file(bool idle) {
+	// Takes in what other programs wrote to the file, unless it is followed (that only takes
+	// appends) or has edits that would be lost. Without a watch, only looks when idle. Returns
+	// whether the buffer changed.
+	bool changed = false;
+	ED_Buffer *buffer = state.current_buffer;
+	
+	if (!state.is_following && buffer == state.single_buffer && buffer->file_name.len > 0 && !buffer->loader &&
+		(state.file_watch.ok ? file_watch_poll(&state.file_watch, buffer->file_name) : idle)) {
+		// The watch also sees the editor's own saves, which leave nothing to reload
+		File_Info info = file_info(buffer->file_name);
+		bool written = (info.ok && (info.size != buffer->file_info.size ||
+									info.modified_time != buffer->file_info.modified_time ||
+									info.id != buffer->file_info.id));
+		
+		if (written && buffer->has_unsaved_edits) {
+			ed_set_status_message(string_from_lit("The file changed on disk, Ctrl-R reloads it"));
+			changed = true;
+		} else if (written) {
+			if (ed_buffer_reload_file(buffer)) {
+				ed_set_status_message(string_from_lit("The file changed on disk, reloaded it"));
+			}
+			changed = true;
+		}
+	}
+	
+	return changed;
 }
 
 //- Editor rendering functions
@@ -1012,10 +189,7 @@ ed_buffer_update_scroll(ED_Buffer *buffer) {
 		buffer->vscroll = buffer->cursor.y - (state.window_size.height - 2) + 1;
 	}
 	
-	Scratch scratch = scratch_begin(0, 0);
-	
-	ED_Line *line = ed_line_from_line_number(buffer, buffer->cursor.y);
-	i64 cursor_render_x = ed_render_x_from_stored_x(ed_string_from_line(scratch.arena, line), buffer->cursor.x);
+	i64 cursor_render_x = ed_buffer_position_from_point(buffer, buffer->cursor).column;
 	
 	// Horizontal scroll
 	if (cursor_render_x < buffer->hscroll) {
@@ -1024,58 +198,26 @@ ed_buffer_update_scroll(ED_Buffer *buffer) {
 	if (cursor_render_x >= buffer->hscroll + state.window_size.width) {
 		buffer->hscroll = cursor_render_x - state.window_size.width + 1;
 	}
-	
-	scratch_end(scratch);
 #endif
 	
 }
 
-// Expands tab characters to spaces
-static String
-ed_render_string_from_stored_string(Arena *arena, String stored_string) {
-	int tab_count = 0;
-	for (i64 i = 0; i < stored_string.len; i += 1) {
-		if (stored_string.data[i] == '\t') {
-			tab_count += 1;
-		}
-	}
-	
-	String result;
-	result.len  = stored_string.len + tab_count*(ED_TAB_WIDTH - 1);
-	result.data = push_nozero(arena, result.len * sizeof(u8));
+static void
+ed_render_buffer(ED_Buffer *buffer) {
+	Scratch scratch = scratch_begin(0, 0);
 	
-	i64 write_index = 0;
-	for (i64 read_index = 0; read_index < stored_string.len; read_index += 1) {
-		if (stored_string.data[read_index] == '\t') {
-			for (i64 i = 0; i < ED_TAB_WIDTH; i += 1) {
-				result.data[write_index + i] = ' ';
-			}
-			write_index += ED_TAB_WIDTH;
-		} else {
-			result.data[write_index] = stored_string.data[read_index];
-			write_index += 1;
-		}
-	}
+	String frame = ed_render_frame(scratch.arena, buffer);
+	write_console_unbuffered(frame);
 	
-	return result;
+	scratch_end(scratch);
 }
 
-static i64
-ed_render_x_from_stored_x(String stored_string, i64 stored_x) {
-	i64 tab_count = 0;
-	for (i64 i = 0; i < stored_x; i += 1) {
-		if (stored_string.data[i] == '\t') {
-			tab_count += 1;
-		}
-	}
+static String
+ed_render_frame(Arena *arena, ED_Buffer *buffer) {
+	// Everything that has to be written to the terminal to draw the buffer. Comes back
+	// in the arena so that it can be measured without a terminal (see fedit_replay.c).
 	
-	i64 result = tab_count*ED_TAB_WIDTH + (stored_x - tab_count);
-	return result;
-}
-
-static void
-ed_render_buffer(ED_Buffer *buffer) {
-	Scratch scratch = scratch_begin(0, 0);
+	Scratch scratch = scratch_begin(&arena, 1);
 	
 	// TODO: Undo this pull-out of the strings and simply put in a big safety padding,
 	// this is stupid
@@ -1087,7 +229,22 @@ ed_render_buffer(ED_Buffer *buffer) {
 	String esc_reset_cursor = esc("H");
 	String esc_show_cursor = esc("?25h");
 	
-	i64 builder_cap = (state.window_size.width * state.window_size.height +
+	String esc_token_colors[ED_Token_Kind_COUNT] = {
+		[ED_Token_Kind_TEXT]         = esc("39m"),
+		[ED_Token_Kind_KEYWORD]      = esc("33m"),
+		[ED_Token_Kind_TYPE]         = esc("36m"),
+		[ED_Token_Kind_NUMBER]       = esc("31m"),
+		[ED_Token_Kind_STRING]       = esc("32m"),
+		[ED_Token_Kind_COMMENT]      = esc("34m"),
+		[ED_Token_Kind_PREPROCESSOR] = esc("35m"),
+	};
+	i64 esc_token_color_len = 0;
+	for (i64 i = 0; i < ED_Token_Kind_COUNT; i += 1) {
+		esc_token_color_len = max(esc_token_color_len, esc_token_colors[i].len);
+	}
+	
+	i64 builder_cap = (4 * state.window_size.width * state.window_size.height + // UTF-8
+					   4 * state.window_size.width * state.window_size.height * esc_token_color_len + // A color per byte at most
 					   2 * state.window_size.height +
 					   esc_hide_cursor.len +
 					   esc_clear_screen.len +
@@ -1098,7 +255,7 @@ ed_render_buffer(ED_Buffer *buffer) {
 					   1024);
 	
 	String_Builder builder;
-	string_builder_init(&builder, push_sliceu8(scratch.arena, builder_cap));
+	string_builder_init(&builder, make_sliceu8(push_nozero(arena, builder_cap), builder_cap));
 	
 	string_builder_append(&builder, esc_hide_cursor);
 	
@@ -1107,21 +264,53 @@ ed_render_buffer(ED_Buffer *buffer) {
 	{
 		i64 line_number = buffer->vscroll; // Absolute line number from the start of the buffer, the first that is visible
 		
+		int num_rows_to_draw = state.window_size.height - 2; // Subtract the status bar and the status message
+		
+		// Before finding the first page, which this can materialize
+		ED_Line_Tokens *highlights = ed_buffer_highlight_lines(scratch.arena, buffer, line_number, num_rows_to_draw,
+															   buffer->hscroll, state.window_size.width);
+		
 		ED_Page_I64 rel_line = ed_relative_from_absolute_line(buffer, line_number);
 		ED_Page *page = rel_line.page;
 		i64 line_relative_to_start_of_page = rel_line.i;
 		
-		int num_rows_to_draw = state.window_size.height - 2; // Subtract the status bar and the status message
-		
 		for (int y = 0; y < num_rows_to_draw; y += 1) {
 			if (page && line_relative_to_start_of_page < page->line_count) {
 				{
 					// Print line
 					ED_Line *line = &page->lines[line_relative_to_start_of_page];
-					String render_line = ed_render_string_from_stored_string(scratch.arena, ed_string_from_line(scratch.arena, line));
-					
-					i64 to_write = clamp(0, render_line.len - buffer->hscroll, state.window_size.width);
-					string_builder_append(&builder, string(render_line.data + buffer->hscroll, to_write));
+					ED_Line_Position start = ed_buffer_line_position_from_column(buffer, line, line_number + y, buffer->hscroll);
+					if (highlights) {
+						// Run by run, each in its color. The text of the row is still held to what
+						// ed_render_line_window would give it, and a color only goes out with text.
+						ED_Line_Tokens tokens = highlights[y];
+						i64 row_cap = 4 * state.window_size.width;
+						String_Builder row = {0};
+						string_builder_init(&row, make_sliceu8(push_nozero(scratch.arena, row_cap), row_cap));
+						
+						ED_Line_Position position = start;
+						ED_Token_Kind color = ED_Token_Kind_TEXT;
+						for (i64 i = 0; i < tokens.count; i += 1) {
+							i64 end_x = (i + 1 < tokens.count) ? tokens.tokens[i + 1].x : INT64_MAX;
+							i64 row_len = row.len;
+							position = ed_render_line_run(&row, position, end_x, buffer->hscroll, state.window_size.width);
+							
+							if (row.len > row_len) {
+								if (tokens.tokens[i].kind != color) {
+									color = tokens.tokens[i].kind;
+									string_builder_append(&builder, esc_token_colors[color]);
+								}
+								string_builder_append(&builder, string(row.data + row_len, row.len - row_len));
+							}
+						}
+						
+						if (color != ED_Token_Kind_TEXT) {
+							string_builder_append(&builder, esc_token_colors[ED_Token_Kind_TEXT]);
+						}
+					} else {
+						String render_line = ed_render_line_window(scratch.arena, start, buffer->hscroll, state.window_size.width);
+						string_builder_append(&builder, render_line);
+					}
 				}
 				
 				// check for end of page
@@ -1129,6 +318,10 @@ ed_render_buffer(ED_Buffer *buffer) {
 				if (line_relative_to_start_of_page == page->line_count) {
 					page = page->next;
 					line_relative_to_start_of_page = 0;
+					
+					if (page && !page->lines) {
+						page = ed_buffer_materialize_page(buffer, page);
+					}
 				}
 			} else {
 				if (buffer == state.null_buffer && y == state.window_size.height / 3) {
@@ -1166,8 +359,19 @@ ed_render_buffer(ED_Buffer *buffer) {
 			char status[80];
 			if (buffer != state.null_buffer) {
 				String buffer_name = buffer->name;
-				len = snprintf(status, sizeof(status), "%.*s - %d lines",
-							   string_expand(buffer_name), cast(i32) buffer->line_count);
+				char *line_ending = buffer->line_ending == ED_Line_Ending_CRLF ? " (CRLF)" : "";
+				char *encoding    = buffer->has_invalid_utf8 ? " (invalid UTF-8)" : "";
+				char loading[32]  = {0};
+				if (buffer->loader) {
+					snprintf(loading, sizeof(loading), " (loading %d%%)", cast(int) (ed_buffer_load_progress(buffer) * 100));
+				} else if (buffer->stream) {
+					snprintf(loading, sizeof(loading), " (reading)");
+				} else if (state.is_following) {
+					snprintf(loading, sizeof(loading), " (following)");
+				}
+				len = snprintf(status, sizeof(status), "%.*s - %d lines%s%s%s",
+							   string_expand(buffer_name), cast(i32) buffer->line_count, line_ending, encoding, loading);
+				len = min(len, cast(int) sizeof(status) - 1);
 				len = min(len, state.window_size.width);
 				string_builder_append(&builder, string(cast(u8 *) status, len));
 			} else {
@@ -1175,9 +379,19 @@ ed_render_buffer(ED_Buffer *buffer) {
 				string_builder_append(&builder, string(cast(u8 *) status, len));
 			}
 			
-			for (int x = len; x < state.window_size.width; x += 1) {
+			// The HUD goes on the right, as long as it fits
+			String hud = {0};
+			if (state.show_hud) {
+				hud = ed_hud_string(scratch.arena);
+				if (len + 1 + hud.len > state.window_size.width) {
+					hud.len = 0;
+				}
+			}
+			
+			for (int x = len; x < state.window_size.width - hud.len; x += 1) {
 				string_builder_append(&builder, string_from_lit(" "));
 			}
+			string_builder_append(&builder, hud);
 			
 			string_builder_append(&builder, esc_reset_colors);
 		}
@@ -1199,8 +413,7 @@ ed_render_buffer(ED_Buffer *buffer) {
 	// Move cursor
 	char buf[32] = {0};
 	
-	ED_Line *current_line = ed_line_from_line_number(buffer, buffer->cursor.y);
-	i64 cursor_render_x = ed_render_x_from_stored_x(ed_string_from_line(scratch.arena, current_line), buffer->cursor.x);
+	i64 cursor_render_x = ed_buffer_position_from_point(buffer, buffer->cursor).column;
 	
 	i32 cursor_y_on_screen = buffer->cursor.y - cast(i32) buffer->vscroll; // TODO: Review this cast
 	i32 cursor_x_on_screen = cast(i32) cursor_render_x - cast(i32) buffer->hscroll; // TODO: Review this cast
@@ -1210,66 +423,270 @@ ed_render_buffer(ED_Buffer *buffer) {
 	string_builder_append(&builder, esc_show_cursor);
 	
 	// assert(builder.len == builder.cap);
-	write_console_unbuffered(string_from_builder(builder));
+	String result = string_from_builder(builder);
+	
+	scratch_end(scratch);
+	return result;
+}
+
+//- Session trace functions
+
+static bool
+ed_load_trace(Arena *arena, String file_name, ED_Trace *trace) {
+	bool ok = false;
+	
+	Read_File_Result read_file_result = read_file(arena, file_name);
+	if (read_file_result.ok && read_file_result.contents.len >= cast(i64) sizeof(ED_Trace_Header)) {
+		memcpy(&trace->header, read_file_result.contents.data, sizeof(ED_Trace_Header));
+		
+		if (trace->header.magic == ED_TRACE_MAGIC && trace->header.version == ED_TRACE_VERSION) {
+			// A recording cut short by a crash can end in the middle of an event, drop it
+			i64 events_size = read_file_result.contents.len - sizeof(ED_Trace_Header);
+			trace->events      = cast(ED_Trace_Event *) (read_file_result.contents.data + sizeof(ED_Trace_Header));
+			trace->event_count = events_size / cast(i64) sizeof(ED_Trace_Event);
+			
+			ok = true;
+		}
+	}
+	
+	return ok;
+}
+
+static bool
+ed_begin_recording(String file_name) {
+	bool ok = false;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	state.record_file = fopen(cstring_from_string(scratch.arena, file_name), "wb");
+	if (state.record_file) {
+		ED_Trace_Header header = {0};
+		header.magic         = ED_TRACE_MAGIC;
+		header.version       = ED_TRACE_VERSION;
+		header.window_width  = cast(u16) state.window_size.width;
+		header.window_height = cast(u16) state.window_size.height;
+		
+		ok = fwrite(&header, sizeof(header), 1, state.record_file) == 1;
+		state.record_start_ns = get_time_ns();
+	}
 	
 	scratch_end(scratch);
+	return ok;
 }
 
-//- Editor debug functions
+static void
+ed_end_recording(void) {
+	if (state.record_file) {
+		fclose(state.record_file);
+		state.record_file = NULL;
+	}
+}
 
 static bool
-ed_text_point_exists(ED_Buffer *buffer, Point point) {
-	bool exists = true;
+ed_begin_replay(String file_name, bool in_real_time) {
+	bool ok = ed_load_trace(&state.arena, file_name, &state.replay_trace);
 	
-	if (point.y < 0 || point.y > buffer->line_count) {
-		exists = false;
+	if (ok) {
+		state.is_replaying        = true;
+		state.replay_in_real_time = in_real_time;
+		state.replay_event_index  = 0;
+		state.replay_start_ns     = get_time_ns();
+		
+		state.window_size.width  = state.replay_trace.header.window_width;
+		state.window_size.height = state.replay_trace.header.window_height;
 	}
 	
-	if (exists) {
-		ED_Line *line = ed_line_from_line_number(buffer, point.y);
-		if (point.x < 0 || point.x > ed_line_len(line)) {
-			exists = false;
+	return ok;
+}
+
+static ED_Key
+ed_next_key(i64 timeout_ms) {
+	ED_Key key = ED_Key_NONE;
+	
+	if (state.is_replaying) {
+		if (state.replay_event_index < state.replay_trace.event_count) {
+			ED_Trace_Event event = state.replay_trace.events[state.replay_event_index];
+			state.replay_event_index += 1;
+			
+			if (state.replay_in_real_time) {
+				u64 elapsed_ms = (get_time_ns() - state.replay_start_ns) / 1000000;
+				if (event.time_ms > elapsed_ms) {
+					sleep_ms(event.time_ms - elapsed_ms);
+				}
+			}
+			
+			state.window_size.width  = event.window_width;
+			state.window_size.height = event.window_height;
+			key = cast(ED_Key) event.key;
+		} else {
+			key = CTRL_KEY('q'); // Nothing left to replay
 		}
+	} else {
+		key = wait_for_key(timeout_ms);
+	}
+	
+	if (state.record_file) {
+		ED_Trace_Event event = {0};
+		event.time_ms       = cast(u32) ((get_time_ns() - state.record_start_ns) / 1000000);
+		event.key           = cast(u32) key;
+		event.window_width  = cast(u16) state.window_size.width;
+		event.window_height = cast(u16) state.window_size.height;
+		
+		// Flushed every time so that the trace survives a crash, which is often the
+		// session we want to look at.
+		fwrite(&event, sizeof(event), 1, state.record_file);
+		fflush(state.record_file);
 	}
 	
-	return exists;
+	return key;
 }
 
 static void
-ed_validate_buffer(ED_Buffer *buffer) {
-	{
-		// Check that global line-count is valid
-		i64 line_count = 0;
+ed_update_window_size(void) {
+	// While replaying, the window size comes from the trace
+	if (!state.is_replaying) {
+		if (!query_window_size(&state.window_size)) {
+			panic();
+		}
+	}
+}
+
+//- Frame profiling functions
+
+static void
+ed_frame_begin(void) {
+	memset(&state.frame, 0, sizeof(state.frame));
+	state.frame_start_ns            = get_time_ns();
+	state.frame_start_console_stats = console_stats;
+	state.frame_start_mem_stats     = mem_stats;
+}
+
+static u64
+ed_frame_stage_begin(ED_Frame_Stage stage) {
+	trace_begin(ed_frame_stage_names[stage]);
+	return get_time_ns();
+}
+
+static void
+ed_frame_stage_end(ED_Frame_Stage stage, u64 start_ns) {
+	state.frame.stage_ns[stage] += get_time_ns() - start_ns;
+	trace_end(ed_frame_stage_names[stage]);
+}
+
+static u64
+ed_mem_call_count(Mem_Stats stats) {
+	return stats.reserve_count + stats.commit_count + stats.decommit_count + stats.release_count;
+}
+
+static void
+ed_frame_end(void) {
+	ED_Frame_Stats *frame = &state.frame;
+	
+	frame->total_ns        = get_time_ns() - state.frame_start_ns;
+	frame->bytes_written   = console_stats.bytes_written - state.frame_start_console_stats.bytes_written;
+	frame->syscall_count   = (console_stats.write_count - state.frame_start_console_stats.write_count +
+							  ed_mem_call_count(mem_stats) - ed_mem_call_count(state.frame_start_mem_stats));
+	frame->committed_bytes = cast(i64) (mem_stats.committed_bytes - state.frame_start_mem_stats.committed_bytes);
+	
+	state.frame_history[state.frame_count % ED_FRAME_HISTORY_COUNT] = *frame;
+	state.frame_count += 1;
+	
+	trace_counter("bytes written",   cast(i64) frame->bytes_written);
+	trace_counter("committed bytes", cast(i64) mem_stats.committed_bytes);
+	trace_counter("span count",      state.current_buffer->span_count);
+	
+	if (logfile) {
+		if (frame->total_ns >= ED_SLOW_FRAME_MS * 1000000ULL) {
+			fprintf(logfile, "slow frame %lld: %.2f ms (input %.2f, apply %.2f, validate %.2f, scroll %.2f, render %.2f), "
+					"%llu bytes written, %llu syscalls, %+lld bytes committed\n",
+					cast(long long) state.frame_count,
+					cast(double) frame->total_ns / 1000000.0,
+					cast(double) frame->stage_ns[ED_Frame_Stage_INPUT]    / 1000000.0,
+					cast(double) frame->stage_ns[ED_Frame_Stage_APPLY]    / 1000000.0,
+					cast(double) frame->stage_ns[ED_Frame_Stage_VALIDATE] / 1000000.0,
+					cast(double) frame->stage_ns[ED_Frame_Stage_SCROLL]   / 1000000.0,
+					cast(double) frame->stage_ns[ED_Frame_Stage_RENDER]   / 1000000.0,
+					cast(unsigned long long) frame->bytes_written,
+					cast(unsigned long long) frame->syscall_count,
+					cast(long long) frame->committed_bytes);
+		}
 		
-		ED_Page *page = buffer->first_page;
-		while (page) {
-			line_count += page->line_count;
-			page = page->next;
+		if (state.frame_count % ED_FRAME_HISTORY_COUNT == 0) {
+			ed_log_frame_percentiles();
+		}
+	}
+}
+
+static int
+ed_compare_u64(const void *a, const void *b) {
+	u64 x = *cast(u64 *) a;
+	u64 y = *cast(u64 *) b;
+	return (x > y) - (x < y);
+}
+
+static u64
+ed_frame_percentile(i64 stage, i64 percent) {
+	u64 result = 0;
+	
+	i64 count = min(state.frame_count, ED_FRAME_HISTORY_COUNT);
+	if (count > 0) {
+		u64 values[ED_FRAME_HISTORY_COUNT];
+		for (i64 i = 0; i < count; i += 1) {
+			ED_Frame_Stats *frame = &state.frame_history[i];
+			values[i] = stage < ED_Frame_Stage_COUNT ? frame->stage_ns[stage] : frame->total_ns;
 		}
 		
-		assert(line_count == buffer->line_count);
-		assert(line_count > 0);
+		qsort(values, count, sizeof(u64), ed_compare_u64);
+		result = values[min(count - 1, count * percent / 100)];
 	}
 	
-	{
-		// Check that each line has at least a span
-		ED_Page *page = buffer->first_page;
-		while (page) {
-			for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
-				assert(page->lines[line_index].first_span);
-				assert(page->lines[line_index].last_span);
-			}
-			page = page->next;
+	return result;
+}
+
+static void
+ed_log_frame_percentiles(void) {
+	// Over the last ED_FRAME_HISTORY_COUNT frames
+	if (logfile) {
+		fprintf(logfile, "frames up to %lld (ms):", cast(long long) state.frame_count);
+		for (i64 stage = 0; stage <= ED_Frame_Stage_COUNT; stage += 1) {
+			fprintf(logfile, " %s p50 %.3f p90 %.3f p99 %.3f%s",
+					stage < ED_Frame_Stage_COUNT ? ed_frame_stage_names[stage] : "frame",
+					cast(double) ed_frame_percentile(stage, 50) / 1000000.0,
+					cast(double) ed_frame_percentile(stage, 90) / 1000000.0,
+					cast(double) ed_frame_percentile(stage, 99) / 1000000.0,
+					stage < ED_Frame_Stage_COUNT ? "," : "\n");
 		}
+		fflush(logfile);
 	}
-	
-	{
-		// Check that first page has at least 1 line
-		ED_Page *page = buffer->first_page;
-		assert(page->line_count > 0);
+}
+
+static String
+ed_hud_string(Arena *arena) {
+	// The last complete frame, then the percentiles of the whole frame time
+	String result = {0};
+	
+	if (state.frame_count > 0) {
+		ED_Frame_Stats *frame = &state.frame_history[(state.frame_count - 1) % ED_FRAME_HISTORY_COUNT];
+		
+		i64 cap = 128;
+		result.data = push_nozero(arena, cap);
+		result.len = snprintf(cast(char *) result.data, cap,
+							  "%.2fms in %.2f ap %.2f va %.2f sc %.2f re %.2f | p50 %.2f p99 %.2f | %lluB %llusc %+lldK",
+							  cast(double) frame->total_ns / 1000000.0,
+							  cast(double) frame->stage_ns[ED_Frame_Stage_INPUT]    / 1000000.0,
+							  cast(double) frame->stage_ns[ED_Frame_Stage_APPLY]    / 1000000.0,
+							  cast(double) frame->stage_ns[ED_Frame_Stage_VALIDATE] / 1000000.0,
+							  cast(double) frame->stage_ns[ED_Frame_Stage_SCROLL]   / 1000000.0,
+							  cast(double) frame->stage_ns[ED_Frame_Stage_RENDER]   / 1000000.0,
+							  cast(double) ed_frame_percentile(ED_Frame_Stage_COUNT, 50) / 1000000.0,
+							  cast(double) ed_frame_percentile(ED_Frame_Stage_COUNT, 99) / 1000000.0,
+							  cast(unsigned long long) frame->bytes_written,
+							  cast(unsigned long long) frame->syscall_count,
+							  cast(long long) frame->committed_bytes / 1024);
+		result.len = clamp(0, result.len, cap - 1);
 	}
 	
-	allow_break();
+	return result;
 }
 
 //- Editor global state functions
@@ -1282,9 +699,21 @@ ed_set_status_message(String message) {
 
 //- Entry point
 
+#if !defined(FEDIT_NO_ENTRY_POINT)
+
 int main(int argc, char **argv) {
 	
 	before_main();
+	
+	// With `cmd | fedit -` the text comes through stdin, and the keys have to be read from the
+	// terminal instead. That has to be sorted out before the terminal is set up.
+	Input_Stream input_stream = {0};
+	for (int arg_index = 1; arg_index < argc; arg_index += 1) {
+		if (strcmp(argv[arg_index], "-") == 0) {
+			input_stream = input_stream_from_stdin();
+		}
+	}
+	
 	enable_raw_mode();
 	
 	logfile = fopen("log.txt", "w");
@@ -1295,6 +724,8 @@ int main(int argc, char **argv) {
 		arena_init(&state.arena);
 		arena_init(&state.frame_arena);
 		
+		state.validation_level = ED_Validation_Level_TOUCHED;
+		
 		if (!query_window_size(&state.window_size)) {
 			panic();
 		}
@@ -1321,27 +752,110 @@ int main(int argc, char **argv) {
 			
 			state.null_buffer->first_page->lines[0].first_span->data = cast(u8 *) "~";
 			state.null_buffer->first_page->lines[0].first_span->len = 1;
+			state.null_buffer->span_count = 1;
+			state.null_buffer->byte_count = 1;
 			
 			state.null_buffer->is_read_only = true;
 		}
 		
 		state.current_buffer = state.null_buffer;
 		
-		ed_set_status_message(string_from_lit("Ctrl-Q to quit"));
+		ed_set_status_message(string_from_lit("Ctrl-S to save, Ctrl-Q to quit"));
 	}
 	
+	String file_name = {0};
+	
 	{
 		// Parse command-line args
-		if (argc > 1) {
-			String file_name = string_from_cstring(argv[1]);
-			bool loaded = ed_load_file(file_name);
+		String record_file_name = {0};
+		String replay_file_name = {0};
+		bool   replay_in_real_time = false;
+		String profile_file_name = {0};
+		bool   follow = false;
+		bool   read_stdin = false;
+		bool   recover = false;
+		
+		for (int arg_index = 1; arg_index < argc; arg_index += 1) {
+			char *arg = argv[arg_index];
+			if (strcmp(arg, "--record") == 0 && arg_index + 1 < argc) {
+				arg_index += 1;
+				record_file_name = string_from_cstring(argv[arg_index]);
+			} else if (strcmp(arg, "--replay") == 0 && arg_index + 1 < argc) {
+				arg_index += 1;
+				replay_file_name = string_from_cstring(argv[arg_index]);
+			} else if (strcmp(arg, "--realtime") == 0) {
+				replay_in_real_time = true;
+			} else if (strcmp(arg, "--follow") == 0) {
+				follow = true;
+			} else if (strcmp(arg, "--recover") == 0) {
+				recover = true;
+			} else if (strcmp(arg, "-") == 0) {
+				read_stdin = true;
+			} else if (strcmp(arg, "--hud") == 0) {
+				state.show_hud = true;
+			} else if (strcmp(arg, "--validate") == 0 && arg_index + 1 < argc) {
+				arg_index += 1;
+				char *level = argv[arg_index];
+				if (strcmp(level, "off") == 0) {
+					state.validation_level = ED_Validation_Level_OFF;
+				} else if (strcmp(level, "touched") == 0) {
+					state.validation_level = ED_Validation_Level_TOUCHED;
+				} else if (strcmp(level, "sampled") == 0) {
+					state.validation_level = ED_Validation_Level_SAMPLED;
+				} else if (strcmp(level, "full") == 0) {
+					state.validation_level = ED_Validation_Level_FULL;
+				} else {
+					ed_set_status_message(string_from_lit("Unknown validation level"));
+				}
+			} else if (strcmp(arg, "--profile") == 0 && arg_index + 1 < argc) {
+				arg_index += 1;
+				profile_file_name = string_from_cstring(argv[arg_index]);
+			} else {
+				file_name = string_from_cstring(arg);
+			}
+		}
+		
+		// First, so that loading the file shows up in the trace
+		if (profile_file_name.len > 0) {
+			if (!trace_begin_session(profile_file_name)) {
+				ed_set_status_message(string_from_lit("Failed to start profiling"));
+			}
+		}
+		
+		if (replay_file_name.len > 0) {
+			if (!ed_begin_replay(replay_file_name, replay_in_real_time)) {
+				ed_set_status_message(string_from_lit("Failed to load the trace to replay"));
+			}
+		}
+		
+		// After the replay has set up the window size, so that the trace starts with it
+		if (record_file_name.len > 0) {
+			if (!ed_begin_recording(record_file_name)) {
+				ed_set_status_message(string_from_lit("Failed to start recording"));
+			}
+		}
+		
+		if (read_stdin) {
+			if (input_stream.ok) {
+				ed_load_stream(input_stream);
+				state.current_buffer = state.single_buffer;
+			} else {
+				ed_set_status_message(string_from_lit("Nothing is piped into stdin"));
+			}
+		} else if (file_name.len > 0) {
+			bool loaded = ed_load_file(file_name, recover);
 			
 			if (loaded) {
 				state.current_buffer = state.single_buffer;
+				ed_set_following(follow);
 			} else {
 				// If the file doesn't exist, simply leave the editor open with no loaded files
 				// Display a log message at the bottom or something
-				ed_set_status_message(string_from_lit("Failed to load file"));
+				if (recover) {
+					ed_set_status_message(string_from_lit("No swap file to recover the file from"));
+				} else {
+					ed_set_status_message(string_from_lit("Failed to load file"));
+				}
 				
 				state.current_buffer = state.null_buffer;
 			}
@@ -1350,7 +864,7 @@ int main(int argc, char **argv) {
 	
 	assert(state.current_buffer); // Always!
 	
-	if (argc > 1) {
+	if (file_name.len > 0) {
 		// Temporary
 #if 0
 		{
@@ -1380,31 +894,150 @@ int main(int argc, char **argv) {
 #endif
 	}
 	
+	bool needs_redraw = true;
+	ed_frame_begin();
+	
 	while (true) {
 		assert(state.current_buffer); // Always!
-		ed_validate_buffer(state.current_buffer); // Always!
 		
-		ed_buffer_update_scroll(state.current_buffer);
+		if (needs_redraw) {
+			u64 start_ns = ed_frame_stage_begin(ED_Frame_Stage_VALIDATE);
+			ed_validate_buffer(state.current_buffer, state.validation_level);
+			ed_frame_stage_end(ED_Frame_Stage_VALIDATE, start_ns);
+			
+			start_ns = ed_frame_stage_begin(ED_Frame_Stage_SCROLL);
+			ed_buffer_update_scroll(state.current_buffer);
+			ed_frame_stage_end(ED_Frame_Stage_SCROLL, start_ns);
+			
+			start_ns = ed_frame_stage_begin(ED_Frame_Stage_RENDER);
+			ed_render_buffer(state.current_buffer);
+			ed_frame_stage_end(ED_Frame_Stage_RENDER, start_ns);
+			
+			ed_frame_end();
+			
+			needs_redraw = false;
+		}
+		
+		ed_update_window_size();
+		state.current_buffer->viewport_height = state.window_size.height;
 		
-		ed_render_buffer(state.current_buffer);
+		Size old_window_size = state.window_size; // A replayed key can come with a new size
 		
-		if (!query_window_size(&state.window_size)) {
-			panic();
+		// Wake up more often while text comes in (loaded, streamed or followed), to show it
+		i64 timeout_ms = ED_IDLE_TIMEOUT_MS;
+		if (state.is_following) {
+			timeout_ms = ED_FOLLOW_POLL_MS;
+		} else if (state.current_buffer->loader || state.current_buffer->stream) {
+			timeout_ms = ED_LOAD_REFRESH_MS;
 		}
 		
-		ED_Key key = wait_for_key();
+		ED_Key key = ed_next_key(timeout_ms);
 		if (key == CTRL_KEY('q')) {
 			clear();
 			goto main_loop_end;
 		}
 		
+		ed_frame_begin();
+		
+		bool loaded_more = ed_buffer_update_loading(state.current_buffer);
+		bool streamed    = ed_buffer_update_streaming(state.current_buffer);
+		bool followed    = ed_follow_file();
+		bool reloaded    = ed_check_file(key == ED_Key_NONE);
+		
+		// After the reload, which leaves nothing to autosave
+		ed_buffer_update_autosave(state.current_buffer, key == ED_Key_NONE);
+		
+		if (key == CTRL_KEY('p')) {
+			state.show_hud = !state.show_hud;
+			needs_redraw = true;
+			continue;
+		}
+		
+		if (key == CTRL_KEY('s')) {
+			ED_Buffer *buffer = state.current_buffer;
+			if (buffer->is_read_only) {
+				ed_set_status_message(string_from_lit("The buffer is read only"));
+			} else if (buffer->file_name.len == 0) {
+				ed_set_status_message(string_from_lit("The buffer has no file to save to"));
+			} else if (ed_buffer_save_file(buffer, buffer->file_name)) {
+				ed_set_status_message(string_from_lit("Saved"));
+			} else {
+				ed_set_status_message(string_from_lit("Failed to save file"));
+			}
+			needs_redraw = true;
+			continue;
+		}
+		
+		if (key == CTRL_KEY('t')) {
+			ed_set_following(!state.is_following);
+			if (state.is_following) {
+				ed_set_status_message(string_from_lit("Following the file"));
+			} else if (state.current_buffer == state.single_buffer) {
+				ed_set_status_message(string_from_lit("Stopped following the file"));
+			} else {
+				ed_set_status_message(string_from_lit("No file to follow"));
+			}
+			needs_redraw = true;
+			continue;
+		}
+		
+		if (key == CTRL_KEY('r')) {
+			// Whatever the edits
+			ED_Buffer *buffer = state.current_buffer;
+			if (buffer != state.single_buffer || buffer->file_name.len == 0) {
+				ed_set_status_message(string_from_lit("No file to reload"));
+			} else if (ed_buffer_reload_file(buffer)) {
+				ed_set_status_message(string_from_lit("Reloaded the file"));
+			} else {
+				ed_set_status_message(string_from_lit("Failed to reload the file"));
+			}
+			needs_redraw = true;
+			continue;
+		}
+		
+		if (key == CTRL_KEY('k')) {
+			// Check the whole buffer now, whatever the level used for every frame
+			ed_validate_buffer(state.current_buffer, ED_Validation_Level_FULL);
+			ed_set_status_message(string_from_lit("Buffer checked"));
+			needs_redraw = true;
+			continue;
+		}
+		
+		if (key == ED_Key_NONE) {
+			// Nothing happened for a while: do the work that can wait
+			ed_buffer_collect_snapshots(state.current_buffer);
+			ed_buffer_reclaim_zombie_pages(state.current_buffer, ED_RECLAIM_IDLE_PAGE_COUNT);
+			ed_buffer_evict_cold_pages(state.current_buffer, state.current_buffer->vscroll, state.window_size.height);
+			
+			if (ed_buffer_should_compact(state.current_buffer, true)) {
+				ed_buffer_compact(state.current_buffer);
+			}
+			
+			ed_update_window_size();
+			
+			needs_redraw = (loaded_more || streamed || followed || reloaded ||
+							old_window_size.width  != state.window_size.width ||
+							old_window_size.height != state.window_size.height);
+			continue;
+		}
+		
+		needs_redraw = true;
+		
 #if 1
 		
+		u64 start_ns = ed_frame_stage_begin(ED_Frame_Stage_INPUT);
 		ED_Text_Action action = ed_text_action_from_key(key);
 		ED_Text_Operation operation = ed_text_operation_from_action(&state.frame_arena, state.current_buffer, action);
+		ed_frame_stage_end(ED_Frame_Stage_INPUT, start_ns);
 		
+		start_ns = ed_frame_stage_begin(ED_Frame_Stage_APPLY);
 		ed_buffer_apply_operation(state.current_buffer, operation);
 		
+		if (ed_buffer_should_compact(state.current_buffer, false)) {
+			ed_buffer_compact(state.current_buffer);
+		}
+		ed_frame_stage_end(ED_Frame_Stage_APPLY, start_ns);
+		
 		arena_reset(&state.frame_arena);
 		
 #else
@@ -1480,8 +1113,21 @@ int main(int argc, char **argv) {
 	
 	main_loop_end:;
 	
+	if (state.single_buffer) {
+		ed_buffer_stop_loading(state.single_buffer);
+		ed_buffer_stop_autosave(state.single_buffer); // Unsaved edits stay in the swap file
+	}
+	file_watch_end(&state.file_watch);
+	
+	ed_end_recording();
+	
+	ed_log_frame_percentiles();
 	fclose(logfile);
 	
+	trace_end_session();
+	
 	disable_raw_mode();
 	return exit_code;
 }
+
+#endif
@@ -5,7 +5,6 @@
 ** Fix cursor positioning with tabs
 ** "Ghost" cursor position
 ** Save, Save-as, Open
-** Basic syntax highlighting
 ** Better status bar
 */
 
@@ -16,110 +15,72 @@
 
 #define FEDIT_VERSION "1"
 
-#define CTRL_KEY(k) ((k) & 0x1f)
-
 #define ESCAPE_BYTE   '\x1b'
 #define ESCAPE_PREFIX "\x1b["
 
 #define esc(code) string_from_lit(ESCAPE_PREFIX code)
 
-#define ED_SPAN_SIZE 64
-#define ED_PAGE_SIZE  4
-
-#define ED_TAB_WIDTH 4
+#define ED_IDLE_TIMEOUT_MS 2000
+#define ED_LOAD_REFRESH_MS 100
+#define ED_FOLLOW_POLL_MS  50
 
-//- Editor types
+// Frames slower than this get their breakdown written to the log as they happen
+#define ED_SLOW_FRAME_MS 16
 
-enum ED_Key {
-	ED_Key_BACKSPACE = 127,
-	ED_Key_ARROW_UP  = 256 + 1,
-	ED_Key_ARROW_LEFT,
-	ED_Key_ARROW_DOWN,
-	ED_Key_ARROW_RIGHT,
-	ED_Key_PAGE_UP,
-	ED_Key_PAGE_DOWN,
-	ED_Key_HOME,
-	ED_Key_END,
-	ED_Key_DELETE,
-};
-typedef enum ED_Key ED_Key;
-
-
-enum ED_Text_Action_Flags {
-	ED_Text_Action_Flags_COPY   = (1<<0),
-	ED_Text_Action_Flags_PASTE  = (1<<1),
-	ED_Text_Action_Flags_DELETE = (1<<2),
-};
-typedef enum ED_Text_Action_Flags ED_Text_Action_Flags;
+// Frames kept for the HUD percentiles, which are also written to the log every time the
+// history fills up
+#define ED_FRAME_HISTORY_COUNT 256
 
-typedef struct ED_Delta ED_Delta;
-struct ED_Delta {
-	i32 delta;
-	Direction direction;
-	
-	// TODO: Make flags
-	bool cross_lines;
-	bool clamp_by_window;
-};
+#define ED_TRACE_MAGIC   0x54444546 // "FEDT" when read as bytes on a little-endian machine
+#define ED_TRACE_VERSION 1
 
-typedef struct ED_Text_Action ED_Text_Action;
-struct ED_Text_Action {
-	ED_Text_Action_Flags flags;
-	ED_Delta delta;
-	u8 character;
-};
+//- Editor types
 
-typedef struct ED_Text_Operation ED_Text_Operation;
-struct ED_Text_Operation {
-	Text_Range delete_range;
-	String     replace_string;
-	Point      new_cursor;
+// Session traces are a header followed by one event per key returned by wait_for_key
+// (timeouts included), all in the byte order of the machine that recorded them.
+typedef struct ED_Trace_Header ED_Trace_Header;
+struct ED_Trace_Header {
+	u32 magic;
+	u32 version;
+	u16 window_width; // Window size when the recording started
+	u16 window_height;
 };
 
-
-typedef struct ED_Span ED_Span;
-struct ED_Span {
-	ED_Span *next;
-	ED_Span *prev;
-	
-	u8  *data;
-	i64  len;
+typedef struct ED_Trace_Event ED_Trace_Event;
+struct ED_Trace_Event {
+	u32 time_ms; // Since the recording started
+	u32 key;
+	u16 window_width;
+	u16 window_height;
 };
 
-typedef struct ED_Line ED_Line;
-struct ED_Line {
-	ED_Span *first_span;
-	ED_Span *last_span;
+typedef struct ED_Trace ED_Trace;
+struct ED_Trace {
+	ED_Trace_Header header;
+	ED_Trace_Event *events;
+	i64 event_count;
 };
 
-typedef struct ED_Page ED_Page;
-struct ED_Page {
-	ED_Page *next;
-	ED_Page *prev;
-	
-	ED_Line *lines;
-	i64 line_count;
+enum ED_Frame_Stage {
+	ED_Frame_Stage_INPUT, // From the key to the operation to apply
+	ED_Frame_Stage_APPLY,
+	ED_Frame_Stage_VALIDATE,
+	ED_Frame_Stage_SCROLL,
+	ED_Frame_Stage_RENDER,
+	ED_Frame_Stage_COUNT,
 };
-
-typedef struct ED_Buffer ED_Buffer;
-struct ED_Buffer {
-	bool is_read_only;
-	
-	Arena arena;
-	
-	String name;
-	String file_name;
-	Point  cursor;
-	i64    vscroll;
-	i64    hscroll;
-	
-	ED_Page *first_page;
-	ED_Page *last_page;
-	i64 page_count;
-	i64 line_count;
-	
-	ED_Page *first_free_page;
-	ED_Span *first_free_span;
+typedef enum ED_Frame_Stage ED_Frame_Stage;
+
+static char *ed_frame_stage_names[ED_Frame_Stage_COUNT] = { "input", "apply", "validate", "scroll", "render" };
+
+// Everything done between receiving a key and having drawn its result.
+typedef struct ED_Frame_Stats ED_Frame_Stats;
+struct ED_Frame_Stats {
+	u64 stage_ns[ED_Frame_Stage_COUNT];
+	u64 total_ns;
+	u64 bytes_written;
+	u64 syscall_count;   // Console writes and memory calls
+	i64 committed_bytes; // Negative when memory was given back
 };
 
 typedef struct ED_State ED_State;
@@ -136,97 +97,73 @@ struct ED_State {
 	ED_Buffer *current_buffer;
 	ED_Buffer *single_buffer;
 	ED_Buffer *null_buffer;
+	
+	ED_Validation_Level validation_level; // Before drawing every frame
+	
+	// Watches the loaded file. Whatever other programs write to it is reloaded, unless the
+	// buffer has unsaved edits.
+	File_Watch file_watch;
+	
+	// Follow mode (--follow, Ctrl-T): what gets appended to the file shows up at the end of
+	// the buffer, and the cursor stays on the last line unless it was moved off it
+	bool is_following;
+	bool follow_check_now; // Whatever the watch says
+	
+	// Session recording (--record) and replay (--replay)
+	FILE *record_file;
+	u64   record_start_ns;
+	
+	ED_Trace replay_trace;
+	i64      replay_event_index;
+	u64      replay_start_ns;
+	bool     is_replaying;
+	bool     replay_in_real_time;
+	
+	// Frame profiling
+	ED_Frame_Stats frame;
+	u64            frame_start_ns;
+	Console_Stats  frame_start_console_stats;
+	Mem_Stats      frame_start_mem_stats;
+	
+	ED_Frame_Stats frame_history[ED_FRAME_HISTORY_COUNT];
+	i64            frame_count;
+	bool           show_hud;
 };
 
-//- Sinthetic types only used as return values for functions
-
-typedef struct ED_Page_I64 ED_Page_I64;
-struct ED_Page_I64 {
-	ED_Page *page;
-	i64 i;
-};
-
-typedef struct ED_Span_I64 ED_Span_I64;
-struct ED_Span_I64 {
-	ED_Span *span;
-	i64 i;
-};
-
-#if 0
-typedef struct ED_Page_Line ED_Page_Line;
-struct ED_Page_Line {
-	ED_Page *page;
-	ED_Line *line;
-};
-
-typedef struct ED_Page_Line_Span_Point ED_Page_Line_Span_Point;
-struct ED_Page_Line_Span_Point {
-	ED_Page *page;
-	ED_Line *line;
-	ED_Span *span;
-	Point point;
-};
-#endif
-
-//- Editor elements allocation functions
-
-static ED_Span *ed_push_span(Arena *arena);
-static ED_Span *ed_alloc_span(ED_Buffer *buffer);
-
-static ED_Page *ed_push_page(Arena *arena);
-static ED_Page *ed_alloc_page(ED_Buffer *buffer);
-
-//- Main buffer modification functions
-
-static void  ed_buffer_remove_range(ED_Buffer *buffer, Text_Range range);
-static Point ed_buffer_insert_text_at_point(ED_Buffer *buffer, Point point, String text);
-
-//- Buffer modification helper functions
-
-static void ed_move_lines_across_pages(ED_Page *dest_page, i64 dest_index, ED_Page *src_page, i64 src_index, i64 count);
-static ED_Span *ed_span_append_text_without_newlines(ED_Buffer *buffer, ED_Line *line, ED_Span *span, String text);
-static void ed_clear_line(ED_Buffer *buffer, ED_Line *line, bool deep_clean);
-static void ed_clear_line_range_across_pages(ED_Buffer *buffer, ED_Page *page, i64 start, i64 end, bool deep_clean);
-
-//- General helper functions
-
-static i64 ed_line_len(ED_Line *line);
-static String ed_string_from_line(Arena *arena, ED_Line *line);
-
-static Point ed_buffer_clamp_delta(ED_Buffer *buffer, Point point, ED_Delta delta);
-static bool ed_buffer_is_in_use(ED_Buffer *buffer);
-
-static ED_Span_I64 ed_relative_span_from_line_and_pos(ED_Line *line, i64 pos);
-static ED_Page_I64 ed_relative_from_absolute_line(ED_Buffer *buffer, i64 absolute_line);
-
-static ED_Line *ed_line_from_line_number(ED_Buffer *buffer, i64 line_number);
-
-//- Input processing functions
+//- Main rendering functions
 
-static ED_Text_Action    ed_text_action_from_key(ED_Key key); // TODO: Replace key with event
-static ED_Text_Operation ed_text_operation_from_action(Arena *arena, ED_Buffer *buffer, ED_Text_Action action);
+static void ed_buffer_update_scroll(ED_Buffer *buffer);
+static void ed_render_buffer(ED_Buffer *buffer);
+static String ed_render_frame(Arena *arena, ED_Buffer *buffer);
 
-static void ed_buffer_apply_operation(ED_Buffer *buffer, ED_Text_Operation op);
+//- Editor load/save functions
 
-//- Load/save functions
+static bool ed_load_file(String file_name, bool recover);
+static void ed_load_stream(Input_Stream input);
+static void ed_set_following(bool following);
+static bool ed_follow_file(void);
+static bool ed_check_file(bool idle);
 
-static void ed_init_buffer_contents(ED_Buffer *buffer, SliceU8 contents);
-static bool ed_load_file(String file_name);
+//- Session trace functions
 
-//- Main rendering functions
-
-static void ed_buffer_update_scroll(ED_Buffer *buffer);
-static void ed_render_buffer(ED_Buffer *buffer);
+static bool ed_load_trace(Arena *arena, String file_name, ED_Trace *trace);
 
-//- Rendering helper functions
+static bool   ed_begin_recording(String file_name);
+static void   ed_end_recording(void);
+static bool   ed_begin_replay(String file_name, bool in_real_time);
+static ED_Key ed_next_key(i64 timeout_ms); // wait_for_key, going through the recording or replay
+static void   ed_update_window_size(void);
 
-static String ed_render_string_from_stored_string(Arena *arena, String stored_string);
-static i64 ed_render_x_from_stored_x(String stored_string, i64 stored_x);
+//- Frame profiling functions
 
-//- Editor debug functions
+static void ed_frame_begin(void);
+static u64  ed_frame_stage_begin(ED_Frame_Stage stage); // Returns the start time to pass to ed_frame_stage_end
+static void ed_frame_stage_end(ED_Frame_Stage stage, u64 start_ns);
+static void ed_frame_end(void);
 
-static void ed_validate_buffer(ED_Buffer *buffer);
-static bool ed_text_point_exists(ED_Buffer *buffer, Point point);
+static u64    ed_frame_percentile(i64 stage, i64 percent); // ED_Frame_Stage_COUNT for the whole frame
+static void   ed_log_frame_percentiles(void);
+static String ed_hud_string(Arena *arena);
 
 //- Editor global state functions
 
@@ -244,7 +181,7 @@ static String get_clear_string(void);
 static bool query_window_size(Size *size);
 static bool query_cursor_position(Point *position);
 
-static ED_Key wait_for_key(void);
+static ED_Key wait_for_key(i64 timeout_ms); // Negative timeout = wait forever
 
 //- Editor global variables
 
@@ -95,6 +95,19 @@ round_up_to_multiple_of_i64(i64 n, i64 r) {
     return result;
 }
 
+static i64
+count_trailing_zeros_u32(u32 i) {
+	assert(i != 0);
+	
+#if COMPILER_MSVC
+	unsigned long result = 0;
+	_BitScanForward(&result, i);
+	return cast(i64) result;
+#else
+	return cast(i64) __builtin_ctz(i);
+#endif
+}
+
 ////////////////////////////////
 //~ Arena
 
@@ -102,19 +115,32 @@ round_up_to_multiple_of_i64(i64 n, i64 r) {
 
 static void
 arena_init(Arena *arena) {
-	arena_init_size(arena, DEFAULT_ARENA_RESERVE_SIZE);
+	arena_init_flags(arena, DEFAULT_ARENA_RESERVE_SIZE, DEFAULT_ARENA_FLAGS);
 }
 
 static void
 arena_init_size(Arena *arena, u64 reserve_size) {
-	u8 *base = mem_reserve(reserve_size);
+	arena_init_flags(arena, reserve_size, DEFAULT_ARENA_FLAGS);
+}
+
+static void
+arena_init_flags(Arena *arena, u64 reserve_size, Arena_Flags flags) {
+	u8 *base = NULL;
+	if (flags & Arena_Flags_LARGE_PAGES) {
+		reserve_size = round_up_to_multiple_of_u64(reserve_size, MEM_LARGE_PAGE_SIZE);
+		base = mem_reserve_large(reserve_size);
+	} else {
+		base = mem_reserve(reserve_size);
+	}
 	assert(base != NULL);
 	
-	arena->ptr  = base;
-	arena->cap  = reserve_size;
-	arena->pos  = 0;
-	arena->peak = 0;
-	arena->commit_pos = 0;
+	arena->ptr   = base;
+	arena->cap   = reserve_size;
+	arena->pos   = 0;
+	arena->peak  = 0;
+	arena->flags = flags;
+	arena->commit_pos  = 0;
+	arena->commit_step = arena_commit_granularity(arena);
 }
 
 static bool
@@ -129,6 +155,17 @@ arena_reset(Arena *arena) {
 	pop_to(arena, 0);
 }
 
+//- Arena operations: commit policy
+
+static u64
+arena_commit_granularity(Arena *arena) {
+	u64 result = ARENA_COMMIT_GRANULARITY;
+	if (arena->flags & Arena_Flags_LARGE_PAGES) {
+		result = max(result, MEM_LARGE_PAGE_SIZE);
+	}
+	return result;
+}
+
 //- Arena operations: push
 
 static void *
@@ -144,7 +181,12 @@ push_nozero_aligned(Arena *arena, u64 size, u64 alignment) {
 			arena->pos += size;
 			
 			if (arena->pos > arena->commit_pos) {
-				u64 new_commit_pos = clamp_top(align_forward(arena->pos, ARENA_COMMIT_GRANULARITY), arena->cap);
+				u64 new_commit_pos = align_forward(arena->pos, arena_commit_granularity(arena));
+				if (arena->flags & Arena_Flags_COMMIT_GROWTH) {
+					new_commit_pos = max(new_commit_pos, arena->commit_pos + arena->commit_step);
+					arena->commit_step = clamp_top(arena->commit_step * 2, ARENA_COMMIT_GROWTH_MAX);
+				}
+				new_commit_pos = clamp_top(new_commit_pos, arena->cap);
 				
 				void *commit_base = arena->ptr + arena->commit_pos;
 				u64   commit_size = new_commit_pos - arena->commit_pos;
@@ -184,14 +226,16 @@ static void
 pop_to(Arena *arena, u64 pos) {
 	arena->pos = clamp_top(pos, arena->pos); // Prevent user from going forward, only go backward.
 	
-	u64 pos_aligned_to_commit_chunks = clamp_top(align_forward(arena->pos, ARENA_COMMIT_GRANULARITY), arena->cap);
+	u64 commit_granularity = arena_commit_granularity(arena);
+	u64 pos_aligned_to_commit_chunks = clamp_top(align_forward(arena->pos, commit_granularity), arena->cap);
 	
 	if (pos_aligned_to_commit_chunks + ARENA_DECOMMIT_THRESHOLD <= arena->commit_pos) {
 		u64   decommit_size = arena->commit_pos - pos_aligned_to_commit_chunks;
 		void *decommit_base = arena->ptr + pos_aligned_to_commit_chunks;
 		
 		mem_decommit(decommit_base, decommit_size);
-		arena->commit_pos = pos_aligned_to_commit_chunks;
+		arena->commit_pos  = pos_aligned_to_commit_chunks;
+		arena->commit_step = commit_granularity; // Start growing again from the bottom
 	}
 }
 
@@ -254,6 +298,122 @@ scratch_end(Scratch scratch) {
 	arena_end_temp_region(scratch);
 }
 
+static void
+scratch_release(void) {
+	// The thread's scratch arenas go with it, or every thread started leaves them reserved
+	for (i64 scratch_arena_index = 0; scratch_arena_index < array_count(scratch_arenas); scratch_arena_index += 1) {
+		if (scratch_arenas[scratch_arena_index].ptr) {
+			arena_fini(&scratch_arenas[scratch_arena_index]);
+		}
+	}
+}
+
+////////////////////////////////
+//~ Pool
+
+static void
+pool_init(Pool *pool, Arena *arena) {
+	memset(pool, 0, sizeof(Pool));
+	pool->arena = arena;
+}
+
+//- Pool operations: size classes
+
+static i64
+pool_size_class_from_size(u64 size) {
+	i64 result = 0;
+	
+	u64 small_max = POOL_SMALL_CLASS_COUNT * POOL_SMALL_CLASS_STEP;
+	if (size <= small_max) {
+		result = cast(i64) (max(size, 1) + POOL_SMALL_CLASS_STEP - 1) / POOL_SMALL_CLASS_STEP - 1;
+	} else {
+		i64 doublings = 0;
+		u64 base = small_max;
+		while (size > base * 2) {
+			base *= 2;
+			doublings += 1;
+		}
+		
+		u64 quarter = base / 4;
+		i64 step = cast(i64) ((size - base + quarter - 1) / quarter) - 1;
+		result = POOL_SMALL_CLASS_COUNT + doublings * 4 + step;
+	}
+	
+	assert(result < POOL_SIZE_CLASS_COUNT); // Bigger blocks should come directly from an arena
+	
+	return result;
+}
+
+static u64
+pool_size_from_size_class(i64 size_class) {
+	u64 result = 0;
+	
+	if (size_class < POOL_SMALL_CLASS_COUNT) {
+		result = cast(u64) (size_class + 1) * POOL_SMALL_CLASS_STEP;
+	} else {
+		i64 doublings = (size_class - POOL_SMALL_CLASS_COUNT) / 4;
+		i64 step      = (size_class - POOL_SMALL_CLASS_COUNT) % 4;
+		
+		u64 base = (POOL_SMALL_CLASS_COUNT * POOL_SMALL_CLASS_STEP) << doublings;
+		result = base + (base / 4) * cast(u64) (step + 1);
+	}
+	
+	return result;
+}
+
+//- Pool operations: alloc/free
+
+static void *
+pool_alloc(Pool *pool, u64 size) {
+	void *result = NULL;
+	
+	i64 size_class = pool_size_class_from_size(size);
+	u64 block_size = pool_size_from_size_class(size_class);
+	Pool_Size_Class *bucket = &pool->classes[size_class];
+	
+	if (bucket->first_free) {
+		result = bucket->first_free;
+		stack_pop(bucket->first_free);
+	} else {
+		if (bucket->slab_at + block_size > bucket->slab_end) {
+			// Carve the blocks of a class out of big contiguous slabs, so that things
+			// allocated one after the other also end up next to each other in memory.
+			u64 slab_size = max(POOL_SLAB_SIZE / block_size, 1) * block_size;
+			bucket->slab_at  = push_nozero_aligned(pool->arena, slab_size, POOL_MIN_ALIGNMENT);
+			bucket->slab_end = bucket->slab_at + slab_size;
+		}
+		
+		result = bucket->slab_at;
+		bucket->slab_at += block_size;
+	}
+	
+	return result;
+}
+
+static void
+pool_free(Pool *pool, void *ptr, u64 size) {
+	pool_free_chain(pool, ptr, ptr, size);
+}
+
+static void
+pool_free_chain(Pool *pool, void *first, void *last, u64 size) {
+	if (first) {
+		Pool_Size_Class *bucket = &pool->classes[pool_size_class_from_size(size)];
+		
+		Pool_Node *first_node = first;
+		Pool_Node *last_node  = last;
+		last_node->next    = bucket->first_free;
+		bucket->first_free = first_node;
+	}
+}
+
+static bool
+pool_has_free_block(Pool *pool, u64 size) {
+	// True if the next allocation of this size reuses a freed block instead of new memory
+	Pool_Size_Class *bucket = &pool->classes[pool_size_class_from_size(size)];
+	return bucket->first_free != NULL;
+}
+
 ////////////////////////////////
 //~ Strings and slices
 
@@ -324,12 +484,17 @@ push_stringf(Arena *arena, char *fmt, ...) {
 
 static String
 push_stringf_va_list(Arena *arena, char *fmt, va_list args) {
-	i64 len = vsnprintf(0, 0, fmt, args);
+	// The first call uses up 'args', and the second one needs room for the null terminator
+	va_list args_copy;
+	va_copy(args_copy, args);
+	i64 len = vsnprintf(0, 0, fmt, args_copy);
+	va_end(args_copy);
+	
 	String result = {
-		.data = push_nozero(arena, sizeof(u8) * len),
+		.data = push_nozero(arena, sizeof(u8) * (len + 1)),
 		.len  = len,
 	};
-	vsnprintf(cast(char *) result.data, result.len, fmt, args);
+	vsnprintf(cast(char *) result.data, result.len + 1, fmt, args);
 	return result;
 }
 
@@ -373,6 +538,12 @@ string_starts_with(String a, String b) {
 	return result;
 }
 
+static bool
+string_equals(String a, String b) {
+	bool result = (a.len == b.len && memcmp(a.data, b.data, a.len) == 0);
+	return result;
+}
+
 static i64
 string_find_first(String s, u8 c) {
 	i64 result = -1;
@@ -455,6 +626,164 @@ string_from_builder(String_Builder builder) {
 	return string(builder.data, builder.len);
 }
 
+////////////////////////////////
+//~ UTF-8
+
+static bool
+utf8_is_continuation(u8 byte) {
+	return (byte & 0xC0) == 0x80;
+}
+
+static i64
+utf8_sequence_len(u8 first_byte) {
+	// Length of the sequence started by this byte, 0 if it can't start one
+	i64 result = 0;
+	
+	if (first_byte < 0x80) {
+		result = 1;
+	} else if (first_byte >= 0xC2 && first_byte <= 0xDF) {
+		result = 2;
+	} else if (first_byte >= 0xE0 && first_byte <= 0xEF) {
+		result = 3;
+	} else if (first_byte >= 0xF0 && first_byte <= 0xF4) {
+		result = 4;
+	}
+	
+	return result;
+}
+
+static UTF8_Decode
+utf8_decode(u8 *data, i64 len) {
+	UTF8_Decode result = {UTF8_REPLACEMENT_CHARACTER, 1};
+	
+	if (len > 0) {
+		i64 sequence_len = utf8_sequence_len(data[0]);
+		
+		if (sequence_len == 1) {
+			result.codepoint = data[0];
+		} else if (sequence_len > 1 && sequence_len <= len) {
+			static u8 first_byte_masks[5] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+			static u32 min_codepoints[5]  = {0, 0, 0x80, 0x800, 0x10000};
+			
+			u32 codepoint = data[0] & first_byte_masks[sequence_len];
+			bool ok = true;
+			for (i64 i = 1; i < sequence_len && ok; i += 1) {
+				ok = utf8_is_continuation(data[i]);
+				codepoint = (codepoint << 6) | (data[i] & 0x3F);
+			}
+			
+			// No overlong encodings, surrogates or codepoints past the last plane
+			ok = (ok &&
+				  codepoint >= min_codepoints[sequence_len] &&
+				  !(codepoint >= 0xD800 && codepoint <= 0xDFFF) &&
+				  codepoint <= 0x10FFFF);
+			
+			if (ok) {
+				result.codepoint = codepoint;
+				result.len       = sequence_len;
+			}
+		}
+	}
+	
+	return result;
+}
+
+static i64
+utf8_codepoint_width(u32 codepoint) {
+	// Columns a terminal gives the codepoint: a rough wcwidth covering the common
+	// combining marks (0 columns) and the East Asian wide blocks and emoji (2 columns).
+	static u32 zero_width_ranges[][2] = {
+		{0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A},
+		{0x064B, 0x065F}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F},
+		{0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+		{0xFEFF, 0xFEFF}, {0xE0100, 0xE01EF},
+	};
+	static u32 wide_ranges[][2] = {
+		{0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF},
+		{0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF},
+		{0xFE30, 0xFE4F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F},
+		{0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+	};
+	
+	i64 result = 1;
+	
+	if (codepoint >= 0x0300) {
+		for (i64 i = 0; i < array_count(zero_width_ranges) && result == 1; i += 1) {
+			if (codepoint >= zero_width_ranges[i][0] && codepoint <= zero_width_ranges[i][1]) {
+				result = 0;
+			}
+		}
+		for (i64 i = 0; i < array_count(wide_ranges) && result == 1; i += 1) {
+			if (codepoint >= wide_ranges[i][0] && codepoint <= wide_ranges[i][1]) {
+				result = 2;
+			}
+		}
+	}
+	
+	return result;
+}
+
+static i64
+utf8_ascii_prefix_len(u8 *data, i64 len) {
+	// Number of ASCII bytes at the start of the data
+	i64 i = 0;
+	bool found = false;
+	
+#if ARCH_X64
+	// The top bit of every byte, 16 at a time
+	for (; i + 16 <= len; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128(cast(__m128i *) (data + i)));
+		if (mask != 0) {
+			i += count_trailing_zeros_u32(cast(u32) mask);
+			found = true;
+			break;
+		}
+	}
+#endif
+	
+	while (!found && i < len && data[i] < 0x80) {
+		i += 1;
+	}
+	
+	return i;
+}
+
+static bool
+utf8_validate(String s) {
+	bool ok = true;
+	
+	i64 i = 0;
+	while (ok && i < s.len) {
+		i += utf8_ascii_prefix_len(s.data + i, s.len - i);
+		
+		if (i < s.len) {
+			// A valid sequence that isn't ASCII is never a single byte
+			UTF8_Decode decode = utf8_decode(s.data + i, s.len - i);
+			ok = (decode.len > 1);
+			i += decode.len;
+		}
+	}
+	
+	return ok;
+}
+
+static i64
+utf8_complete_prefix_len(u8 *data, i64 len) {
+	// Leaves out a sequence cut short at the end, which may still be completed by what follows
+	i64 result = len;
+	
+	i64 start = len - 1;
+	while (start > 0 && start > len - 4 && utf8_is_continuation(data[start])) {
+		start -= 1;
+	}
+	
+	if (start >= 0 && utf8_sequence_len(data[start]) > len - start) {
+		result = start;
+	}
+	
+	return result;
+}
+
 ////////////////////////////////
 //~ File IO
 
@@ -499,4 +828,353 @@ read_file(Arena *arena, String file_name) {
 	return result;
 }
 
+static Read_File_Result
+read_file_range(Arena *arena, String file_name, i64 offset, i64 len) {
+	// Up to 'len' bytes from 'offset' on, fewer if the file ends before
+	Read_File_Result result = {0};
+	
+	Scratch scratch = scratch_begin(&arena, 1);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	FILE *handle = fopen(file_name_null_terminated, "rb");
+	if (handle) {
+#if COMPILER_MSVC
+		int seek_result = _fseeki64(handle, offset, SEEK_SET);
+#else
+		int seek_result = fseeko(handle, offset, SEEK_SET);
+#endif
+		if (seek_result == 0) {
+			result.contents.data = push_nozero(arena, len * sizeof(u8));
+			result.contents.len  = fread(result.contents.data, sizeof(u8), len, handle);
+			result.ok = !ferror(handle);
+		}
+		fclose(handle);
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+write_file(String file_name, String contents) {
+	// Replaces the file's contents, creating it if needed
+	bool ok = false;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	FILE *handle = fopen(file_name_null_terminated, "wb");
+	if (handle) {
+		size_t written = fwrite(contents.data, sizeof(u8), contents.len, handle);
+		ok = (written == cast(size_t) contents.len);
+		
+		if (fclose(handle) != 0) {
+			ok = false;
+		}
+	}
+	
+	scratch_end(scratch);
+	
+	return ok;
+}
+
+static File_Handle
+open_file_for_writing(String file_name, bool truncate) {
+	// Keeps what the file had, unless 'truncate'
+	File_Handle result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	FILE *handle = NULL;
+	if (!truncate) {
+		handle = fopen(file_name_null_terminated, "r+b");
+	}
+	if (!handle) {
+		handle = fopen(file_name_null_terminated, "w+b");
+	}
+	
+	if (handle) {
+		result.handle = cast(u64) handle;
+		result.ok = true;
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+write_file_range(File_Handle file, i64 offset, String contents) {
+	bool ok = false;
+	FILE *handle = cast(FILE *) file.handle;
+	
+#if COMPILER_MSVC
+	int seek_result = _fseeki64(handle, offset, SEEK_SET);
+#else
+	int seek_result = fseeko(handle, offset, SEEK_SET);
+#endif
+	if (seek_result == 0) {
+		size_t written = fwrite(contents.data, sizeof(u8), contents.len, handle);
+		ok = (written == cast(size_t) contents.len);
+	}
+	
+	return ok;
+}
+
+static bool
+close_file(File_Handle file) {
+	FILE *handle = cast(FILE *) file.handle;
+	bool ok = !ferror(handle);
+	
+	if (fclose(handle) != 0) {
+		ok = false;
+	}
+	
+	return ok;
+}
+
+static bool
+delete_file(String file_name) {
+	Scratch scratch = scratch_begin(0, 0);
+	bool ok = (remove(cstring_from_string(scratch.arena, file_name)) == 0);
+	scratch_end(scratch);
+	
+	return ok;
+}
+
+////////////////////////////////
+//~ Atomics
+
+static bool
+atomic_compare_exchange_ptr(void *volatile *p, void *expected, void *desired) {
+#if COMPILER_MSVC
+	return InterlockedCompareExchangePointer(p, desired, expected) == expected;
+#else
+	return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static bool
+atomic_compare_exchange_u64(volatile u64 *p, u64 expected, u64 desired) {
+#if COMPILER_MSVC
+	return cast(u64) InterlockedCompareExchange64(cast(volatile LONG64 *) p, cast(LONG64) desired, cast(LONG64) expected) == expected;
+#else
+	return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+////////////////////////////////
+//~ Tracing
+
+static Trace_Ring *
+trace_claim_ring(void) {
+	// A ring that a thread gave back and the flusher drained, or a new one made visible to it
+	Trace_Ring *result = NULL;
+	for (Trace_Ring *ring = atomic_load_ptr(&trace_state.first_ring); ring && !result; ring = ring->next) {
+		if (atomic_compare_exchange_u64(&ring->state, Trace_Ring_State_FREE, Trace_Ring_State_OWNED)) {
+			result = ring;
+		}
+	}
+	
+	if (!result) {
+		result = mem_reserve_and_commit(sizeof(Trace_Ring));
+		assert(result);
+		
+		Trace_Ring *first = NULL;
+		do {
+			first = atomic_load_ptr(&trace_state.first_ring);
+			result->next = first;
+		} while (!atomic_compare_exchange_ptr(cast(void *volatile *) &trace_state.first_ring, first, result));
+	}
+	
+	// Written before any event is, so the flusher reads it after them
+	result->thread_id     = atomic_add_u64(&trace_state.next_thread_id, 1) + 1;
+	result->open_count    = 0;
+	result->dropped_depth = 0;
+	
+	return result;
+}
+
+static void
+trace_release_ring(void) {
+	// After the last event of this thread
+	if (trace_ring) {
+		atomic_store_u64(&trace_ring->state, Trace_Ring_State_RELEASED);
+		trace_ring = NULL;
+	}
+}
+
+static void
+trace_record(Trace_Event_Kind kind, char *name, i64 value) {
+	if (!trace_ring) {
+		trace_ring = trace_claim_ring();
+	}
+	
+	// When the flusher is behind, better to lose events than to stall the editor
+	u64 write_pos = trace_ring->write_pos;
+	u64 room = TRACE_RING_EVENT_COUNT - (write_pos - atomic_load_u64(&trace_ring->read_pos));
+	bool in_dropped_scope = (trace_ring->dropped_depth > 0);
+	
+	bool keep = false;
+	if (kind == Trace_Event_Kind_BEGIN) {
+		keep = (!in_dropped_scope && room >= trace_ring->open_count + 2);
+		if (keep) {
+			trace_ring->open_count += 1;
+		} else {
+			trace_ring->dropped_depth += 1;
+		}
+	} else if (kind == Trace_Event_Kind_END) {
+		// Always has room if its begin event was written
+		keep = (!in_dropped_scope && room > 0);
+		if (in_dropped_scope) {
+			trace_ring->dropped_depth -= 1;
+		} else if (keep && trace_ring->open_count > 0) {
+			trace_ring->open_count -= 1;
+		}
+	} else {
+		keep = (!in_dropped_scope && room >= trace_ring->open_count + 1);
+	}
+	
+	if (keep) {
+		Trace_Event *event = &trace_ring->events[write_pos & (TRACE_RING_EVENT_COUNT - 1)];
+		event->time_ns = get_time_ns();
+		event->name    = name;
+		event->value   = value;
+		event->kind    = kind;
+		
+		atomic_store_u64(&trace_ring->write_pos, write_pos + 1);
+	} else {
+		atomic_add_u64(&trace_ring->dropped_count, 1);
+	}
+}
+
+static void
+trace_begin(char *name) {
+	if (atomic_load_u64(&trace_state.is_enabled)) {
+		trace_record(Trace_Event_Kind_BEGIN, name, 0);
+	}
+}
+
+static void
+trace_end(char *name) {
+	if (atomic_load_u64(&trace_state.is_enabled)) {
+		trace_record(Trace_Event_Kind_END, name, 0);
+	}
+}
+
+static void
+trace_counter(char *name, i64 value) {
+	if (atomic_load_u64(&trace_state.is_enabled)) {
+		trace_record(Trace_Event_Kind_COUNTER, name, value);
+	}
+}
+
+static void
+trace_flush(void) {
+	// Only called from one thread at a time: the flusher, or whoever ends the session
+	// after joining it.
+	Trace_Ring *ring = atomic_load_ptr(&trace_state.first_ring);
+	for (; ring; ring = ring->next) {
+		// Once released, the last events of its thread are in before 'write_pos' is read
+		u64 state     = atomic_load_u64(&ring->state);
+		u64 read_pos  = ring->read_pos;
+		u64 write_pos = atomic_load_u64(&ring->write_pos);
+		
+		for (; read_pos < write_pos; read_pos += 1) {
+			Trace_Event *event = &ring->events[read_pos & (TRACE_RING_EVENT_COUNT - 1)];
+			
+			char phase = 'C';
+			if (event->kind == Trace_Event_Kind_BEGIN) {
+				phase = 'B';
+			} else if (event->kind == Trace_Event_Kind_END) {
+				phase = 'E';
+			}
+			
+			fprintf(trace_state.file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu",
+					trace_state.has_written_event ? ",\n" : "",
+					event->name, phase,
+					cast(double) (event->time_ns - trace_state.start_ns) / 1000.0,
+					cast(unsigned long long) ring->thread_id);
+			if (event->kind == Trace_Event_Kind_COUNTER) {
+				fprintf(trace_state.file, ",\"args\":{\"value\":%lld}", cast(long long) event->value);
+			}
+			fputs("}", trace_state.file);
+			
+			trace_state.has_written_event = true;
+		}
+		
+		u64 dropped_count = atomic_load_u64(&ring->dropped_count);
+		if (dropped_count != ring->reported_dropped_count) {
+			fprintf(trace_state.file, "%s{\"name\":\"dropped events\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu,\"args\":{\"value\":%llu}}",
+					trace_state.has_written_event ? ",\n" : "",
+					cast(double) (get_time_ns() - trace_state.start_ns) / 1000.0,
+					cast(unsigned long long) ring->thread_id,
+					cast(unsigned long long) dropped_count);
+			ring->reported_dropped_count = dropped_count;
+			trace_state.has_written_event = true;
+		}
+		
+		atomic_store_u64(&ring->read_pos, write_pos);
+		if (state == Trace_Ring_State_RELEASED) {
+			atomic_store_u64(&ring->state, Trace_Ring_State_FREE);
+		}
+	}
+	
+	fflush(trace_state.file);
+}
+
+static void
+trace_flusher_proc(void *data) {
+	(void)data;
+	
+	while (!atomic_load_u64(&trace_state.should_stop)) {
+		sleep_ms(TRACE_FLUSH_INTERVAL_MS);
+		trace_flush();
+	}
+}
+
+static bool
+trace_begin_session(String file_name) {
+	bool ok = false;
+	
+	assert(!trace_state.file); // One session at a time
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	trace_state.file = fopen(cstring_from_string(scratch.arena, file_name), "wb");
+	if (trace_state.file) {
+		// The array form of the format, which viewers accept even without the closing
+		// bracket, so a trace cut short by a crash can still be opened.
+		fputs("[\n", trace_state.file);
+		
+		trace_state.start_ns          = get_time_ns();
+		trace_state.has_written_event = false;
+		atomic_store_u64(&trace_state.should_stop, 0);
+		atomic_store_u64(&trace_state.is_enabled, 1);
+		
+		trace_state.flusher = thread_start(trace_flusher_proc, NULL);
+		ok = true;
+	}
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+static void
+trace_end_session(void) {
+	if (trace_state.file) {
+		atomic_store_u64(&trace_state.is_enabled, 0);
+		atomic_store_u64(&trace_state.should_stop, 1);
+		thread_join(trace_state.flusher);
+		
+		trace_flush();
+		
+		fputs("\n]\n", trace_state.file);
+		fclose(trace_state.file);
+		trace_state.file = NULL;
+	}
+}
+
 #endif
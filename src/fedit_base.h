@@ -13,7 +13,11 @@
 # include <unistd.h>
 # include <sys/ioctl.h>
 # include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <sys/inotify.h>
 # include <sys/utsname.h>
+# include <pthread.h>
 #else
 # error Platform not supported.
 #endif
@@ -32,6 +36,13 @@
 #include <errno.h>
 #include <time.h>
 
+#if ARCH_X64
+# include <emmintrin.h> // SSE2
+#endif
+#if COMPILER_MSVC
+# include <intrin.h> // _BitScanForward
+#endif
+
 #ifdef min
 # undef min
 #endif
@@ -145,6 +156,9 @@ typedef  int16_t i16;
 typedef  int32_t i32;
 typedef  int64_t i64;
 
+typedef    float f32;
+typedef   double f64;
+
 typedef struct Size Size;
 struct Size {
 	i32 width;
@@ -177,11 +191,37 @@ static bool is_power_of_two(u64 i);
 static u64  align_forward(u64 ptr, u64 alignment);
 static u64  round_up_to_multiple_of_u64(u64 n, u64 r);
 static i64  round_up_to_multiple_of_i64(i64 n, i64 r);
+static i64  count_trailing_zeros_u32(u32 i);
 
 ////////////////////////////////
 //~ Memory procedures
 
+//- Memory constants
+
+#if !defined(MEM_LARGE_PAGE_SIZE)
+#define MEM_LARGE_PAGE_SIZE megabytes(2)
+#endif
+
+//- Memory types
+
+// Counts of the calls made to the OS by the memory procedures below.
+typedef struct Mem_Stats Mem_Stats;
+struct Mem_Stats {
+	u64 reserve_count;
+	u64 commit_count;
+	u64 decommit_count;
+	u64 release_count;
+	u64 committed_bytes;
+};
+
+//- Memory variables
+
+static per_thread Mem_Stats mem_stats;
+
+//- Memory procedures
+
 static void *mem_reserve(u64 size);
+static void *mem_reserve_large(u64 size);
 static void *mem_commit(void *ptr, u64 size);
 static void *mem_reserve_and_commit(u64 size);
 static bool  mem_decommit(void *ptr, u64 size);
@@ -200,12 +240,33 @@ static bool  mem_release(void *ptr, u64 size);
 #define ARENA_DECOMMIT_THRESHOLD megabytes(64)
 #endif
 
+#if !defined(ARENA_COMMIT_GROWTH_MAX)
+#define ARENA_COMMIT_GROWTH_MAX megabytes(64)
+#endif
+
 #if !defined(DEFAULT_ARENA_RESERVE_SIZE)
 #define DEFAULT_ARENA_RESERVE_SIZE gigabytes(1)
 #endif
 
+// Plain arenas commit ARENA_COMMIT_GRANULARITY bytes at a time. The few that grow big opt in
+// to the policies below with arena_init_flags.
+#if !defined(DEFAULT_ARENA_FLAGS)
+#define DEFAULT_ARENA_FLAGS 0
+#endif
+
 //- Arena Types
 
+enum Arena_Flags {
+	// Every commit is twice as big as the previous one (up to ARENA_COMMIT_GROWTH_MAX),
+	// so that filling a big arena doesn't cost one syscall every ARENA_COMMIT_GRANULARITY bytes.
+	Arena_Flags_COMMIT_GROWTH = (1<<0),
+	
+	// The reserved range is aligned to MEM_LARGE_PAGE_SIZE and committed in chunks of that size,
+	// and the OS is asked to back it with large pages if it can.
+	Arena_Flags_LARGE_PAGES   = (1<<1),
+};
+typedef enum Arena_Flags Arena_Flags;
+
 typedef struct Arena Arena;
 struct Arena {
 	u8  *ptr;
@@ -213,6 +274,8 @@ struct Arena {
 	u64  cap;
 	u64  peak;
 	u64  commit_pos;
+	u64  commit_step;
+	Arena_Flags flags;
 };
 
 typedef struct Arena_Restore_Point Arena_Restore_Point;
@@ -225,9 +288,12 @@ struct Arena_Restore_Point {
 
 static void arena_init(Arena *arena);
 static void arena_init_size(Arena *arena, u64 reserve_size);
+static void arena_init_flags(Arena *arena, u64 reserve_size, Arena_Flags flags);
 static bool arena_fini(Arena *arena);
 static void arena_reset(Arena *arena);
 
+static u64 arena_commit_granularity(Arena *arena);
+
 static void *push_nozero(Arena *arena, u64 size, u64 alignment);
 static void *push_zero(Arena *arena, u64 size, u64 alignment);
 
@@ -257,13 +323,63 @@ typedef Arena_Restore_Point Scratch;
 //- Scratch Memory Variables
 
 #if SCRATCH_ARENA_COUNT > 0
-per_thread Arena scratch_arenas[SCRATCH_ARENA_COUNT];
+static per_thread Arena scratch_arenas[SCRATCH_ARENA_COUNT];
 #endif
 
 //- Scratch Memory Functions
 
 static Scratch scratch_begin(Arena **conflicts, i64 conflict_count);
 static void    scratch_end(Scratch scratch);
+static void    scratch_release(void);
+
+////////////////////////////////
+//~ Pool
+
+//- Pool Constants
+
+// Size classes go in steps of 16 bytes up to 256, then in quarter steps of each power of two.
+#define POOL_SIZE_CLASS_COUNT     64
+#define POOL_SMALL_CLASS_COUNT    16
+#define POOL_SMALL_CLASS_STEP     16
+#define POOL_MIN_ALIGNMENT        16
+
+#if !defined(POOL_SLAB_SIZE)
+#define POOL_SLAB_SIZE kilobytes(64)
+#endif
+
+//- Pool Types
+
+// Free blocks are linked through their first pointer-sized field, so any chain of
+// structs that have their 'next' pointer first can be given back in one go.
+typedef struct Pool_Node Pool_Node;
+struct Pool_Node {
+	Pool_Node *next;
+};
+
+typedef struct Pool_Size_Class Pool_Size_Class;
+struct Pool_Size_Class {
+	Pool_Node *first_free;
+	u8 *slab_at;
+	u8 *slab_end;
+};
+
+typedef struct Pool Pool;
+struct Pool {
+	Arena *arena;
+	Pool_Size_Class classes[POOL_SIZE_CLASS_COUNT];
+};
+
+//- Pool procedures
+
+static void pool_init(Pool *pool, Arena *arena);
+
+static i64 pool_size_class_from_size(u64 size);
+static u64 pool_size_from_size_class(i64 size_class);
+
+static void *pool_alloc(Pool *pool, u64 size);
+static void  pool_free(Pool *pool, void *ptr, u64 size);
+static void  pool_free_chain(Pool *pool, void *first, void *last, u64 size);
+static bool  pool_has_free_block(Pool *pool, u64 size);
 
 ////////////////////////////////
 //~ Strings and slices
@@ -296,6 +412,7 @@ static SliceU8 sliceu8_clone(Arena *arena, SliceU8 s);
 
 #define string_from_lit(s)     string(cast(u8 *)s, sizeof(s)-1)
 #define string_from_cstring(s) string(cast(u8 *)s, strlen(s))
+#define string_lit_init(s)     {sizeof(s)-1, cast(u8 *)s} // For initializers of static data
 
 static String string(u8 *data, i64 len);
 static String push_string(Arena *arena, i64 len);
@@ -306,6 +423,7 @@ static String string_clone(Arena *arena, String s);
 static String string_clone_buffer(u8 *buffer, i64 buffer_len, String s);
 static char *cstring_from_string(Arena *arena, String s);
 static bool string_starts_with(String a, String b);
+static bool string_equals(String a, String b);
 static i64 string_find_first(String s, u8 c);
 static i64 string_count_occurrences(String s, u8 c);
 static String string_skip(String s, i64 amount);
@@ -331,6 +449,31 @@ static i64  string_builder_append(String_Builder *builder, String s);
 
 static String string_from_builder(String_Builder builder);
 
+////////////////////////////////
+//~ UTF-8
+
+//- UTF-8 constants
+
+#define UTF8_REPLACEMENT_CHARACTER 0xFFFD
+
+//- UTF-8 types
+
+typedef struct UTF8_Decode UTF8_Decode;
+struct UTF8_Decode {
+	u32 codepoint; // UTF8_REPLACEMENT_CHARACTER for an invalid byte
+	i64 len;       // Bytes taken, at least 1. Invalid sequences take a single byte.
+};
+
+//- UTF-8 functions
+
+static bool        utf8_is_continuation(u8 byte);
+static i64         utf8_sequence_len(u8 first_byte);
+static UTF8_Decode utf8_decode(u8 *data, i64 len);
+static i64         utf8_codepoint_width(u32 codepoint);
+static i64         utf8_ascii_prefix_len(u8 *data, i64 len);
+static bool        utf8_validate(String s);
+static i64         utf8_complete_prefix_len(u8 *data, i64 len);
+
 ////////////////////////////////
 //~ File IO
 
@@ -342,15 +485,232 @@ struct Read_File_Result {
 	bool    ok;
 };
 
+// Tells whether a file may have changed since it was last asked, without waiting
+typedef struct File_Watch File_Watch;
+struct File_Watch {
+	u64  handle;
+	i64  id;
+	bool ok;
+};
+
+// What changes when a file is written to or replaced by another one
+typedef struct File_Info File_Info;
+struct File_Info {
+	i64  size;
+	u64  modified_time; // Only meaningful compared with another one
+	u64  id;            // Stays the same for as long as the file isn't replaced
+	bool ok;
+};
+
+// An open file that is written a piece at a time, anywhere in it
+typedef struct File_Handle File_Handle;
+struct File_Handle {
+	u64  handle;
+	bool ok;
+};
+
+// Input that has no size and can only be read once, like a pipe
+typedef struct Input_Stream Input_Stream;
+struct Input_Stream {
+	u64  handle;
+	bool ok;
+};
+
 //- File IO functions
 
 static Read_File_Result read_file(Arena *arena, String file_name);
+static Read_File_Result read_file_range(Arena *arena, String file_name, i64 offset, i64 len);
+static bool             write_file(String file_name, String contents);
+
+static File_Handle open_file_for_writing(String file_name, bool truncate); // Created if there's no such file
+static bool        write_file_range(File_Handle file, i64 offset, String contents);
+static bool        close_file(File_Handle file); // Also fails if the writes before it did
+static bool        delete_file(String file_name);
+
+//- File IO platform-specific functions
+
+// Maps the whole file read-only. Its pages are read as they are touched, and the OS can
+// drop them again whenever it needs the memory. Empty files map to an empty slice.
+static Read_File_Result map_file(String file_name);
+static void             unmap_file(SliceU8 contents);
+
+static i64 file_size(String file_name); // -1 if there's no such file
+static File_Info file_info(String file_name);
+static bool replace_file(String from_file_name, String to_file_name); // Renames over 'to', in one step
+
+// Polling reports writes, and also the file being replaced (e.g. by log rotation), after
+// which the watch moves on to the new file.
+static File_Watch file_watch_begin(String file_name);
+static bool       file_watch_poll(File_Watch *watch, String file_name);
+static void       file_watch_end(File_Watch *watch);
+
+// Takes the standard input if something is piped into it, and puts the terminal in its place
+// so that keys can still be read from there. Must come before the terminal is set up.
+static Input_Stream input_stream_from_stdin(void);
+static i64          input_stream_read(Input_Stream stream, u8 *data, i64 len); // Blocks, 0 at the end, -1 on errors
+static void         input_stream_close(Input_Stream stream);
+
+////////////////////////////////
+//~ Time
+
+//- Time platform-specific functions
+
+static u64  get_time_ns(void); // Monotonic, only meaningful as a difference
+static void sleep_ms(u64 ms);
 
 ////////////////////////////////
 //~ Console IO
 
+//- Console IO types
+
+// Counts of the writes made to the OS by write_console_unbuffered.
+typedef struct Console_Stats Console_Stats;
+struct Console_Stats {
+	u64 write_count;
+	u64 bytes_written;
+};
+
+//- Console IO variables
+
+static per_thread Console_Stats console_stats;
+
 //- Console platform-specific functions
 
 static void write_console_unbuffered(String s);
 
+////////////////////////////////
+//~ Atomics
+
+// Loads acquire, stores release, read-modify-writes do both.
+#if COMPILER_MSVC
+# define atomic_load_u64(p)     cast(u64) InterlockedOr64(cast(volatile LONG64 *) (p), 0)
+# define atomic_store_u64(p, v) (void)InterlockedExchange64(cast(volatile LONG64 *) (p), cast(LONG64) (v))
+# define atomic_add_u64(p, v)   cast(u64) InterlockedExchangeAdd64(cast(volatile LONG64 *) (p), cast(LONG64) (v)) // Returns the old value
+# define atomic_load_ptr(p)     InterlockedCompareExchangePointer(cast(void *volatile *) (p), NULL, NULL)
+# define atomic_store_ptr(p, v) (void)InterlockedExchangePointer(cast(void *volatile *) (p), (v))
+#else
+# define atomic_load_u64(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define atomic_store_u64(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# define atomic_add_u64(p, v)   __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL) // Returns the old value
+# define atomic_load_ptr(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define atomic_store_ptr(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+static bool atomic_compare_exchange_ptr(void *volatile *p, void *expected, void *desired);
+static bool atomic_compare_exchange_u64(volatile u64 *p, u64 expected, u64 desired);
+
+////////////////////////////////
+//~ Threads
+
+//- Thread types
+
+typedef void Thread_Proc(void *data);
+
+typedef struct Thread Thread;
+struct Thread {
+	u64 handle;
+};
+
+//- Thread platform-specific functions
+
+static Thread thread_start(Thread_Proc *proc, void *data);
+static void   thread_join(Thread thread);
+
+////////////////////////////////
+//~ Tracing
+
+// Begin/end events and counters go into a ring buffer owned by the thread that records
+// them. A background thread drains the rings into a file in the Chrome trace format (open
+// it with chrome://tracing or ui.perfetto.dev). When no session is running, recording an
+// event is a single load and branch. Threads give their ring back when they exit, and once
+// it is drained the next thread that records an event takes it.
+
+//- Tracing constants
+
+#if !defined(TRACE_RING_EVENT_COUNT)
+#define TRACE_RING_EVENT_COUNT 16384 // Per thread, must be a power of two
+#endif
+
+#define TRACE_FLUSH_INTERVAL_MS 50
+
+//- Tracing types
+
+enum Trace_Event_Kind {
+	Trace_Event_Kind_BEGIN,
+	Trace_Event_Kind_END,
+	Trace_Event_Kind_COUNTER,
+};
+typedef enum Trace_Event_Kind Trace_Event_Kind;
+
+typedef struct Trace_Event Trace_Event;
+struct Trace_Event {
+	u64   time_ns;
+	char *name;
+	i64   value;
+	u64   kind;
+};
+
+enum Trace_Ring_State {
+	Trace_Ring_State_OWNED,    // By the thread recording into it
+	Trace_Ring_State_RELEASED, // Its thread exited, the flusher has yet to drain it
+	Trace_Ring_State_FREE,     // For the next thread
+};
+typedef enum Trace_Ring_State Trace_Ring_State;
+
+typedef struct Trace_Ring Trace_Ring;
+struct Trace_Ring {
+	Trace_Ring *next;
+	u64 thread_id;
+	u64 state;
+	
+	u64 write_pos; // Only advanced by the owning thread
+	u64 read_pos;  // Only advanced by the flusher
+	u64 dropped_count;
+	u64 reported_dropped_count; // Only used by the flusher
+	
+	// Only used by the owning thread. There is always room for the end events of the begin
+	// events written ('open_count'), and once a begin event is dropped everything is dropped
+	// until its end ('dropped_depth' counts the scopes entered since), so that every begin
+	// event in the trace has its end event.
+	u64 open_count;
+	u64 dropped_depth;
+	
+	Trace_Event events[TRACE_RING_EVENT_COUNT];
+};
+
+typedef struct Trace_State Trace_State;
+struct Trace_State {
+	u64 is_enabled;
+	u64 should_stop;
+	
+	FILE  *file;
+	Thread flusher;
+	u64    start_ns;
+	bool   has_written_event;
+	
+	Trace_Ring *first_ring;
+	u64 next_thread_id;
+};
+
+//- Tracing variables
+
+static Trace_State trace_state;
+static per_thread Trace_Ring *trace_ring;
+
+//- Tracing functions
+
+static bool trace_begin_session(String file_name);
+static void trace_end_session(void);
+
+// Names are stored as pointers and only read when flushing: use string literals.
+static void trace_begin(char *name);
+static void trace_end(char *name);
+static void trace_counter(char *name, i64 value);
+
+// Called by threads started with thread_start as they exit
+static void trace_release_ring(void);
+
+// Leaving the scope with break, goto or return skips the end event.
+#define trace_scope(name) for (int _trace_scope_once_ = (trace_begin(name), 0); _trace_scope_once_ == 0; _trace_scope_once_ = 1, trace_end(name))
+
 #endif
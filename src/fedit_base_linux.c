@@ -9,6 +9,34 @@ mem_reserve(u64 size) {
 	void *result = mmap(0, size, 0, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
 	assert(result != NULL);
 	
+	mem_stats.reserve_count += 1;
+	
+	return result;
+}
+
+static void *
+mem_reserve_large(u64 size) {
+	assert(size % MEM_LARGE_PAGE_SIZE == 0);
+	
+	// mmap only guarantees 4K alignment, so reserve one extra large page and
+	// give back the parts before and after the aligned range.
+	u64 padded_size = size + MEM_LARGE_PAGE_SIZE;
+	u8 *base = mmap(0, padded_size, 0, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	assert(base != MAP_FAILED);
+	
+	u8 *result = cast(u8 *) align_forward(cast(u64) base, MEM_LARGE_PAGE_SIZE);
+	u64 head = cast(u64) (result - base);
+	u64 tail = padded_size - head - size;
+	if (head > 0) munmap(base, head);
+	if (tail > 0) munmap(result + size, tail);
+	
+#if defined(MADV_HUGEPAGE)
+	// Only a hint: if transparent huge pages are disabled this fails and we get normal pages.
+	(void)madvise(result, size, MADV_HUGEPAGE);
+#endif
+	
+	mem_stats.reserve_count += 1;
+	
 	return result;
 }
 
@@ -17,6 +45,9 @@ mem_commit(void *ptr, u64 size) {
 	int r = mprotect(ptr, size, PROT_READ|PROT_WRITE);
 	assert(r != -1);
 	
+	mem_stats.commit_count += 1;
+	mem_stats.committed_bytes += size;
+	
 	return ptr;
 }
 
@@ -27,15 +58,296 @@ mem_reserve_and_commit(u64 size) {
 
 static bool
 mem_decommit(void *ptr, u64 size) {
+	mem_stats.decommit_count += 1;
+	mem_stats.committed_bytes -= min(size, mem_stats.committed_bytes);
+	
 	return (mprotect(ptr, size, 0) != -1 &&
 			madvise(ptr, size, MADV_FREE) != -1);
 }
 
 static bool
 mem_release(void *ptr, u64 size) {
+	mem_stats.release_count += 1;
+	
 	return munmap(ptr, size) != -1;
 }
 
+////////////////////////////////
+//~ File IO
+
+static Read_File_Result
+map_file(String file_name) {
+	Read_File_Result result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	int fd = open(file_name_null_terminated, O_RDONLY);
+	if (fd != -1) {
+		struct stat file_stat = {0};
+		if (fstat(fd, &file_stat) == 0) {
+			if (file_stat.st_size == 0) {
+				result.ok = true;
+			} else {
+				void *data = mmap(0, cast(size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED) {
+					result.contents.data = data;
+					result.contents.len  = file_stat.st_size;
+					result.ok = true;
+				}
+			}
+		}
+		close(fd); // The mapping keeps the file open
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static void
+unmap_file(SliceU8 contents) {
+	if (contents.data) {
+		munmap(contents.data, cast(size_t) contents.len);
+	}
+}
+
+static i64
+file_size(String file_name) {
+	i64 result = -1;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	struct stat file_stat = {0};
+	if (stat(file_name_null_terminated, &file_stat) == 0) {
+		result = file_stat.st_size;
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static File_Info
+file_info(String file_name) {
+	File_Info result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	struct stat file_stat = {0};
+	if (stat(file_name_null_terminated, &file_stat) == 0) {
+		result.size = file_stat.st_size;
+		result.modified_time = cast(u64) file_stat.st_mtim.tv_sec * 1000000000ULL + cast(u64) file_stat.st_mtim.tv_nsec;
+		result.id = (cast(u64) file_stat.st_dev << 48) ^ cast(u64) file_stat.st_ino;
+		result.ok = true;
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+replace_file(String from_file_name, String to_file_name) {
+	Scratch scratch = scratch_begin(0, 0);
+	char *from_null_terminated = cstring_from_string(scratch.arena, from_file_name);
+	char *to_null_terminated   = cstring_from_string(scratch.arena, to_file_name);
+	
+	bool ok = (rename(from_null_terminated, to_null_terminated) == 0);
+	
+	scratch_end(scratch);
+	
+	return ok;
+}
+
+#define LINUX_FILE_WATCH_MASK (IN_MODIFY|IN_ATTRIB|IN_MOVE_SELF|IN_DELETE_SELF)
+
+static File_Watch
+file_watch_begin(String file_name) {
+	File_Watch result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	int fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+	if (fd != -1) {
+		int wd = inotify_add_watch(fd, file_name_null_terminated, LINUX_FILE_WATCH_MASK);
+		if (wd != -1) {
+			result.handle = fd;
+			result.id     = wd;
+			result.ok     = true;
+		} else {
+			close(fd);
+		}
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+file_watch_poll(File_Watch *watch, String file_name) {
+	bool result = false;
+	
+	if (watch->ok) {
+		Scratch scratch = scratch_begin(0, 0);
+		char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+		
+		if (watch->id == -1) {
+			// The file was gone at the last poll, see if it is back
+			watch->id = inotify_add_watch(cast(int) watch->handle, file_name_null_terminated, LINUX_FILE_WATCH_MASK);
+			result = (watch->id != -1);
+		}
+		
+		// Drain every pending event, only whether there were any matters
+		bool replaced = false;
+		_Alignas(struct inotify_event) u8 events[4096];
+		
+		i64 read_len = read(cast(int) watch->handle, events, sizeof(events));
+		while (read_len > 0) {
+			i64 at = 0;
+			while (at < read_len) {
+				struct inotify_event *event = cast(struct inotify_event *) (events + at);
+				if (event->wd == watch->id && (event->mask & (IN_MOVE_SELF|IN_DELETE_SELF|IN_IGNORED))) {
+					replaced = true;
+				}
+				at += sizeof(struct inotify_event) + event->len;
+			}
+			
+			result = true;
+			read_len = read(cast(int) watch->handle, events, sizeof(events));
+		}
+		
+		if (replaced) {
+			// Watch whatever has the name now, if anything
+			inotify_rm_watch(cast(int) watch->handle, cast(int) watch->id);
+			watch->id = inotify_add_watch(cast(int) watch->handle, file_name_null_terminated, LINUX_FILE_WATCH_MASK);
+		}
+		
+		scratch_end(scratch);
+	}
+	
+	return result;
+}
+
+static void
+file_watch_end(File_Watch *watch) {
+	if (watch->ok) {
+		close(cast(int) watch->handle);
+	}
+	
+	*watch = (File_Watch){0};
+}
+
+static Input_Stream
+input_stream_from_stdin(void) {
+	Input_Stream result = {0};
+	
+	if (!isatty(STDIN_FILENO)) {
+		int fd  = dup(STDIN_FILENO);
+		int tty = open("/dev/tty", O_RDWR|O_CLOEXEC);
+		if (fd != -1 && tty != -1 && dup2(tty, STDIN_FILENO) != -1) {
+			result.handle = fd;
+			result.ok     = true;
+		} else if (fd != -1) {
+			close(fd);
+		}
+		
+		if (tty != -1) {
+			close(tty);
+		}
+	}
+	
+	return result;
+}
+
+static i64
+input_stream_read(Input_Stream stream, u8 *data, i64 len) {
+	i64 result = -1;
+	
+	if (stream.ok) {
+		do {
+			result = read(cast(int) stream.handle, data, cast(size_t) len);
+		} while (result == -1 && errno == EINTR);
+	}
+	
+	return result;
+}
+
+static void
+input_stream_close(Input_Stream stream) {
+	if (stream.ok) {
+		close(cast(int) stream.handle);
+	}
+}
+
+////////////////////////////////
+//~ Time
+
+static u64
+get_time_ns(void) {
+	struct timespec ts = {0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return cast(u64) ts.tv_sec * 1000000000ULL + cast(u64) ts.tv_nsec;
+}
+
+static void
+sleep_ms(u64 ms) {
+	struct timespec ts = {0};
+	ts.tv_sec  = cast(time_t) (ms / 1000);
+	ts.tv_nsec = cast(long) (ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+		// Interrupted (e.g. by a resize signal), sleep for what is left
+	}
+}
+
+////////////////////////////////
+//~ Threads
+
+typedef struct Linux_Thread_Start Linux_Thread_Start;
+struct Linux_Thread_Start {
+	Thread_Proc *proc;
+	void *data;
+};
+
+static void *
+linux_thread_entry(void *start_ptr) {
+	Linux_Thread_Start start = *cast(Linux_Thread_Start *) start_ptr;
+	free(start_ptr);
+	
+	start.proc(start.data);
+	trace_release_ring();
+	scratch_release();
+	return NULL;
+}
+
+static Thread
+thread_start(Thread_Proc *proc, void *data) {
+	Thread result = {0};
+	
+	Linux_Thread_Start *start = malloc(sizeof(Linux_Thread_Start));
+	assert(start);
+	start->proc = proc;
+	start->data = data;
+	
+	pthread_t handle;
+	int error = pthread_create(&handle, NULL, linux_thread_entry, start);
+	if (error != 0) {
+		panic(error);
+	}
+	
+	result.handle = cast(u64) handle;
+	return result;
+}
+
+static void
+thread_join(Thread thread) {
+	pthread_join(cast(pthread_t) thread.handle, NULL);
+}
+
 ////////////////////////////////
 //~ Console IO
 
@@ -43,12 +355,16 @@ static void
 write_console_unbuffered(String s) {
 	if (s.len > 0) {
 		int nwrite = write(STDOUT_FILENO, s.data, s.len);
+		console_stats.write_count += 1;
 		if (nwrite != -1) {
+			console_stats.bytes_written += nwrite;
 			if (nwrite < s.len) {
 				nwrite = write(STDOUT_FILENO, s.data + nwrite, s.len - nwrite);
+				console_stats.write_count += 1;
 				if (nwrite == -1) {
 					panic(errno);
 				}
+				console_stats.bytes_written += nwrite;
 			}
 		} else {
 			panic(errno);
@@ -10,15 +10,28 @@ mem_reserve(u64 size) {
 	void *result = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
 	assert(result != NULL);
 	
+	mem_stats.reserve_count += 1;
+	
 	return result;
 }
 
+static void *
+mem_reserve_large(u64 size) {
+	// MEM_LARGE_PAGES needs the SeLockMemoryPrivilege and must be committed all at once,
+	// which defeats the point of an arena. Reservations are already 64K-aligned, so
+	// just reserve normally and let the arena commit in MEM_LARGE_PAGE_SIZE chunks.
+	return mem_reserve(size);
+}
+
 static void *
 mem_commit(void *ptr, u64 size) {
 	// No need to align the size to a page boundary, Windows will do it for us.
 	void *result = VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
 	assert(result != NULL);
 	
+	mem_stats.commit_count += 1;
+	mem_stats.committed_bytes += size;
+	
 	return result;
 }
 
@@ -28,11 +41,18 @@ mem_reserve_and_commit(u64 size) {
 	void *result = VirtualAlloc(NULL, size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
 	assert(result != NULL);
 	
+	mem_stats.reserve_count += 1;
+	mem_stats.commit_count  += 1;
+	mem_stats.committed_bytes += size;
+	
 	return result;
 }
 
 static bool
 mem_decommit(void *ptr, u64 size) {
+	mem_stats.decommit_count += 1;
+	mem_stats.committed_bytes -= min(size, mem_stats.committed_bytes);
+	
 	return VirtualFree(ptr, size, MEM_DECOMMIT);
 }
 
@@ -40,9 +60,280 @@ static bool
 mem_release(void *ptr, u64 size) {
 	(void)size; // Not needed on Windows
 	
+	mem_stats.release_count += 1;
+	
 	return VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
+////////////////////////////////
+//~ File IO
+
+static Read_File_Result
+map_file(String file_name) {
+	Read_File_Result result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	HANDLE file = CreateFileA(file_name_null_terminated, GENERIC_READ, FILE_SHARE_READ, NULL,
+							  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size = {0};
+		if (GetFileSizeEx(file, &size)) {
+			if (size.QuadPart == 0) {
+				result.ok = true;
+			} else {
+				HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mapping) {
+					void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+					if (data) {
+						result.contents.data = data;
+						result.contents.len  = size.QuadPart;
+						result.ok = true;
+					}
+					CloseHandle(mapping); // The view keeps the mapping alive
+				}
+			}
+		}
+		CloseHandle(file);
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static void
+unmap_file(SliceU8 contents) {
+	if (contents.data) {
+		UnmapViewOfFile(contents.data);
+	}
+}
+
+static i64
+file_size(String file_name) {
+	i64 result = -1;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	WIN32_FILE_ATTRIBUTE_DATA attributes = {0};
+	if (GetFileAttributesExA(file_name_null_terminated, GetFileExInfoStandard, &attributes)) {
+		result = (cast(i64) attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static File_Info
+file_info(String file_name) {
+	File_Info result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	char *file_name_null_terminated = cstring_from_string(scratch.arena, file_name);
+	
+	HANDLE handle = CreateFileA(file_name_null_terminated, 0, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE,
+								NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle != INVALID_HANDLE_VALUE) {
+		BY_HANDLE_FILE_INFORMATION information = {0};
+		if (GetFileInformationByHandle(handle, &information)) {
+			result.size = (cast(i64) information.nFileSizeHigh << 32) | information.nFileSizeLow;
+			result.modified_time = ((cast(u64) information.ftLastWriteTime.dwHighDateTime << 32) |
+									information.ftLastWriteTime.dwLowDateTime) * 100;
+			result.id = ((cast(u64) information.nFileIndexHigh << 32) | information.nFileIndexLow) ^
+				(cast(u64) information.dwVolumeSerialNumber << 48);
+			result.ok = true;
+		}
+		CloseHandle(handle);
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+replace_file(String from_file_name, String to_file_name) {
+	Scratch scratch = scratch_begin(0, 0);
+	char *from_null_terminated = cstring_from_string(scratch.arena, from_file_name);
+	char *to_null_terminated   = cstring_from_string(scratch.arena, to_file_name);
+	
+	// Unlike rename, replaces a file that is already there
+	bool ok = MoveFileExA(from_null_terminated, to_null_terminated, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH);
+	
+	scratch_end(scratch);
+	
+	return ok;
+}
+
+static File_Watch
+file_watch_begin(String file_name) {
+	// Windows only watches directories: this reports changes to the file's neighbours too,
+	// which is harmless for a poll
+	File_Watch result = {0};
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	i64 slash = file_name.len - 1;
+	while (slash >= 0 && file_name.data[slash] != '/' && file_name.data[slash] != '\\') {
+		slash -= 1;
+	}
+	
+	String directory = string_from_lit(".");
+	if (slash >= 0) {
+		directory = string_stop(file_name, max(slash, 1)); // Keep the root's slash
+	}
+	char *directory_null_terminated = cstring_from_string(scratch.arena, directory);
+	
+	HANDLE handle = FindFirstChangeNotificationA(directory_null_terminated, FALSE,
+												 FILE_NOTIFY_CHANGE_SIZE|FILE_NOTIFY_CHANGE_LAST_WRITE|FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (handle != INVALID_HANDLE_VALUE) {
+		result.handle = cast(u64) handle;
+		result.ok     = true;
+	}
+	
+	scratch_end(scratch);
+	
+	return result;
+}
+
+static bool
+file_watch_poll(File_Watch *watch, String file_name) {
+	(void)file_name; // The directory watch already follows the name
+	bool result = false;
+	
+	if (watch->ok) {
+		HANDLE handle = cast(HANDLE) watch->handle;
+		if (WaitForSingleObject(handle, 0) == WAIT_OBJECT_0) {
+			FindNextChangeNotification(handle);
+			result = true;
+		}
+	}
+	
+	return result;
+}
+
+static void
+file_watch_end(File_Watch *watch) {
+	if (watch->ok) {
+		FindCloseChangeNotification(cast(HANDLE) watch->handle);
+	}
+	
+	*watch = (File_Watch){0};
+}
+
+static Input_Stream
+input_stream_from_stdin(void) {
+	Input_Stream result = {0};
+	
+	HANDLE handle = GetStdHandle(STD_INPUT_HANDLE);
+	if (handle && handle != INVALID_HANDLE_VALUE && GetFileType(handle) != FILE_TYPE_CHAR) {
+		HANDLE console = CreateFileA("CONIN$", GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE,
+									 NULL, OPEN_EXISTING, 0, NULL);
+		if (console != INVALID_HANDLE_VALUE && SetStdHandle(STD_INPUT_HANDLE, console)) {
+			result.handle = cast(u64) handle;
+			result.ok     = true;
+		}
+	}
+	
+	return result;
+}
+
+static i64
+input_stream_read(Input_Stream stream, u8 *data, i64 len) {
+	i64 result = -1;
+	
+	if (stream.ok) {
+		DWORD read_len = 0;
+		DWORD to_read  = cast(DWORD) min(len, 1 << 30);
+		if (ReadFile(cast(HANDLE) stream.handle, data, to_read, &read_len, NULL)) {
+			result = read_len;
+		} else if (GetLastError() == ERROR_BROKEN_PIPE) {
+			result = 0; // The writer closed its end
+		}
+	}
+	
+	return result;
+}
+
+static void
+input_stream_close(Input_Stream stream) {
+	if (stream.ok) {
+		CloseHandle(cast(HANDLE) stream.handle);
+	}
+}
+
+////////////////////////////////
+//~ Time
+
+static u64
+get_time_ns(void) {
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	
+	// Split the multiplication to avoid overflowing after a few hours of uptime
+	u64 seconds   = cast(u64) (counter.QuadPart / frequency.QuadPart);
+	u64 remainder = cast(u64) (counter.QuadPart % frequency.QuadPart);
+	return seconds * 1000000000ULL + remainder * 1000000000ULL / cast(u64) frequency.QuadPart;
+}
+
+static void
+sleep_ms(u64 ms) {
+	Sleep(cast(DWORD) ms);
+}
+
+////////////////////////////////
+//~ Threads
+
+typedef struct Windows_Thread_Start Windows_Thread_Start;
+struct Windows_Thread_Start {
+	Thread_Proc *proc;
+	void *data;
+};
+
+static DWORD WINAPI
+windows_thread_entry(LPVOID start_ptr) {
+	Windows_Thread_Start start = *cast(Windows_Thread_Start *) start_ptr;
+	free(start_ptr);
+	
+	start.proc(start.data);
+	trace_release_ring();
+	scratch_release();
+	return 0;
+}
+
+static Thread
+thread_start(Thread_Proc *proc, void *data) {
+	Thread result = {0};
+	
+	Windows_Thread_Start *start = malloc(sizeof(Windows_Thread_Start));
+	assert(start);
+	start->proc = proc;
+	start->data = data;
+	
+	HANDLE handle = CreateThread(NULL, 0, windows_thread_entry, start, 0, NULL);
+	if (!handle) {
+		panic();
+	}
+	
+	result.handle = cast(u64) handle;
+	return result;
+}
+
+static void
+thread_join(Thread thread) {
+	HANDLE handle = cast(HANDLE) thread.handle;
+	WaitForSingleObject(handle, INFINITE);
+	CloseHandle(handle);
+}
+
 ////////////////////////////////
 //~ Console IO
 
@@ -61,6 +352,8 @@ write_console_unbuffered(String s) {
 			
 			panic();
 		}
+		console_stats.write_count += 1;
+		console_stats.bytes_written += actual_nwrite;
 		
 		written += cast(i64) actual_nwrite;
 	}
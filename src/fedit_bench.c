@@ -0,0 +1,1244 @@
+// Benchmarks for the buffer engine, built without the terminal front end. Built by the
+// same build scripts as the editor, run as:
+//   fedit_bench load <file>
+//   fedit_bench edit [file]
+//   fedit_bench geometry [file]   (see bench_geometry.sh to sweep ED_SPAN_SIZE and ED_PAGE_SIZE)
+//   fedit_bench paste [file]
+//   fedit_bench delete [file]
+//   fedit_bench snapshot [file]
+//   fedit_bench autosave <file>   (writes <file>.swp and a copy next to it, and deletes them)
+//   fedit_bench reload <file>     (writes copies of it next to it, and deletes them)
+//   fedit_bench highlight <file>
+
+#include "fedit_engine.c"
+
+////////////////////////////////
+//~ Benchmark helpers
+
+static void
+bench_print_header(char *name) {
+	printf("\n== %s ==\n", name);
+}
+
+static double
+bench_ms_from_ns(u64 ns) {
+	return cast(double) ns / 1000000.0;
+}
+
+// xorshift64, so that runs are reproducible across platforms
+static u64 bench_random_state = 0x9E3779B97F4A7C15ULL;
+
+static u64
+bench_random(void) {
+	u64 x = bench_random_state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	bench_random_state = x;
+	return x;
+}
+
+static i64
+bench_random_range(i64 min_value, i64 max_value) {
+	// Inclusive on both ends
+	return min_value + cast(i64) (bench_random() % cast(u64) (max_value - min_value + 1));
+}
+
+static SliceU8
+bench_synthetic_text(Arena *arena, i64 line_count, i64 max_line_len) {
+	i64 cap = line_count * (max_line_len + 1);
+	SliceU8 result = push_sliceu8(arena, cap);
+	
+	i64 at = 0;
+	for (i64 line_index = 0; line_index < line_count; line_index += 1) {
+		i64 line_len = bench_random_range(0, max_line_len);
+		for (i64 i = 0; i < line_len; i += 1) {
+			result.data[at + i] = cast(u8) bench_random_range('a', 'z');
+		}
+		at += line_len;
+		
+		if (line_index + 1 < line_count) {
+			result.data[at] = '\n';
+			at += 1;
+		}
+	}
+	
+	result.len = at;
+	return result;
+}
+
+static bool
+bench_load_buffer(ED_Buffer *buffer, Arena *arena, String file_name) {
+	// Loads the file, or some generated text if the file name is empty
+	bool ok = true;
+	
+	SliceU8 contents = {0};
+	if (file_name.len > 0) {
+		Read_File_Result read_file_result = read_file(arena, file_name);
+		contents = read_file_result.contents;
+		ok = read_file_result.ok;
+	} else {
+		contents = bench_synthetic_text(arena, 10000, 120);
+	}
+	
+	if (ok) {
+		arena_init_flags(&buffer->arena, max(DEFAULT_ARENA_RESERVE_SIZE, cast(u64) contents.len * 4), ED_BUFFER_ARENA_FLAGS);
+		ed_init_buffer_contents(buffer, contents);
+	} else {
+		printf("Failed to read '%.*s'\n", string_expand(file_name));
+	}
+	
+	return ok;
+}
+
+////////////////////////////////
+//~ Load benchmark
+
+typedef struct Bench_Arena_Policy Bench_Arena_Policy;
+struct Bench_Arena_Policy {
+	char *name;
+	Arena_Flags flags;
+};
+
+static void
+bench_load(String file_name) {
+	bench_print_header("load");
+	
+	Bench_Arena_Policy policies[] = {
+		{ "fixed commit",         0 },
+		{ "commit growth",        Arena_Flags_COMMIT_GROWTH },
+		{ "commit growth + THP",  Arena_Flags_COMMIT_GROWTH|Arena_Flags_LARGE_PAGES },
+	};
+	
+	printf("%-22s %10s %10s %10s %12s %12s\n", "policy", "read ms", "init ms", "commits", "committed MB", "peak MB");
+	
+	for (i64 policy_index = 0; policy_index < array_count(policies); policy_index += 1) {
+		Bench_Arena_Policy policy = policies[policy_index];
+		
+		memset(&mem_stats, 0, sizeof(mem_stats));
+		
+		Arena file_arena = {0};
+		arena_init_flags(&file_arena, SCRATCH_ARENA_RESERVE_SIZE, policy.flags);
+		
+		u64 read_start = get_time_ns();
+		Read_File_Result read_file_result = read_file(&file_arena, file_name);
+		u64 read_end = get_time_ns();
+		
+		if (!read_file_result.ok) {
+			printf("Failed to read '%.*s'\n", string_expand(file_name));
+			arena_fini(&file_arena);
+			break;
+		}
+		
+		// Spans cost about 1.5x the text, and a page list built from short lines even more
+		ED_Buffer buffer = {0};
+		arena_init_flags(&buffer.arena, max(DEFAULT_ARENA_RESERVE_SIZE, cast(u64) read_file_result.contents.len * 4), policy.flags);
+		
+		u64 init_start = get_time_ns();
+		ed_init_buffer_contents(&buffer, read_file_result.contents);
+		u64 init_end = get_time_ns();
+		
+		printf("%-22s %10.2f %10.2f %10llu %12.1f %12.1f\n", policy.name,
+			   bench_ms_from_ns(read_end - read_start),
+			   bench_ms_from_ns(init_end - init_start),
+			   cast(unsigned long long) mem_stats.commit_count,
+			   cast(double) mem_stats.committed_bytes / megabytes(1),
+			   cast(double) (file_arena.peak + buffer.arena.peak) / megabytes(1));
+		
+		arena_fini(&buffer.arena);
+		arena_fini(&file_arena);
+	}
+	
+	{
+		// What ed_buffer_load_file does for big files: the first screen is shown once the
+		// first chunk is indexed, the rest comes in the background
+		memset(&mem_stats, 0, sizeof(mem_stats));
+		
+		u64 read_start = get_time_ns();
+		Read_File_Result map_file_result = map_file(file_name);
+		u64 read_end = get_time_ns();
+		
+		if (map_file_result.ok && map_file_result.contents.len > 0) {
+			ED_Buffer buffer = {0};
+			arena_init_flags(&buffer.arena, DEFAULT_ARENA_RESERVE_SIZE, ED_BUFFER_ARENA_FLAGS);
+			
+			u64 init_start = get_time_ns();
+			ed_buffer_start_loading(&buffer, map_file_result.contents);
+			(void)ed_line_from_line_number(&buffer, 0);
+			u64 first_screen_end = get_time_ns();
+			
+			ed_buffer_finish_loading(&buffer);
+			u64 init_end = get_time_ns();
+			
+			char *names[] = { "mapped, first screen", "mapped, all indexed" };
+			u64 ends[] = { first_screen_end, init_end };
+			for (i64 i = 0; i < array_count(names); i += 1) {
+				printf("%-22s %10.2f %10.2f %10llu %12.1f %12.1f\n", names[i],
+					   bench_ms_from_ns(read_end - read_start),
+					   bench_ms_from_ns(ends[i] - init_start),
+					   cast(unsigned long long) mem_stats.commit_count,
+					   cast(double) mem_stats.committed_bytes / megabytes(1),
+					   cast(double) buffer.arena.peak / megabytes(1));
+			}
+			
+			arena_fini(&buffer.arena);
+			unmap_file(map_file_result.contents);
+		}
+	}
+}
+
+////////////////////////////////
+//~ Random edit benchmark
+
+static Point
+bench_random_point(ED_Buffer *buffer) {
+	Point result = {0};
+	result.y = cast(i32) bench_random_range(0, buffer->line_count - 1);
+	result.x = cast(i32) bench_random_range(0, ed_line_len(ed_line_from_line_number(buffer, result.y)));
+	return result;
+}
+
+static Point
+bench_random_point_near(ED_Buffer *buffer, i64 line_number, i64 spread) {
+	// Within 'spread' lines of the given one, like a user working in one place
+	i64 y = line_number + bench_random_range(-spread, spread);
+	
+	Point result = {0};
+	result.y = cast(i32) clamp(0, y, buffer->line_count - 1);
+	result.x = cast(i32) bench_random_range(0, ed_line_len(ed_line_from_line_number(buffer, result.y)));
+	return result;
+}
+
+static void
+bench_random_edit_at(ED_Buffer *buffer, Point point) {
+	// Mostly typing and deleting a few characters, sometimes joining two lines
+	i64 line_len = ed_line_len(ed_line_from_line_number(buffer, point.y));
+	
+	i64 kind = bench_random_range(0, 99);
+	if (kind < 55) {
+		// Type a few characters
+		u8 text[8];
+		i64 text_len = bench_random_range(1, array_count(text));
+		for (i64 i = 0; i < text_len; i += 1) {
+			text[i] = cast(u8) bench_random_range('a', 'z');
+		}
+		ed_buffer_insert_text_at_point(buffer, point, string(text, text_len));
+	} else if (kind < 98) {
+		// Delete a few characters
+		i64 delete_len = bench_random_range(1, 8);
+		Point end = point;
+		end.x = cast(i32) min(point.x + delete_len, line_len);
+		ed_buffer_remove_range(buffer, make_text_range(point, end));
+	} else if (point.y + 1 < buffer->line_count) {
+		// Join with the next line
+		Point start = {cast(i32) line_len, point.y};
+		Point end   = {0, point.y + 1};
+		ed_buffer_remove_range(buffer, make_text_range(start, end));
+	}
+}
+
+static void
+bench_random_edit(ED_Buffer *buffer) {
+	bench_random_edit_at(buffer, bench_random_point(buffer));
+}
+
+static void
+bench_edit(String file_name) {
+	bench_print_header("edit");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	ED_Buffer buffer = {0};
+	if (bench_load_buffer(&buffer, &arena, file_name)) {
+		i64 edit_count = 100000;
+		i64 report_every = edit_count / 10;
+		
+		printf("%10s %12s %12s %12s %14s %12s\n", "edits", "lines", "bytes", "spans", "spans per KB", "frag. ratio");
+		
+		u64 start = get_time_ns();
+		for (i64 edit_index = 0; edit_index <= edit_count; edit_index += 1) {
+			if (edit_index % report_every == 0) {
+				printf("%10lld %12lld %12lld %12lld %14.2f %12.2f\n", cast(long long) edit_index,
+					   cast(long long) buffer.line_count, cast(long long) buffer.byte_count, cast(long long) buffer.span_count,
+					   cast(double) buffer.span_count * 1024.0 / cast(double) max(buffer.byte_count, 1),
+					   cast(double) ed_buffer_fragmentation(&buffer));
+			}
+			
+			bench_random_edit(&buffer);
+		}
+		u64 end = get_time_ns();
+		
+		ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+		
+		printf("%.1f ns/edit\n", cast(double) (end - start) / cast(double) edit_count);
+		
+		arena_fini(&buffer.arena);
+	}
+	
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Geometry benchmark
+
+static void
+bench_geometry(String file_name) {
+	bench_print_header("geometry");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	SliceU8 contents = {0};
+	if (file_name.len > 0) {
+		Read_File_Result read_file_result = read_file(&arena, file_name);
+		if (read_file_result.ok) {
+			contents = read_file_result.contents;
+		} else {
+			printf("Failed to read '%.*s'\n", string_expand(file_name));
+		}
+	} else {
+		contents = bench_synthetic_text(&arena, 10000, 120);
+	}
+	
+	ED_Buffer buffer = {0};
+	arena_init_flags(&buffer.arena, max(DEFAULT_ARENA_RESERVE_SIZE, cast(u64) contents.len * 4), ED_BUFFER_ARENA_FLAGS);
+	
+	// Load
+	u64 load_start = get_time_ns();
+	ed_init_buffer_contents(&buffer, contents);
+	u64 load_end = get_time_ns();
+	
+	u64 loaded_bytes = buffer.arena.pos;
+	i64 loaded_page_count = buffer.page_count;
+	
+	// Scroll: draw screens of 50 lines at evenly spaced positions
+	i64 frame_count = 2000;
+	i64 rows = 50;
+	u64 scroll_start = get_time_ns();
+	for (i64 frame_index = 0; frame_index < frame_count; frame_index += 1) {
+		Scratch scratch = scratch_begin(0, 0);
+		
+		i64 first_line = frame_index * buffer.line_count / frame_count;
+		ED_Page_I64 rel = ed_relative_from_absolute_line(&buffer, first_line);
+		ED_Page *page = rel.page;
+		i64 line_in_page = rel.i;
+		
+		for (i64 row = 0; row < rows && page; row += 1) {
+			(void)ed_render_line_window(scratch.arena, ed_line_position_from_column(&page->lines[line_in_page], 0), 0, 120);
+			
+			line_in_page += 1;
+			if (line_in_page == page->line_count) {
+				page = page->next;
+				line_in_page = 0;
+			}
+		}
+		
+		scratch_end(scratch);
+	}
+	u64 scroll_end = get_time_ns();
+	
+	// Insert: typing, with a newline now and then
+	i64 op_count = 20000;
+	u64 insert_start = get_time_ns();
+	for (i64 op_index = 0; op_index < op_count; op_index += 1) {
+		u8 text[8];
+		i64 text_len = bench_random_range(1, array_count(text));
+		for (i64 i = 0; i < text_len; i += 1) {
+			text[i] = bench_random_range(0, 7) == 0 ? '\n' : cast(u8) bench_random_range('a', 'z');
+		}
+		ed_buffer_insert_text_at_point(&buffer, bench_random_point(&buffer), string(text, text_len));
+	}
+	u64 insert_end = get_time_ns();
+	
+	// Delete: within a line, or now and then across up to 2 lines
+	u64 delete_start = get_time_ns();
+	for (i64 op_index = 0; op_index < op_count && buffer.line_count > 4; op_index += 1) {
+		Point start = bench_random_point(&buffer);
+		Point end = start;
+		
+		i64 line_delta = bench_random_range(0, 3) == 0 ? bench_random_range(1, 2) : 0;
+		if (line_delta > 0 && start.y + line_delta < buffer.line_count) {
+			end.y = cast(i32) (start.y + line_delta);
+			end.x = cast(i32) bench_random_range(0, ed_line_len(ed_line_from_line_number(&buffer, end.y)));
+		} else {
+			i64 delete_len = bench_random_range(1, 8);
+			end.x = cast(i32) min(start.x + delete_len, ed_line_len(ed_line_from_line_number(&buffer, start.y)));
+		}
+		
+		ed_buffer_remove_range(&buffer, make_text_range(start, end));
+	}
+	u64 delete_end = get_time_ns();
+	
+	ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+	
+	printf("%5s %5s %10s %10s %10s %12s %12s %12s\n", "span", "page", "pages", "load ms", "load MB", "scroll ns/f", "insert ns/op", "delete ns/op");
+	printf("%5d %5d %10lld %10.2f %10.1f %12.0f %12.0f %12.0f\n", ED_SPAN_SIZE, ED_PAGE_SIZE,
+		   cast(long long) loaded_page_count,
+		   bench_ms_from_ns(load_end - load_start),
+		   cast(double) loaded_bytes / megabytes(1),
+		   cast(double) (scroll_end - scroll_start) / cast(double) frame_count,
+		   cast(double) (insert_end - insert_start) / cast(double) op_count,
+		   cast(double) (delete_end - delete_start) / cast(double) op_count);
+	
+	arena_fini(&buffer.arena);
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Paste benchmark
+
+static void
+bench_paste(String file_name) {
+	bench_print_header("paste");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	ED_Buffer buffer = {0};
+	if (bench_load_buffer(&buffer, &arena, file_name)) {
+		printf("%12s %12s %12s %12s %12s\n", "lines", "ms", "ns/line", "pages", "frag. ratio");
+		
+		// Paste blocks of growing size in the middle of the buffer; the time should grow with
+		// the size of the block and not with the lines after it
+		for (i64 line_count = 1000; line_count <= 1000000; line_count *= 10) {
+			Scratch scratch = scratch_begin(0, 0);
+			String text = string_from_sliceu8(bench_synthetic_text(scratch.arena, line_count, 60));
+			
+			Point point = {0, cast(i32) (buffer.line_count / 2)};
+			
+			u64 start = get_time_ns();
+			ed_buffer_insert_text_at_point(&buffer, point, text);
+			u64 end = get_time_ns();
+			
+			printf("%12lld %12.2f %12.1f %12lld %12.2f\n", cast(long long) line_count,
+				   bench_ms_from_ns(end - start),
+				   cast(double) (end - start) / cast(double) line_count,
+				   cast(long long) buffer.page_count,
+				   cast(double) ed_buffer_fragmentation(&buffer));
+			
+			scratch_end(scratch);
+		}
+		
+		ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+		
+		arena_fini(&buffer.arena);
+	}
+	
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Delete benchmark
+
+static void
+bench_delete(String file_name) {
+	bench_print_header("delete");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	ED_Buffer buffer = {0};
+	bool ok = true;
+	if (file_name.len > 0) {
+		ok = bench_load_buffer(&buffer, &arena, file_name);
+	} else {
+		SliceU8 contents = bench_synthetic_text(&arena, 2000000, 120);
+		arena_init_flags(&buffer.arena, max(DEFAULT_ARENA_RESERVE_SIZE, cast(u64) contents.len * 4), ED_BUFFER_ARENA_FLAGS);
+		ed_init_buffer_contents(&buffer, contents);
+	}
+	
+	if (ok) {
+		i64 line_count = buffer.line_count;
+		
+		// Delete the middle half of the buffer
+		Point start = {0, cast(i32) (line_count / 4)};
+		Point end   = {0, cast(i32) (line_count * 3 / 4)};
+		
+		u64 delete_start = get_time_ns();
+		ed_buffer_remove_range(&buffer, make_text_range(start, end));
+		u64 delete_end = get_time_ns();
+		
+		i64 zombie_page_count = buffer.zombie_page_count;
+		
+		// Type over the hole: the spans come back from the zombie pages
+		i64 op_count = 1000;
+		u64 insert_start = get_time_ns();
+		for (i64 op_index = 0; op_index < op_count; op_index += 1) {
+			u8 text[8];
+			i64 text_len = bench_random_range(1, array_count(text));
+			for (i64 i = 0; i < text_len; i += 1) {
+				text[i] = bench_random_range(0, 7) == 0 ? '\n' : cast(u8) bench_random_range('a', 'z');
+			}
+			Point point = {0, cast(i32) (line_count / 4)};
+			ed_buffer_insert_text_at_point(&buffer, point, string(text, text_len));
+		}
+		u64 insert_end = get_time_ns();
+		
+		// Give back whatever is left, as the editor does when it is idle
+		u64 reclaim_start = get_time_ns();
+		ed_buffer_reclaim_zombie_pages(&buffer, buffer.zombie_page_count);
+		u64 reclaim_end = get_time_ns();
+		
+		ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+		
+		printf("%12s %12s %12s %14s %12s\n", "lines", "delete ms", "zombies", "insert ns/op", "reclaim ms");
+		printf("%12lld %12.2f %12lld %14.0f %12.2f\n", cast(long long) (end.y - start.y),
+			   bench_ms_from_ns(delete_end - delete_start),
+			   cast(long long) zombie_page_count,
+			   cast(double) (insert_end - insert_start) / cast(double) op_count,
+			   bench_ms_from_ns(reclaim_end - reclaim_start));
+		
+		arena_fini(&buffer.arena);
+	}
+	
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Snapshot benchmark
+
+// FNV-1a of the lines of a page, each followed by a line break
+static u64
+bench_hash_page(ED_Page *page, u64 hash) {
+	assert(page->lines); // The benchmark buffers aren't lazy
+	
+	for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+		for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+			for (i64 i = 0; i < span->len; i += 1) {
+				hash = (hash ^ span->data[i]) * 0x100000001B3ULL;
+			}
+		}
+		hash = (hash ^ '\n') * 0x100000001B3ULL;
+	}
+	
+	return hash;
+}
+
+typedef struct Bench_Snapshot_Reader Bench_Snapshot_Reader;
+struct Bench_Snapshot_Reader {
+	ED_Snapshot *snapshot; // Handed over by the main thread, cleared once read
+	u64 should_quit;
+	
+	// Written by the reader before it clears the snapshot
+	u64 hash;
+	u64 line_count;
+	u64 read_ns;
+};
+
+static void
+bench_snapshot_reader_proc(void *data) {
+	Bench_Snapshot_Reader *reader = data;
+	
+	while (!atomic_load_u64(&reader->should_quit)) {
+		ED_Snapshot *snapshot = atomic_load_ptr(&reader->snapshot);
+		if (snapshot) {
+			u64 start = get_time_ns();
+			
+			u64 hash = 0xCBF29CE484222325ULL;
+			u64 line_count = 0;
+			for (ED_Page *page = ed_snapshot_next_page(snapshot, NULL); page; page = ed_snapshot_next_page(snapshot, page)) {
+				hash = bench_hash_page(page, hash);
+				line_count += page->line_count;
+			}
+			
+			reader->hash = hash;
+			reader->line_count = line_count;
+			reader->read_ns += get_time_ns() - start;
+			
+			ed_snapshot_release(snapshot);
+			atomic_store_ptr(&reader->snapshot, NULL);
+		} else {
+			sleep_ms(1);
+		}
+	}
+}
+
+static void
+bench_snapshot(String file_name) {
+	// Edits the buffer while another thread reads snapshots of it, and checks that each one
+	// reads as the buffer was when it was taken
+	bench_print_header("snapshot");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	ED_Buffer buffer = {0};
+	if (bench_load_buffer(&buffer, &arena, file_name)) {
+		i64 edit_count = 100000;
+		
+		u64 plain_start = get_time_ns();
+		for (i64 edit_index = 0; edit_index < edit_count; edit_index += 1) {
+			bench_random_edit(&buffer);
+		}
+		u64 plain_end = get_time_ns();
+		
+		Bench_Snapshot_Reader reader = {0};
+		Thread thread = thread_start(bench_snapshot_reader_proc, &reader);
+		
+		i64 snapshot_count = 0;
+		i64 mismatch_count = 0;
+		u64 expected_hash = 0;
+		i64 expected_line_count = 0;
+		u64 take_ns = 0;
+		u64 max_take_ns = 0;
+		u64 edit_ns = 0;
+		
+		for (i64 edit_index = 0; edit_index < edit_count; edit_index += 1) {
+			// A new snapshot as soon as the reader is done with the last one
+			if (!atomic_load_ptr(&reader.snapshot)) {
+				if (snapshot_count > 0 && (reader.hash != expected_hash || cast(i64) reader.line_count != expected_line_count)) {
+					mismatch_count += 1;
+				}
+				
+				u64 start = get_time_ns();
+				ED_Snapshot *snapshot = ed_buffer_take_snapshot(&buffer);
+				u64 end = get_time_ns();
+				
+				take_ns += end - start;
+				max_take_ns = max(max_take_ns, end - start);
+				snapshot_count += 1;
+				
+				// What the reader should find, walking the buffer itself (not timed)
+				expected_hash = 0xCBF29CE484222325ULL;
+				expected_line_count = buffer.line_count;
+				for (ED_Page *page = buffer.first_page; page; page = page->next) {
+					expected_hash = bench_hash_page(page, expected_hash);
+				}
+				
+				atomic_store_ptr(&reader.snapshot, snapshot);
+			}
+			
+			u64 start = get_time_ns();
+			bench_random_edit(&buffer);
+			edit_ns += get_time_ns() - start;
+		}
+		
+		while (atomic_load_ptr(&reader.snapshot)) {
+			sleep_ms(1);
+		}
+		if (reader.hash != expected_hash || cast(i64) reader.line_count != expected_line_count) {
+			mismatch_count += 1;
+		}
+		
+		atomic_store_u64(&reader.should_quit, 1);
+		thread_join(thread);
+		
+		i64 retired_page_count = 0;
+		for (ED_Retired_Page *retired = buffer.first_retired_page; retired; retired = retired->next) {
+			retired_page_count += 1;
+		}
+		
+		ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+		ed_buffer_collect_snapshots(&buffer);
+		ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+		
+		printf("%14s %14s %10s %12s %12s %14s %12s %10s\n", "plain ns/edit", "snap. ns/edit", "snapshots",
+			   "take ns", "max take ns", "read ms/snap.", "retired", "mismatches");
+		printf("%14.1f %14.1f %10lld %12.1f %12llu %14.2f %12lld %10lld\n",
+			   cast(double) (plain_end - plain_start) / cast(double) edit_count,
+			   cast(double) edit_ns / cast(double) edit_count,
+			   cast(long long) snapshot_count,
+			   cast(double) take_ns / cast(double) max(snapshot_count, 1),
+			   cast(unsigned long long) max_take_ns,
+			   bench_ms_from_ns(reader.read_ns) / cast(double) max(snapshot_count, 1),
+			   cast(long long) retired_page_count,
+			   cast(long long) mismatch_count);
+		
+		arena_fini(&buffer.arena);
+	}
+	
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Autosave benchmark
+
+// FNV-1a of some bytes
+static u64
+bench_hash_bytes(u64 hash, u8 *data, i64 len) {
+	for (i64 i = 0; i < len; i += 1) {
+		hash = (hash ^ data[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// FNV-1a of the buffer as it would be saved
+static u64
+bench_hash_buffer_file(ED_Buffer *buffer) {
+	String line_break = string_from_lit("\n");
+	if (buffer->line_ending == ED_Line_Ending_CRLF) {
+		line_break = string_from_lit("\r\n");
+	}
+	
+	u64 hash = 0xCBF29CE484222325ULL;
+	for (ED_Page *page = buffer->first_page; page; page = page->next) {
+		if (!page->lines) {
+			hash = bench_hash_bytes(hash, page->source, page->source_len);
+		} else {
+			for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+				for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+					hash = bench_hash_bytes(hash, span->data, span->len);
+				}
+				
+				if (page->next || line_index < page->line_count - 1) {
+					hash = bench_hash_bytes(hash, line_break.data, line_break.len);
+				}
+			}
+		}
+	}
+	
+	return hash;
+}
+
+static void
+bench_autosave_changed_file(String file_name) {
+	// Another program replaces a copy of the file (writing a new file and renaming it over the
+	// old one, as git and formatters do) while the buffer still has pages that point into the
+	// old one. The swap file can't point into the file anymore, so every page is written to
+	// it, the ones that were never split into lines included.
+	Scratch scratch = scratch_begin(0, 0);
+	String copy_name     = push_stringf(scratch.arena, "%.*s.copy", string_expand(file_name));
+	String new_copy_name = push_stringf(scratch.arena, "%.*s.copy.new", string_expand(file_name));
+	
+	Read_File_Result contents = read_file(scratch.arena, file_name);
+	String text = string_from_sliceu8(contents.contents);
+	bool copied = (contents.ok && write_file(copy_name, text));
+	
+	ED_Buffer buffer = {0};
+	bool loaded = copied && ed_buffer_load_file(&buffer, copy_name);
+	if (loaded) {
+		ed_buffer_finish_loading(&buffer);
+	}
+	
+	if (!loaded) {
+		printf("Failed to copy '%.*s'\n", string_expand(file_name));
+	} else {
+		ed_buffer_start_autosave(&buffer);
+		ED_Autosave *autosave = buffer.autosave;
+		
+		for (i64 edit_index = 0; edit_index < 100; edit_index += 1) {
+			bench_random_edit_at(&buffer, bench_random_point_near(&buffer, 0, 50));
+		}
+		buffer.has_unsaved_edits = true;
+		ed_buffer_evict_cold_pages(&buffer, 0, 50);
+		
+		String changed = push_stringf(scratch.arena, "%.*s\nchanged\n", string_expand(text));
+		bool replaced = (write_file(new_copy_name, changed) && replace_file(new_copy_name, copy_name));
+		assert(replaced);
+		
+		u64 start = get_time_ns();
+		ed_buffer_update_autosave(&buffer, true);
+		assert(autosave->thread.handle);
+		while (!atomic_load_u64(&autosave->is_done)) {
+			sleep_ms(1);
+		}
+		u64 run_ns = get_time_ns() - start;
+		
+		ed_buffer_update_autosave(&buffer, false);
+		assert(autosave->ok);
+		
+		Read_File_Result swap = ed_swap_file_contents(scratch.arena, copy_name);
+		bool matches = (swap.ok && bench_hash_bytes(0xCBF29CE484222325ULL, swap.contents.data, swap.contents.len) == bench_hash_buffer_file(&buffer));
+		printf("with the file replaced on disk: %.1f KB written in %.2f ms, swap file %s\n",
+			   cast(double) autosave->written_len / 1024.0, bench_ms_from_ns(run_ns),
+			   matches ? "matches the buffer" : "DOES NOT MATCH the buffer");
+		
+		ed_buffer_stop_autosave(&buffer);
+		delete_file(ed_swap_file_name(scratch.arena, copy_name));
+		
+		ed_buffer_collect_snapshots(&buffer);
+		ed_buffer_release_source(&buffer);
+	}
+	
+	if (buffer.arena.ptr) {
+		arena_fini(&buffer.arena);
+	}
+	if (copied) {
+		delete_file(copy_name);
+	}
+	
+	scratch_end(scratch);
+}
+
+static void
+bench_autosave(String file_name) {
+	// Edits the file in one place after another, autosaving after each round as the editor
+	// does when it goes idle, and keeps editing while the swap file is written. Then checks
+	// that the swap file reads back as the buffer.
+	bench_print_header("autosave");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	ED_Buffer buffer = {0};
+	u64 load_start = get_time_ns();
+	bool loaded = ed_buffer_load_file(&buffer, file_name);
+	if (loaded) {
+		ed_buffer_finish_loading(&buffer);
+	}
+	u64 load_end = get_time_ns();
+	
+	if (!loaded) {
+		printf("Failed to load '%.*s'\n", string_expand(file_name));
+	} else if (buffer.line_count < 2) {
+		printf("'%.*s' is too small\n", string_expand(file_name));
+	} else {
+		printf("loaded %lld lines in %.1f ms%s\n", cast(long long) buffer.line_count,
+			   bench_ms_from_ns(load_end - load_start), buffer.source.data ? " (lazily)" : "");
+		
+		ed_buffer_start_autosave(&buffer);
+		ED_Autosave *autosave = buffer.autosave;
+		
+		i64 round_count = 20;
+		i64 edits_per_round = 1000;
+		
+		printf("%6s %12s %12s %14s %12s %14s %14s\n", "round", "stall us", "run ms", "written KB",
+			   "swap MB", "edits in run", "ns/edit in run");
+		
+		u64 max_stall_ns = 0;
+		u64 total_stall_ns = 0;
+		u64 total_run_ns = 0;
+		for (i64 round_index = 0; round_index <= round_count; round_index += 1) {
+			i64 line_number = bench_random_range(0, buffer.line_count - 1);
+			for (i64 edit_index = 0; edit_index < edits_per_round; edit_index += 1) {
+				bench_random_edit_at(&buffer, bench_random_point_near(&buffer, line_number, 200));
+			}
+			buffer.has_unsaved_edits = true;
+			ed_buffer_evict_cold_pages(&buffer, line_number, 50);
+			
+			u64 start = get_time_ns();
+			ed_buffer_update_autosave(&buffer, true);
+			u64 stall_ns = get_time_ns() - start;
+			assert(autosave->thread.handle);
+			
+			// Typing goes on meanwhile, somewhere else, except during the last run: it's checked
+			line_number = bench_random_range(0, buffer.line_count - 1);
+			i64 edit_count = 0;
+			u64 edit_ns = 0;
+			while (!atomic_load_u64(&autosave->is_done)) {
+				if (round_index < round_count) {
+					u64 edit_start = get_time_ns();
+					bench_random_edit_at(&buffer, bench_random_point_near(&buffer, line_number, 200));
+					edit_ns += get_time_ns() - edit_start;
+					edit_count += 1;
+				} else {
+					sleep_ms(1);
+				}
+			}
+			u64 run_ns = get_time_ns() - start;
+			
+			// Joins the run
+			ed_buffer_update_autosave(&buffer, false);
+			assert(autosave->ok);
+			
+			if (round_index > 0) {
+				max_stall_ns = max(max_stall_ns, stall_ns);
+				total_stall_ns += stall_ns;
+				total_run_ns += run_ns;
+			}
+			
+			printf("%6lld %12.1f %12.2f %14.1f %12.1f %14lld %14.1f\n", cast(long long) round_index,
+				   cast(double) stall_ns / 1000.0, bench_ms_from_ns(run_ns),
+				   cast(double) autosave->written_len / 1024.0, cast(double) autosave->swap_len / (1024.0 * 1024.0),
+				   cast(long long) edit_count, cast(double) edit_ns / cast(double) max(edit_count, 1));
+		}
+		
+		printf("after the first: %.1f us stall on average, %.1f us at most, %.2f ms per run\n",
+			   cast(double) total_stall_ns / (1000.0 * cast(double) round_count),
+			   cast(double) max_stall_ns / 1000.0, bench_ms_from_ns(total_run_ns) / cast(double) round_count);
+		
+		// Nothing changed since the last run
+		Read_File_Result swap = ed_swap_file_contents(&arena, file_name);
+		bool matches = (swap.ok && bench_hash_bytes(0xCBF29CE484222325ULL, swap.contents.data, swap.contents.len) == bench_hash_buffer_file(&buffer));
+		printf("swap file %s\n", matches ? "matches the buffer" : "DOES NOT MATCH the buffer");
+		
+		ed_buffer_stop_autosave(&buffer);
+		
+		bench_autosave_changed_file(file_name);
+		
+		Scratch scratch = scratch_begin(0, 0);
+		delete_file(ed_swap_file_name(scratch.arena, file_name));
+		scratch_end(scratch);
+		
+		ed_buffer_collect_snapshots(&buffer);
+		ed_buffer_release_source(&buffer);
+	}
+	
+	if (buffer.arena.ptr) {
+		arena_fini(&buffer.arena);
+	}
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Reload benchmark
+
+static bool
+bench_replace_file(Arena *arena, String file_name, String contents) {
+	// As another program would: a new file renamed over the old one
+	String new_file_name = push_stringf(arena, "%.*s.new", string_expand(file_name));
+	return (write_file(new_file_name, contents) && replace_file(new_file_name, file_name));
+}
+
+static void
+bench_reload_copy(Arena *arena, String copy_name, SliceU8 contents) {
+	// Rewrites a few lines somewhere in the copy, with the cursor on them or on a random line
+	// (for a lazily loaded file, on a page that wasn't read yet), reloads it, and checks that
+	// the buffer is the file. Then times loading it again from scratch.
+	i64 round_count = 10;
+	i64 capacity = contents.len + round_count * 512;
+	SliceU8 text = push_sliceu8(arena, capacity);
+	memcpy(text.data, contents.data, contents.len);
+	text.len = contents.len;
+	
+	ED_Buffer buffer = {0};
+	bool loaded = bench_replace_file(arena, copy_name, string_from_sliceu8(text)) && ed_buffer_load_file(&buffer, copy_name);
+	if (loaded) {
+		ed_buffer_finish_loading(&buffer);
+	}
+	
+	if (!loaded) {
+		printf("Failed to write or load '%.*s'\n", string_expand(copy_name));
+	} else {
+		printf("%lld lines, %.1f MB%s\n", cast(long long) buffer.line_count, cast(double) text.len / megabytes(1),
+			   buffer.source.data ? " (lazily loaded)" : "");
+		printf("%6s %12s %12s %10s\n", "round", "removed B", "added B", "reload ms");
+		
+		String line_break = (buffer.line_ending == ED_Line_Ending_CRLF) ? string_from_lit("\r\n") : string_from_lit("\n");
+		
+		bool matches = true;
+		for (i64 round_index = 0; round_index < round_count && matches; round_index += 1) {
+			// Whole lines, up to 256 bytes of them, replaced by up to 4 new ones
+			i64 start = bench_random_range(0, text.len - 1);
+			while (start > 0 && text.data[start - 1] != '\n') {
+				start -= 1;
+			}
+			
+			buffer.cursor.x = 0;
+			if (round_index % 2 == 0) {
+				buffer.cursor.y = cast(i32) string_count_occurrences(string(text.data, start), '\n');
+			} else {
+				buffer.cursor.y = cast(i32) bench_random_range(0, buffer.line_count - 1);
+			}
+			buffer.vscroll = buffer.cursor.y;
+			i64 end = min(start + bench_random_range(1, 256), text.len);
+			while (end < text.len && text.data[end - 1] != '\n') {
+				end += 1;
+			}
+			
+			u8 replacement[256];
+			i64 replacement_len = 0;
+			i64 line_count = bench_random_range(0, 4);
+			for (i64 line_index = 0; line_index < line_count; line_index += 1) {
+				replacement_len += snprintf(cast(char *) replacement + replacement_len, 40, "reloaded %lld.%lld",
+											cast(long long) round_index, cast(long long) line_index);
+				memcpy(replacement + replacement_len, line_break.data, line_break.len);
+				replacement_len += line_break.len;
+			}
+			
+			memmove(text.data + start + replacement_len, text.data + end, text.len - end);
+			memcpy(text.data + start, replacement, replacement_len);
+			text.len += replacement_len - (end - start);
+			assert(text.len <= capacity);
+			
+			bool replaced = bench_replace_file(arena, copy_name, string_from_sliceu8(text));
+			assert(replaced);
+			
+			u64 reload_start = get_time_ns();
+			bool reloaded = ed_buffer_reload_file(&buffer);
+			u64 reload_ns = get_time_ns() - reload_start;
+			assert(reloaded);
+			
+			ed_validate_buffer(&buffer, ED_Validation_Level_FULL);
+			matches = (bench_hash_buffer_file(&buffer) == bench_hash_bytes(0xCBF29CE484222325ULL, text.data, text.len));
+			
+			printf("%6lld %12lld %12lld %10.2f\n", cast(long long) round_index, cast(long long) (end - start),
+				   cast(long long) replacement_len, bench_ms_from_ns(reload_ns));
+		}
+		printf("the buffer %s\n", matches ? "matches the file after every reload" : "DOES NOT MATCH the file");
+		
+		ed_buffer_collect_snapshots(&buffer);
+		ed_buffer_release_source(&buffer);
+		arena_fini(&buffer.arena);
+		
+		ED_Buffer fresh = {0};
+		u64 load_start = get_time_ns();
+		bool fresh_loaded = ed_buffer_load_file(&fresh, copy_name);
+		if (fresh_loaded) {
+			ed_buffer_finish_loading(&fresh);
+		}
+		u64 load_ns = get_time_ns() - load_start;
+		if (fresh_loaded) {
+			printf("loading it again instead takes %.2f ms\n", bench_ms_from_ns(load_ns));
+			ed_buffer_release_source(&fresh);
+			arena_fini(&fresh.arena);
+		}
+	}
+	
+	delete_file(copy_name);
+}
+
+static void
+bench_reload(String file_name) {
+	// On a copy of the start of the file small enough to be read whole, then on one made of
+	// the file repeated until it is loaded lazily
+	bench_print_header("reload");
+	
+	Arena arena = {0};
+	arena_init(&arena);
+	
+	Read_File_Result read_file_result = read_file(&arena, file_name);
+	if (!read_file_result.ok || read_file_result.contents.len == 0) {
+		printf("Failed to read '%.*s' (or it is empty)\n", string_expand(file_name));
+	} else {
+		SliceU8 contents = read_file_result.contents;
+		String copy_name = push_stringf(&arena, "%.*s.copy", string_expand(file_name));
+		
+		SliceU8 small = contents;
+		if (small.len >= ED_LAZY_MIN_FILE_SIZE) {
+			small.len = ED_LAZY_MIN_FILE_SIZE - 1;
+			while (small.len > 0 && small.data[small.len - 1] != '\n') {
+				small.len -= 1;
+			}
+		}
+		
+		if (small.len > 0) {
+			bench_reload_copy(&arena, copy_name, small);
+		}
+		
+		// Whole copies of the file, so that the line endings stay as they are
+		SliceU8 big = contents;
+		if (big.len < ED_LAZY_MIN_FILE_SIZE) {
+			i64 copy_count = (ED_LAZY_MIN_FILE_SIZE + contents.len - 1) / contents.len;
+			big = push_sliceu8(&arena, copy_count * contents.len);
+			for (i64 copy_index = 0; copy_index < copy_count; copy_index += 1) {
+				memcpy(big.data + copy_index * contents.len, contents.data, contents.len);
+			}
+		}
+		
+		printf("\n");
+		bench_reload_copy(&arena, copy_name, big);
+	}
+	
+	arena_fini(&arena);
+}
+
+////////////////////////////////
+//~ Highlight benchmark
+
+typedef struct Bench_Frames Bench_Frames;
+struct Bench_Frames {
+	i64 count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+static void
+bench_highlight_frame(ED_Buffer *buffer, i64 first_line, Bench_Frames *frames) {
+	// What highlighting adds to drawing a screen of 50 rows of 120 columns
+	Scratch scratch = scratch_begin(0, 0);
+	
+	u64 start = get_time_ns();
+	ED_Line_Tokens *tokens = ed_buffer_highlight_lines(scratch.arena, buffer, first_line, 50, 0, 120);
+	u64 ns = get_time_ns() - start;
+	assert(tokens);
+	
+	frames->count    += 1;
+	frames->total_ns += ns;
+	frames->max_ns    = max(frames->max_ns, ns);
+	
+	scratch_end(scratch);
+}
+
+static void
+bench_print_frames(char *name, Bench_Frames frames) {
+	printf("%-28s %8lld %12.1f %12.1f\n", name, cast(long long) frames.count,
+		   cast(double) frames.total_ns / (1000.0 * cast(double) max(frames.count, 1)), cast(double) frames.max_ns / 1000.0);
+}
+
+static bool
+bench_highlight_matches(ED_Buffer *buffer, i64 first_line) {
+	// Whether the screen at 'first_line' and the end states kept before the frontier are what
+	// lexing the whole buffer from its first line gives
+	Scratch scratch = scratch_begin(0, 0);
+	
+	ED_Line_Tokens *tokens = ed_buffer_highlight_lines(scratch.arena, buffer, first_line, 50, 0, 120);
+	i64 end_line = min(first_line + 50, buffer->line_count);
+	
+	bool matches = (tokens != NULL);
+	ED_Lex_State state = ED_Lex_State_CODE;
+	for (i64 line_number = 0; line_number < end_line && matches; line_number += 1) {
+		ED_Line *line = ed_line_from_line_number(buffer, line_number);
+		
+		ED_Line_Tokens expected = {0};
+		i64 first_x = 0;
+		i64 end_x   = 0;
+		if (line_number >= first_line) {
+			first_x = ed_buffer_line_position_from_column(buffer, line, line_number, 0).x;
+			end_x   = ed_buffer_line_position_from_column(buffer, line, line_number, 120).x + 1;
+			end_x   = max(first_x, min(end_x, ed_line_len(line)));
+			expected.tokens = push_array(scratch.arena, ED_Token, end_x - first_x);
+		}
+		
+		state = ed_lex_line(line, state, (line_number >= first_line) ? &expected : NULL, first_x, end_x);
+		
+		if (line_number < buffer->highlight.frontier) {
+			matches = (line->lex_state == state);
+		}
+		
+		if (line_number >= first_line) {
+			ED_Line_Tokens got = tokens[line_number - first_line];
+			matches = matches && (got.count == expected.count);
+			for (i64 token_index = 0; token_index < expected.count && matches; token_index += 1) {
+				matches = (got.tokens[token_index].x    == expected.tokens[token_index].x &&
+						   got.tokens[token_index].kind == expected.tokens[token_index].kind);
+			}
+		}
+	}
+	
+	scratch_end(scratch);
+	
+	return matches;
+}
+
+static void
+bench_highlight(String file_name) {
+	// Highlights screens of the file (lexed as C, whatever its name) as the editor would: from
+	// the top, paging down, and while typing in one place, near the top and far into the file.
+	// Lexing the whole file is timed first, which is what every keystroke would cost without
+	// the states kept in the lines. After typing and after the comments, the screen and the
+	// kept states are checked against lexing from the start.
+	bench_print_header("highlight");
+	
+	ED_Buffer buffer = {0};
+	bool loaded = ed_buffer_load_file(&buffer, file_name);
+	if (loaded) {
+		ed_buffer_finish_loading(&buffer);
+	}
+	
+	if (!loaded) {
+		printf("Failed to load '%.*s'\n", string_expand(file_name));
+	} else {
+		buffer.highlight.language = ED_Language_C;
+		
+		// Without keeping anything
+		u64 full_start = get_time_ns();
+		ED_Lex_State state = ED_Lex_State_CODE;
+		i64 byte_count = 0;
+		for (ED_Page *page = buffer.first_page; page; page = page->next) {
+			if (!page->lines) {
+				page = ed_buffer_materialize_page(&buffer, page);
+			}
+			for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+				state = ed_lex_line(&page->lines[line_index], state, NULL, 0, 0);
+				byte_count += ed_line_len(&page->lines[line_index]) + 1;
+			}
+		}
+		u64 full_ns = get_time_ns() - full_start;
+		
+		printf("%lld lines%s, lexing all of them takes %.2f ms (%.0f MB/s)\n", cast(long long) buffer.line_count,
+			   buffer.source.data ? " (lazily loaded)" : "", bench_ms_from_ns(full_ns),
+			   cast(double) byte_count / megabytes(1) / (cast(double) full_ns / 1e9));
+		
+		// Only the screens from here on are lexed
+		ed_buffer_evict_cold_pages(&buffer, 0, 50);
+		
+		printf("%-28s %8s %12s %12s\n", "", "frames", "us/frame", "max us");
+		
+		Bench_Frames first = {0};
+		bench_highlight_frame(&buffer, 0, &first);
+		bench_print_frames("first screen", first);
+		
+		Bench_Frames page_down = {0};
+		i64 near_line = 0;
+		while (page_down.count < 200 && near_line + 50 < buffer.line_count) {
+			near_line += 50;
+			bench_highlight_frame(&buffer, near_line, &page_down);
+		}
+		bench_print_frames("page down", page_down);
+		
+		// Typing in the last screen paged down to, a frame per keystroke
+		Bench_Frames typing = {0};
+		for (i64 edit_index = 0; edit_index < 1000; edit_index += 1) {
+			bench_random_edit_at(&buffer, bench_random_point_near(&buffer, near_line + 25, 25));
+			bench_highlight_frame(&buffer, near_line, &typing);
+		}
+		bench_print_frames("typing", typing);
+		bool typing_matches = bench_highlight_matches(&buffer, near_line);
+		
+		// Opening a comment on the first row changes the state of every line after it, closing
+		// it changes them back
+		Bench_Frames toggle = {0};
+		for (i64 toggle_index = 0; toggle_index < 100; toggle_index += 1) {
+			Point point = {0, cast(i32) near_line};
+			ed_buffer_insert_text_at_point(&buffer, point, string_from_lit("/*"));
+			bench_highlight_frame(&buffer, near_line, &toggle);
+			ed_buffer_remove_range(&buffer, make_text_range(point, (Point){2, cast(i32) near_line}));
+			bench_highlight_frame(&buffer, near_line, &toggle);
+		}
+		bench_print_frames("comment opened and closed", toggle);
+		bool toggle_matches = bench_highlight_matches(&buffer, near_line);
+		
+		// Past what is caught up on, from a little above the screen every frame
+		i64 far_line = max(buffer.line_count - 50, 0);
+		Bench_Frames far_typing = {0};
+		bench_highlight_frame(&buffer, far_line, &far_typing);
+		for (i64 edit_index = 0; edit_index < 1000; edit_index += 1) {
+			bench_random_edit_at(&buffer, bench_random_point_near(&buffer, far_line + 25, 25));
+			bench_highlight_frame(&buffer, far_line, &far_typing);
+		}
+		bench_print_frames("typing at the end", far_typing);
+		
+		printf("end states kept for %lld lines\n", cast(long long) buffer.highlight.valid_line_count);
+		printf("after typing, highlighting %s\n", typing_matches ? "matches lexing from the start" : "DOES NOT MATCH lexing from the start");
+		printf("after the comments, highlighting %s\n", toggle_matches ? "matches lexing from the start" : "DOES NOT MATCH lexing from the start");
+		
+		ed_buffer_collect_snapshots(&buffer);
+		ed_buffer_release_source(&buffer);
+	}
+	
+	if (buffer.arena.ptr) {
+		arena_fini(&buffer.arena);
+	}
+}
+
+////////////////////////////////
+//~ Entry point
+
+int main(int argc, char **argv) {
+	int result = 0;
+	
+	if (argc > 2 && strcmp(argv[1], "load") == 0) {
+		bench_load(string_from_cstring(argv[2]));
+	} else if (argc > 1 && strcmp(argv[1], "edit") == 0) {
+		bench_edit(argc > 2 ? string_from_cstring(argv[2]) : string_from_lit(""));
+	} else if (argc > 1 && strcmp(argv[1], "geometry") == 0) {
+		bench_geometry(argc > 2 ? string_from_cstring(argv[2]) : string_from_lit(""));
+	} else if (argc > 1 && strcmp(argv[1], "paste") == 0) {
+		bench_paste(argc > 2 ? string_from_cstring(argv[2]) : string_from_lit(""));
+	} else if (argc > 1 && strcmp(argv[1], "delete") == 0) {
+		bench_delete(argc > 2 ? string_from_cstring(argv[2]) : string_from_lit(""));
+	} else if (argc > 1 && strcmp(argv[1], "snapshot") == 0) {
+		bench_snapshot(argc > 2 ? string_from_cstring(argv[2]) : string_from_lit(""));
+	} else if (argc > 2 && strcmp(argv[1], "autosave") == 0) {
+		bench_autosave(string_from_cstring(argv[2]));
+	} else if (argc > 2 && strcmp(argv[1], "reload") == 0) {
+		bench_reload(string_from_cstring(argv[2]));
+	} else if (argc > 2 && strcmp(argv[1], "highlight") == 0) {
+		bench_highlight(string_from_cstring(argv[2]));
+	} else {
+		fprintf(stderr, "Usage: %s load <file>\n", argv[0]);
+		fprintf(stderr, "       %s edit [file]\n", argv[0]);
+		fprintf(stderr, "       %s geometry [file]\n", argv[0]);
+		fprintf(stderr, "       %s paste [file]\n", argv[0]);
+		fprintf(stderr, "       %s delete [file]\n", argv[0]);
+		fprintf(stderr, "       %s snapshot [file]\n", argv[0]);
+		fprintf(stderr, "       %s autosave <file>\n", argv[0]);
+		fprintf(stderr, "       %s reload <file>\n", argv[0]);
+		fprintf(stderr, "       %s highlight <file>\n", argv[0]);
+		result = 1;
+	}
+	
+	return result;
+}
@@ -45,6 +45,15 @@
 # error Compiler is not supported. _MSC_VER, __clang__, __GNUC__, or __GNUG__ must be defined.
 #endif
 
+////////////////////////////////
+//~ Context Crack: Architecture
+
+#if defined(__x86_64__) || defined(_M_AMD64)
+# define ARCH_X64 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+# define ARCH_ARM64 1
+#endif
+
 ////////////////////////////////
 //~ Context Crack: Zero
 
@@ -66,5 +75,11 @@
 #if !defined(OS_MAC)
 # define OS_MAC 0
 #endif
+#if !defined(ARCH_X64)
+# define ARCH_X64 0
+#endif
+#if !defined(ARCH_ARM64)
+# define ARCH_ARM64 0
+#endif
 
 #endif
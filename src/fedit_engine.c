@@ -0,0 +1,4357 @@
+#ifndef FEDIT_ENGINE_C
+#define FEDIT_ENGINE_C
+
+// The buffer engine: storage, editing, navigation and loading of text buffers. Nothing in
+// here touches the terminal or the editor's global state, so it can be built on its own
+// (build.sh turns it into libfedit_engine.a) or included by a front end.
+
+#include "fedit_ctx_crack.h"
+#include "fedit_base.h"
+
+#include "fedit_base.c"
+
+#include "fedit_engine.h"
+
+// TODO: Review all casts
+
+////////////////////////////////
+//~ Internal functions
+
+// The engine's interface is in fedit_engine.h. These are what it is built from: pages, spans
+// and the pool, the links snapshots follow, line indexes, the loader threads and the like.
+
+//- Editor elements allocation functions
+
+static ED_Page *ed_alloc_page(ED_Buffer *buffer);
+static void     ed_free_page(ED_Buffer *buffer, ED_Page *page);
+
+static ED_Page *ed_alloc_source_page(ED_Buffer *buffer, u8 *source, i64 source_len, i64 line_count);
+static void     ed_buffer_evict_pages_outside(ED_Buffer *buffer, i64 keep_start, i64 keep_end);
+
+static ED_Span *ed_alloc_span(ED_Buffer *buffer);
+static void     ed_free_span(ED_Buffer *buffer, ED_Span *span);
+static void     ed_free_span_chain(ED_Buffer *buffer, ED_Span *first, ED_Span *last, i64 count);
+
+static void ed_zombify_pages(ED_Buffer *buffer, ED_Page *first, ED_Page *last, i64 count);
+static void ed_free_whole_page(ED_Buffer *buffer, ED_Page *page);
+static void ed_free_page_links(ED_Buffer *buffer, ED_Page *page);
+
+//- Snapshot functions
+
+static void               ed_buffer_wait_for_snapshots(ED_Buffer *buffer);
+static bool               ed_buffer_page_is_shared(ED_Buffer *buffer, ED_Page *page);
+static ED_Page           *ed_buffer_own_page(ED_Buffer *buffer, ED_Page *page, i64 first_line);
+static void               ed_buffer_set_next_page(ED_Buffer *buffer, ED_Page *page, ED_Page *next);
+static void               ed_buffer_prune_page_links(ED_Buffer *buffer, ED_Page *page);
+static void               ed_buffer_link_page(ED_Buffer *buffer, ED_Page *prev, ED_Page *page);
+static void               ed_buffer_unlink_page(ED_Buffer *buffer, ED_Page *page);
+static void               ed_buffer_discard_page(ED_Buffer *buffer, ED_Page *page);
+static void               ed_buffer_retire_page(ED_Buffer *buffer, ED_Page *page);
+static ED_Retired_Memory *ed_buffer_retire_memory(ED_Buffer *buffer);
+static void               ed_buffer_reset_arena(ED_Buffer *buffer);
+
+//- Main buffer modification functions
+
+static Point ed_buffer_replace_range(ED_Buffer *buffer, Text_Range range, String text);
+
+//- Buffer modification helper functions
+
+static ED_Page_I64 ed_page_insert_line(ED_Buffer *buffer, ED_Page *page, i64 index);
+static ED_Page *ed_page_split(ED_Buffer *buffer, ED_Page *page, i64 index);
+static void ed_page_remove_lines(ED_Buffer *buffer, ED_Page *page, i64 index, i64 count);
+static void ed_line_remove_range(ED_Buffer *buffer, ED_Line *line, i64 start, i64 end);
+static void ed_line_insert_text(ED_Buffer *buffer, ED_Line *line, i64 pos, String text);
+static void ed_free_line(ED_Buffer *buffer, ED_Line *line);
+static void ed_line_fill(ED_Buffer *buffer, ED_Line *line, String text);
+static ED_Span *ed_span_append_text_without_newlines(ED_Buffer *buffer, ED_Line *line, ED_Span *span, String text);
+static void ed_line_coalesce_spans(ED_Buffer *buffer, ED_Line *line, ED_Span *first, ED_Span *last);
+
+//- General helper functions
+
+static i64 ed_span_chain_count(ED_Span *first);
+static i64 ed_buffer_range_byte_count(ED_Buffer *buffer, Text_Range range);
+static String ed_string_from_line(Arena *arena, ED_Line *line);
+
+static bool ed_buffer_is_in_use(ED_Buffer *buffer);
+
+static ED_Span_I64 ed_relative_span_from_line_and_pos(ED_Line *line, i64 pos);
+static ED_Page_I64 ed_relative_from_page_and_line(ED_Buffer *buffer, ED_Page *page, i64 line);
+
+//- Line position functions
+
+static i64              ed_codepoint_columns(u32 codepoint);
+static UTF8_Decode      ed_line_decode_at(ED_Line_Position position);
+static ED_Line_Position ed_line_position_normalize(ED_Line_Position position);
+static bool             ed_line_position_is_end(ED_Line_Position position);
+static ED_Line_Position ed_line_next_position(ED_Line_Position position);
+static ED_Line_Position ed_line_prev_position(ED_Line_Position position);
+static ED_Line_Position ed_line_position_from_x(ED_Line *line, i64 x);
+static void             ed_buffer_cache_position(ED_Buffer *buffer, Point point, ED_Line_Position position);
+static ED_Line_Position ed_line_position_advance_to_x(ED_Line_Position position, i64 x);
+static ED_Line_Position ed_line_position_advance_to_column(ED_Line_Position position, i64 column);
+
+//- Line index functions
+
+static ED_Line_Index   *ed_buffer_line_index(ED_Buffer *buffer, i64 line_number);
+static void             ed_buffer_free_line_index(ED_Buffer *buffer, ED_Line_Index *index);
+static void             ed_buffer_line_indexes_edit(ED_Buffer *buffer, Point start, i64 removed_line_count, i64 added_line_count);
+static ED_Line_Position ed_buffer_line_checkpoint(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 x, i64 column);
+static ED_Line_Position ed_buffer_line_position_from_x(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 x);
+
+//- Load/save functions
+
+static void ed_init_buffer_source(ED_Buffer *buffer, SliceU8 source);
+static i64  ed_source_chunk_end(SliceU8 source, i64 start);
+static void ed_loader_proc(void *data);
+static void ed_stream_proc(void *data);
+static void ed_stream_release(ED_Stream *stream);
+static void ed_buffer_stop_streaming(ED_Buffer *buffer);
+static void ed_buffer_clear(ED_Buffer *buffer);
+static void ed_release_source_memory(SliceU8 source, bool is_mapped);
+static i64  ed_page_file_len(ED_Buffer *buffer, ED_Page *page);
+static bool ed_page_matches_text(ED_Buffer *buffer, ED_Page *page, SliceU8 text, i64 at);
+static void ed_buffer_append_text(ED_Buffer *buffer, String text);
+
+static ED_Line_Ending ed_detect_line_ending(SliceU8 contents);
+static i64            ed_strip_crlf(SliceU8 contents);
+
+//- Autosave functions
+
+static void ed_autosave_proc(void *data);
+static void ed_swap_writer_append(ED_Swap_Writer *writer, String text);
+static void ed_swap_writer_flush(ED_Swap_Writer *writer);
+
+//- Layout functions
+
+static String ed_render_string_from_stored_string(Arena *arena, String stored_string);
+static i64 ed_render_x_from_stored_x(String stored_string, i64 stored_x);
+
+//- Highlighting functions
+
+static ED_Language   ed_language_from_file_name(String file_name);
+static ED_Token_Kind ed_token_kind_from_word(String word);
+static void          ed_tokens_mark(ED_Line_Tokens *tokens, i64 x, ED_Token_Kind kind);
+static void          ed_buffer_highlight_edit(ED_Buffer *buffer, i64 first_line, i64 old_line_count, i64 new_line_count);
+static void          ed_buffer_highlight_forget(ED_Buffer *buffer, i64 line_number);
+static void          ed_buffer_highlight_store(ED_Buffer *buffer, ED_Line *line, i64 line_number, ED_Lex_State state);
+
+//- Editor debug functions
+
+static void ed_validate_page(ED_Buffer *buffer, ED_Page *page);
+static void ed_buffer_mark_touched(ED_Buffer *buffer, ED_Page *page, i64 line_count);
+static bool ed_text_point_exists(ED_Buffer *buffer, Point point);
+
+//- Editor elements allocation functions
+
+// Headers and their data come from the same pool block, so a span's bytes are right after
+// its links and a page's lines are right after the page.
+
+static ED_Page *
+ed_alloc_page(ED_Buffer *buffer) {
+	if (buffer->first_zombie_page && !pool_has_free_block(&buffer->pool, ED_PAGE_BLOCK_SIZE)) {
+		ed_buffer_reclaim_zombie_pages(buffer, 1);
+	}
+	
+	ED_Page *page = pool_alloc(&buffer->pool, ED_PAGE_BLOCK_SIZE);
+	
+	page->next  = NULL;
+	page->prev  = NULL;
+	page->lines = cast(ED_Line *) (page + 1);
+	page->line_count = 0;
+	page->source     = NULL;
+	page->source_len = 0;
+	page->epoch      = buffer->epoch;
+	page->link_epoch = buffer->epoch;
+	page->links      = NULL;
+	
+	buffer->page_count += 1;
+	
+	return page;
+}
+
+static void
+ed_free_page(ED_Buffer *buffer, ED_Page *page) {
+	// Don't leave the validation pointing at freed memory
+	if (buffer->touched_page == page) {
+		buffer->touched_page = NULL;
+	}
+	if (buffer->next_sample_page == page) {
+		buffer->next_sample_page = NULL;
+	}
+	
+	ed_free_page_links(buffer, page);
+	pool_free(&buffer->pool, page, page->lines ? ED_PAGE_BLOCK_SIZE : ED_SOURCE_PAGE_BLOCK_SIZE);
+	buffer->page_count -= 1;
+}
+
+static ED_Page *
+ed_alloc_source_page(ED_Buffer *buffer, u8 *source, i64 source_len, i64 line_count) {
+	ED_Page *page = pool_alloc(&buffer->pool, ED_SOURCE_PAGE_BLOCK_SIZE);
+	
+	page->next  = NULL;
+	page->prev  = NULL;
+	page->lines = NULL;
+	page->line_count = line_count;
+	page->source     = source;
+	page->source_len = source_len;
+	page->epoch      = buffer->epoch;
+	page->link_epoch = buffer->epoch;
+	page->links      = NULL;
+	
+	buffer->page_count += 1;
+	buffer->source_byte_count += source_len;
+	
+	return page;
+}
+
+ed_function ED_Page *
+ed_buffer_materialize_page(ED_Buffer *buffer, ED_Page *source_page) {
+	// Replaces a source page with regular pages holding its lines, and returns the first one.
+	// Each of them remembers its part of the source, until it is edited.
+	assert(!source_page->lines); // Validate args
+	
+	trace_begin("materialize");
+	
+	u8 *at  = source_page->source;
+	u8 *end = source_page->source + source_page->source_len;
+	
+	ED_Page *first = NULL;
+	ED_Page *page  = source_page;
+	
+	for (i64 line_index = 0; line_index < source_page->line_count; line_index += 1) {
+		if (!first || page->line_count == ED_PAGE_SIZE) {
+			if (first) {
+				page->source_len = at - page->source;
+			}
+			
+			ED_Page *new_page = ed_alloc_page(buffer);
+			ed_buffer_link_page(buffer, page, new_page);
+			new_page->source = at;
+			
+			page  = new_page;
+			first = first ? first : new_page;
+		}
+		
+		// The line break after every line but the last one of the file (CRLF files lose the CRs)
+		u8 *line_break = memchr(at, '\n', end - at);
+		u8 *line_end   = line_break ? line_break : end;
+		u8 *next       = line_break ? line_break + 1 : end;
+		if (line_break && buffer->line_ending == ED_Line_Ending_CRLF && line_end > at && line_end[-1] == '\r') {
+			line_end -= 1;
+		}
+		
+		ED_Line *line = &page->lines[page->line_count];
+		page->line_count += 1;
+		ed_line_fill(buffer, line, string(at, line_end - at));
+		
+		at = next;
+	}
+	
+	assert(at == end); // The line count didn't match the source
+	page->source_len = at - page->source;
+	
+	ed_buffer_unlink_page(buffer, source_page);
+	ed_buffer_discard_page(buffer, source_page);
+	
+	trace_end("materialize");
+	
+	return first;
+}
+
+ed_function void
+ed_buffer_evict_cold_pages(ED_Buffer *buffer, i64 first_line, i64 line_count) {
+	// Evicts the pages more than ED_SOURCE_KEEP_LINE_COUNT lines away from the given ones
+	ed_buffer_evict_pages_outside(buffer, first_line - ED_SOURCE_KEEP_LINE_COUNT,
+								  first_line + line_count + ED_SOURCE_KEEP_LINE_COUNT);
+}
+
+static void
+ed_buffer_evict_pages_outside(ED_Buffer *buffer, i64 keep_start, i64 keep_end) {
+	// Turns the unedited pages that aren't in [keep_start, keep_end) back into source pages,
+	// merged with the source pages before them while they stay under ED_SOURCE_CHUNK_SIZE.
+	if (buffer->source.data) {
+		bool evicted = false;
+		i64 line_number = 0;
+		
+		ED_Page *page = buffer->first_page;
+		while (page) {
+			ED_Page *next = page->next;
+			i64 page_line_count = page->line_count;
+			
+			bool cold = (page->source && (line_number + page_line_count <= keep_start || line_number >= keep_end));
+			
+			if (cold && page->lines) {
+				ed_buffer_highlight_forget(buffer, line_number);
+				
+				ED_Page *source_page = ed_alloc_source_page(buffer, page->source, page->source_len, page->line_count);
+				ed_buffer_link_page(buffer, page, source_page);
+				ed_buffer_unlink_page(buffer, page);
+				ed_buffer_discard_page(buffer, page);
+				
+				page = source_page;
+				evicted = true;
+			}
+			
+			// The page before grows, so it can't be one that a snapshot sees. The merged page's
+			// bytes are counted twice until it goes.
+			ED_Page *prev = page->prev;
+			if (cold && prev && !prev->lines && !ed_buffer_page_is_shared(buffer, prev) &&
+				prev->source + prev->source_len == page->source &&
+				prev->source_len + page->source_len <= ED_SOURCE_CHUNK_SIZE) {
+				prev->source_len += page->source_len;
+				prev->line_count += page->line_count;
+				prev->epoch = buffer->epoch;
+				buffer->source_byte_count += page->source_len;
+				
+				ed_buffer_unlink_page(buffer, page);
+				ed_buffer_discard_page(buffer, page);
+			}
+			
+			line_number += page_line_count;
+			page = next;
+		}
+		
+		if (evicted) {
+			// The line indexes and the cached position may point to the spans that went away
+			for (i64 i = 0; i < ED_LINE_INDEX_COUNT; i += 1) {
+				ed_buffer_free_line_index(buffer, &buffer->line_indexes[i]);
+			}
+			buffer->edit_count += 1;
+		}
+	}
+}
+
+static ED_Span *
+ed_alloc_span(ED_Buffer *buffer) {
+	if (buffer->first_zombie_page && !pool_has_free_block(&buffer->pool, ED_SPAN_BLOCK_SIZE)) {
+		ed_buffer_reclaim_zombie_pages(buffer, 1);
+	}
+	
+	// No need to clear the data, len says how much of it is valid
+	ED_Span *span = pool_alloc(&buffer->pool, ED_SPAN_BLOCK_SIZE);
+	
+	span->next = NULL;
+	span->prev = NULL;
+	span->data = cast(u8 *) (span + 1);
+	span->len  = 0;
+	
+	buffer->span_count += 1;
+	
+	return span;
+}
+
+static void
+ed_free_span(ED_Buffer *buffer, ED_Span *span) {
+	pool_free(&buffer->pool, span, ED_SPAN_BLOCK_SIZE);
+	buffer->span_count -= 1;
+}
+
+static void
+ed_free_span_chain(ED_Buffer *buffer, ED_Span *first, ED_Span *last, i64 count) {
+	// Spans are already linked through their first field, so the whole chain
+	// goes back to the pool without touching the nodes in between.
+	pool_free_chain(&buffer->pool, first, last, ED_SPAN_BLOCK_SIZE);
+	buffer->span_count -= count;
+}
+
+static void
+ed_zombify_pages(ED_Buffer *buffer, ED_Page *first, ED_Page *last, i64 count) {
+	// Unlinks the pages from 'first' to 'last' and puts the whole chain on the zombie list,
+	// lines and all: freeing them is ed_buffer_reclaim_zombie_pages's job.
+	if (first->prev) {
+		ed_buffer_set_next_page(buffer, first->prev, last->next);
+	} else {
+		buffer->first_page = last->next;
+	}
+	if (last->next) {
+		last->next->prev = first->prev;
+	} else {
+		buffer->last_page = first->prev;
+	}
+	
+	ed_buffer_set_next_page(buffer, last, buffer->first_zombie_page);
+	buffer->first_zombie_page = first;
+	buffer->zombie_page_count += count;
+	
+	// Finding out whether the sampled pass was in the chain would mean walking it.
+	// The touched page is where the deletion starts, which stays.
+	buffer->next_sample_page = NULL;
+}
+
+ed_function void
+ed_buffer_reclaim_zombie_pages(ED_Buffer *buffer, i64 max_page_count) {
+	// Not while a snapshot is alive: it may still see them
+	if (buffer->snapshot_count == 0) {
+		for (i64 i = 0; i < max_page_count && buffer->first_zombie_page; i += 1) {
+			ED_Page *page = buffer->first_zombie_page;
+			buffer->first_zombie_page = page->next;
+			buffer->zombie_page_count -= 1;
+			
+			ed_free_whole_page(buffer, page);
+		}
+	}
+}
+
+static void
+ed_free_whole_page(ED_Buffer *buffer, ED_Page *page) {
+	// Gives back the page with the spans of all its lines, or its part of the source, and takes
+	// it out of the counts
+	
+	// Join the span chains of all the lines and give them back in one go
+	ED_Span *first = NULL;
+	ED_Span *last  = NULL;
+	i64 span_count = 0;
+	i64 byte_count = 0;
+	
+	for (i64 line_index = 0; page->lines && line_index < page->line_count; line_index += 1) {
+		ED_Line *line = &page->lines[line_index];
+		for (ED_Span *span = line->first_span; span; span = span->next) {
+			span_count += 1;
+			byte_count += span->len;
+		}
+		
+		if (line->first_span) {
+			if (last) {
+				last->next = line->first_span;
+			} else {
+				first = line->first_span;
+			}
+			last = line->last_span;
+		}
+	}
+	
+	if (first) {
+		ed_free_span_chain(buffer, first, last, span_count);
+	}
+	buffer->byte_count -= byte_count;
+	
+	if (!page->lines) {
+		buffer->source_byte_count -= page->source_len;
+	}
+	ed_free_page(buffer, page);
+}
+
+static void
+ed_free_page_links(ED_Buffer *buffer, ED_Page *page) {
+	if (page->links) {
+		ED_Page_Link *last = page->links;
+		while (last->older) {
+			last = last->older;
+		}
+		pool_free_chain(&buffer->pool, page->links, last, sizeof(ED_Page_Link));
+		page->links = NULL;
+	}
+}
+
+//- Snapshot functions
+
+// A snapshot is only the first page and the epoch it was taken in: taking one doesn't copy
+// anything. Afterwards, the pages it can see are copied before an edit changes their lines,
+// a link it could follow is kept on the page before it is changed, and the pages and memory
+// that go out of the buffer are retired instead of freed, until the snapshots that can see
+// them are released. Snapshots only follow 'next', never 'prev'.
+
+ed_function ED_Snapshot *
+ed_buffer_take_snapshot(ED_Buffer *buffer) {
+	// Returns NULL if ED_SNAPSHOT_COUNT snapshots are already alive. Freeing what the released
+	// ones held is left to ed_buffer_collect_snapshots.
+	ED_Snapshot *result = NULL;
+	for (i64 i = 0; i < ED_SNAPSHOT_COUNT && !result; i += 1) {
+		if (!atomic_load_u64(&buffer->snapshots[i].is_alive)) {
+			result = &buffer->snapshots[i];
+		}
+	}
+	
+	if (result) {
+		result->should_stop = 0;
+		result->epoch       = buffer->epoch;
+		result->first_page  = buffer->first_page;
+		result->line_count  = buffer->line_count;
+		result->line_ending = buffer->line_ending;
+		result->file_name   = buffer->file_name;
+		result->source      = buffer->source;
+		atomic_store_u64(&result->is_alive, 1);
+		
+		if (buffer->snapshot_count == 0) {
+			buffer->oldest_snapshot_epoch = buffer->epoch;
+		}
+		buffer->snapshot_epoch = buffer->epoch;
+		buffer->snapshot_count += 1;
+		buffer->epoch += 1;
+	}
+	
+	return result;
+}
+
+ed_function void
+ed_snapshot_release(ED_Snapshot *snapshot) {
+	// From any thread, once nothing reads from the snapshot anymore
+	atomic_store_u64(&snapshot->is_alive, 0);
+}
+
+ed_function ED_Page *
+ed_snapshot_next_page(ED_Snapshot *snapshot, ED_Page *page) {
+	// The page that came after 'page' (or the first page, for NULL) when the snapshot was taken.
+	// 'next' is read before the old links: a link is kept before 'next' changes.
+	ED_Page *result = snapshot->first_page;
+	
+	if (page) {
+		result = atomic_load_ptr(&page->next);
+		
+		ED_Page_Link *link = atomic_load_ptr(&page->links);
+		while (link && snapshot->epoch < link->until_epoch) {
+			result = link->next;
+			link = link->older;
+		}
+	}
+	
+	return result;
+}
+
+ed_function void
+ed_buffer_collect_snapshots(ED_Buffer *buffer) {
+	// Notices the snapshots released since the last call, and frees what only they could see
+	i64 snapshot_count = 0;
+	u64 oldest_epoch   = buffer->epoch;
+	
+	for (i64 i = 0; i < ED_SNAPSHOT_COUNT; i += 1) {
+		ED_Snapshot *snapshot = &buffer->snapshots[i];
+		if (atomic_load_u64(&snapshot->is_alive)) {
+			snapshot_count += 1;
+			oldest_epoch = min(oldest_epoch, snapshot->epoch);
+		}
+	}
+	
+	buffer->snapshot_count = snapshot_count;
+	buffer->oldest_snapshot_epoch = oldest_epoch;
+	
+	// Retired in the epoch they went out in, which no snapshot taken before it is older than
+	while (buffer->first_retired_page && buffer->first_retired_page->epoch <= oldest_epoch) {
+		ED_Retired_Page *retired = buffer->first_retired_page;
+		queue_pop(buffer->first_retired_page, buffer->last_retired_page);
+		
+		ed_free_whole_page(buffer, retired->page);
+		pool_free(&buffer->pool, retired, sizeof(ED_Retired_Page));
+	}
+	
+	while (buffer->first_retired_memory && buffer->first_retired_memory->epoch <= oldest_epoch) {
+		ED_Retired_Memory *retired = buffer->first_retired_memory;
+		queue_pop(buffer->first_retired_memory, buffer->last_retired_memory);
+		
+		if (retired->arena.ptr) {
+			arena_fini(&retired->arena);
+		}
+		if (retired->source.data) {
+			ed_release_source_memory(retired->source, retired->source_is_mapped);
+		}
+		mem_release(retired, sizeof(ED_Retired_Memory));
+	}
+}
+
+static void
+ed_buffer_wait_for_snapshots(ED_Buffer *buffer) {
+	// For the few changes that can't leave the snapshots alone. Asks them to stop first.
+	for (i64 i = 0; i < ED_SNAPSHOT_COUNT; i += 1) {
+		atomic_store_u64(&buffer->snapshots[i].should_stop, 1);
+	}
+	
+	ed_buffer_collect_snapshots(buffer);
+	while (buffer->snapshot_count > 0) {
+		sleep_ms(1);
+		ed_buffer_collect_snapshots(buffer);
+	}
+}
+
+static bool
+ed_buffer_page_is_shared(ED_Buffer *buffer, ED_Page *page) {
+	// Whether a snapshot alive may see the page's lines as they are
+	return buffer->snapshot_count > 0 && page->epoch <= buffer->snapshot_epoch;
+}
+
+static ED_Page *
+ed_buffer_own_page(ED_Buffer *buffer, ED_Page *page, i64 first_line) {
+	// Every edit goes through here before changing the lines of a page (whose first line is
+	// 'first_line'), and uses the page returned. A page that a snapshot can see is replaced by
+	// a copy, spans and all, and retired; any other one is changed in place.
+	assert(page->lines); // Validate args
+	
+	if (buffer->snapshot_count > 0) {
+		ed_buffer_collect_snapshots(buffer);
+	}
+	
+	ED_Page *result = page;
+	
+	if (ed_buffer_page_is_shared(buffer, page)) {
+		result = ed_alloc_page(buffer);
+		result->line_count = page->line_count;
+		result->source     = page->source;
+		result->source_len = page->source_len;
+		
+		for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+			ED_Line *src_line  = &page->lines[line_index];
+			ED_Line *dest_line = &result->lines[line_index];
+			dest_line->first_span = NULL;
+			dest_line->last_span  = NULL;
+			dest_line->lex_state  = src_line->lex_state;
+			
+			// Span for span, as they were
+			for (ED_Span *src_span = src_line->first_span; src_span; src_span = src_span->next) {
+				ED_Span *dest_span = ed_alloc_span(buffer);
+				dll_push_back(dest_line->first_span, dest_line->last_span, dest_span);
+				memcpy(dest_span->data, src_span->data, src_span->len);
+				dest_span->len = src_span->len;
+				buffer->byte_count += src_span->len;
+			}
+		}
+		
+		ed_buffer_link_page(buffer, page, result);
+		ed_buffer_unlink_page(buffer, page);
+		ed_buffer_retire_page(buffer, page);
+		
+		// The line indexes and the cached position may point to the old spans
+		for (i64 i = 0; i < ED_LINE_INDEX_COUNT; i += 1) {
+			ED_Line_Index *index = &buffer->line_indexes[i];
+			if (index->line_number >= first_line && index->line_number < first_line + page->line_count) {
+				ed_buffer_free_line_index(buffer, index);
+			}
+		}
+		buffer->edit_count += 1;
+	} else {
+		page->epoch = buffer->epoch;
+	}
+	
+	return result;
+}
+
+static void
+ed_buffer_set_next_page(ED_Buffer *buffer, ED_Page *page, ED_Page *next) {
+	// Changes the link of a page in the buffer. If a snapshot can follow the old one, it is
+	// kept first.
+	if (page->links) {
+		ed_buffer_prune_page_links(buffer, page);
+	}
+	
+	if (buffer->snapshot_count > 0 && page->link_epoch <= buffer->snapshot_epoch) {
+		ED_Page_Link *link = pool_alloc(&buffer->pool, sizeof(ED_Page_Link));
+		link->older       = page->links;
+		link->until_epoch = buffer->epoch;
+		link->next        = page->next;
+		atomic_store_ptr(&page->links, link);
+	}
+	
+	page->link_epoch = buffer->epoch;
+	atomic_store_ptr(&page->next, next);
+}
+
+static void
+ed_buffer_prune_page_links(ED_Buffer *buffer, ED_Page *page) {
+	// Frees the old links that no snapshot alive follows anymore. The newest of those stays if
+	// there are snapshots: they look at it to know where to stop.
+	if (buffer->snapshot_count == 0) {
+		ed_free_page_links(buffer, page);
+	} else {
+		ED_Page_Link *link = page->links;
+		while (link && link->until_epoch > buffer->oldest_snapshot_epoch) {
+			link = link->older;
+		}
+		
+		if (link && link->older) {
+			ED_Page_Link *first = link->older;
+			ED_Page_Link *last  = first;
+			while (last->older) {
+				last = last->older;
+			}
+			
+			link->older = NULL;
+			pool_free_chain(&buffer->pool, first, last, sizeof(ED_Page_Link));
+		}
+	}
+}
+
+static void
+ed_buffer_link_page(ED_Buffer *buffer, ED_Page *prev, ED_Page *page) {
+	// Like dll_insert, for a new page: after 'prev', or first if it is NULL
+	ED_Page *next = prev ? prev->next : buffer->first_page;
+	
+	page->prev = prev;
+	ed_buffer_set_next_page(buffer, page, next);
+	
+	if (prev) {
+		ed_buffer_set_next_page(buffer, prev, page);
+	} else {
+		buffer->first_page = page;
+	}
+	if (next) {
+		next->prev = page;
+	} else {
+		buffer->last_page = page;
+	}
+}
+
+static void
+ed_buffer_unlink_page(ED_Buffer *buffer, ED_Page *page) {
+	// Like dll_remove. The page keeps its own links, snapshots may still go through it.
+	if (page->prev) {
+		ed_buffer_set_next_page(buffer, page->prev, page->next);
+	} else {
+		buffer->first_page = page->next;
+	}
+	if (page->next) {
+		page->next->prev = page->prev;
+	} else {
+		buffer->last_page = page->prev;
+	}
+}
+
+static void
+ed_buffer_discard_page(ED_Buffer *buffer, ED_Page *page) {
+	// Frees a page that was unlinked, or retires it if a snapshot can see it
+	if (ed_buffer_page_is_shared(buffer, page)) {
+		ed_buffer_retire_page(buffer, page);
+	} else {
+		ed_free_whole_page(buffer, page);
+	}
+}
+
+static void
+ed_buffer_retire_page(ED_Buffer *buffer, ED_Page *page) {
+	// Don't leave the validation pointing at it, it isn't in the buffer anymore
+	if (buffer->touched_page == page) {
+		buffer->touched_page = NULL;
+	}
+	if (buffer->next_sample_page == page) {
+		buffer->next_sample_page = NULL;
+	}
+	
+	ED_Retired_Page *retired = pool_alloc(&buffer->pool, sizeof(ED_Retired_Page));
+	retired->next  = NULL;
+	retired->page  = page;
+	retired->epoch = buffer->epoch;
+	queue_push(buffer->first_retired_page, buffer->last_retired_page, retired);
+}
+
+static ED_Retired_Memory *
+ed_buffer_retire_memory(ED_Buffer *buffer) {
+	// The caller fills in what goes
+	ED_Retired_Memory *retired = mem_reserve_and_commit(sizeof(ED_Retired_Memory));
+	assert(retired);
+	retired->epoch = buffer->epoch;
+	queue_push(buffer->first_retired_memory, buffer->last_retired_memory, retired);
+	
+	return retired;
+}
+
+static void
+ed_buffer_reset_arena(ED_Buffer *buffer) {
+	// Makes room for new contents. While snapshots are alive, the old arena goes aside with
+	// everything in it (the retired pages included) until they are released.
+	ed_buffer_collect_snapshots(buffer);
+	
+	if (!buffer->arena.ptr) {
+		arena_init_flags(&buffer->arena, DEFAULT_ARENA_RESERVE_SIZE, ED_BUFFER_ARENA_FLAGS);
+	} else if (buffer->snapshot_count > 0) {
+		ED_Retired_Memory *retired = ed_buffer_retire_memory(buffer);
+		retired->arena = buffer->arena;
+		arena_init_flags(&buffer->arena, retired->arena.cap, retired->arena.flags);
+	} else {
+		arena_reset(&buffer->arena);
+	}
+	
+	buffer->first_retired_page = NULL;
+	buffer->last_retired_page  = NULL;
+}
+
+//- Main buffer modification functions
+
+ed_function void
+ed_buffer_remove_range(ED_Buffer *buffer, Text_Range range) {
+	// Validate arguments (the points are checked below, once their lines have been found:
+	// checking them here would mean walking the pages twice more)
+	assert(!text_point_less_than(range.end, range.start));
+	assert(range.start.y >= 0 && range.end.y < buffer->line_count);
+	
+	ED_Page *start_page = NULL;
+	ED_Line *start_line = NULL;
+	i64 start_line_in_page = 0;
+	
+	{
+		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.start.y);
+		start_page = ed_buffer_own_page(buffer, rel.page, range.start.y - rel.i);
+		start_line = &start_page->lines[rel.i];
+		start_line_in_page = rel.i;
+	}
+	
+	assert(range.start.x >= 0 && range.start.x <= ed_line_len(start_line));
+	
+	ed_buffer_mark_touched(buffer, start_page, start_line_in_page + 1);
+	ed_buffer_line_indexes_edit(buffer, range.start, range.end.y - range.start.y, 0);
+	ed_buffer_highlight_edit(buffer, range.start.y, range.end.y - range.start.y + 1, 1);
+	buffer->edit_count += 1;
+	
+	if (range.start.y == range.end.y) {
+		assert(range.end.x <= ed_line_len(start_line));
+		
+		ed_line_remove_range(buffer, start_line, range.start.x, range.end.x);
+		buffer->byte_count -= range.end.x - range.start.x;
+	} else {
+		// The bytes are subtracted as they go: the ones cut from the start and end lines here,
+		// the ones in the lines in between when those lines are freed
+		// Walk from the start line, not from the start of the buffer. The end line's spans are
+		// moved and cut too, so its page is owned like the start one.
+		ED_Page_I64 end_rel = ed_relative_from_page_and_line(buffer, start_page, start_line_in_page + range.end.y - range.start.y);
+		ED_Page *end_page = ed_buffer_own_page(buffer, end_rel.page, range.end.y - end_rel.i);
+		ED_Line *end_line = &end_page->lines[end_rel.i];
+		
+		assert(range.end.x >= 0 && range.end.x <= ed_line_len(end_line));
+		
+		// 1: Cut the start line at the start of the range
+		ED_Span *start_span = NULL;
+		{
+			ED_Span_I64 rel = ed_relative_span_from_line_and_pos(start_line, range.start.x);
+			start_span = rel.span;
+			buffer->byte_count -= ed_line_len(start_line) - range.start.x;
+			start_span->len = rel.i;
+			
+			if (start_span->next) {
+				ed_free_span_chain(buffer, start_span->next, start_line->last_span, ed_span_chain_count(start_span->next));
+				start_span->next = NULL;
+				start_line->last_span = start_span;
+			}
+		}
+		
+		// 2: Move what comes after the end of the range to the start line
+		{
+			ED_Span_I64 rel = ed_relative_span_from_line_and_pos(end_line, range.end.x);
+			ED_Span *tail_first = rel.span;
+			ED_Span *tail_last  = end_line->last_span;
+			
+			memmove(tail_first->data, tail_first->data + rel.i, tail_first->len - rel.i);
+			tail_first->len -= rel.i;
+			buffer->byte_count -= rel.i;
+			
+			if (tail_first->prev) {
+				end_line->last_span = tail_first->prev;
+				end_line->last_span->next = NULL;
+			} else {
+				end_line->first_span = NULL;
+				end_line->last_span  = NULL;
+			}
+			
+			start_span->next = tail_first;
+			tail_first->prev = start_span;
+			start_line->last_span = tail_last;
+			
+			ed_line_coalesce_spans(buffer, start_line, start_span, tail_first);
+		}
+		
+		// 3: Remove all the lines after the start line, up to the end line
+		ed_page_remove_lines(buffer, start_page, start_line_in_page + 1, range.end.y - range.start.y);
+	}
+	
+	return;
+}
+
+ed_function Point
+ed_buffer_insert_text_at_point(ED_Buffer *buffer, Point point, String text) {
+	
+	// Get all the variables
+	ED_Page *page = NULL;
+	ED_Line *line = NULL;
+	ED_Span *span = NULL;
+	i64 line_in_page = 0;
+	i64 at_in_span = 0;
+	
+	{
+		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, point.y);
+		page = ed_buffer_own_page(buffer, rel.page, point.y - rel.i);
+		line = &page->lines[rel.i];
+		line_in_page = rel.i;
+	}
+	
+	{
+		ED_Span_I64 rel = ed_relative_span_from_line_and_pos(line, point.x);
+		span = rel.span;
+		at_in_span = rel.i;
+	}
+	
+	i64 newline_count = string_count_occurrences(text, '\n');
+	buffer->byte_count += text.len - newline_count; // Newlines aren't stored
+	
+	ed_buffer_mark_touched(buffer, page, line_in_page + 1 + newline_count);
+	ed_buffer_line_indexes_edit(buffer, point, 0, newline_count);
+	ed_buffer_highlight_edit(buffer, point.y, 1, 1 + newline_count);
+	buffer->edit_count += 1;
+	
+	// When the new lines don't fit in this page, split it once after the cursor's line and
+	// fill new pages after it, instead of inserting (and moving) the lines one at a time.
+	bool splice = newline_count > ED_PAGE_SIZE - page->line_count;
+	if (splice) {
+		ed_page_split(buffer, page, line_in_page + 1);
+	}
+	
+	// Create a backup of what comes after the cursor in this span, and detach the spans
+	// after it: all of that goes at the end of the last inserted line
+	Scratch scratch = scratch_begin(0, 0);
+	
+	i64 after_in_span = span->len - at_in_span;
+	String temp = string_clone(scratch.arena, string(span->data + at_in_span, after_in_span));
+	
+	ED_Span *tail_first = span->next;
+	ED_Span *tail_last  = line->last_span;
+	if (tail_first) {
+		span->next = NULL;
+		line->last_span = span;
+	}
+	
+	// Pretend the span has more space (truncate at the cursor)
+	span->len = at_in_span;
+	
+	ED_Span *first_touched_span = span; // In the current line
+	
+	// Append the text, overwriting the current span and potentially creating new ones;
+	// At every newline, insert a new line after the current one
+	i64 len_after_last_newline = text.len;
+	
+	while (text.len > 0) {
+		bool has_newline = true;
+		i64 split_index = string_find_first(text, '\n');
+		if (split_index < 0) {
+			split_index = text.len;
+			has_newline = false;
+		}
+		
+		String chunk = string_stop(text, split_index);
+		text = string_skip(text, split_index + 1);
+		
+		span = ed_span_append_text_without_newlines(buffer, line, span, chunk);
+		
+		if (has_newline) {
+			len_after_last_newline = text.len;
+			
+			ed_line_coalesce_spans(buffer, line, first_touched_span, span);
+			
+			if (splice) {
+				// Lines are only ever appended here, the page was split
+				if (page->line_count == ED_PAGE_SIZE) {
+					ED_Page *new_page = ed_alloc_page(buffer);
+					ed_buffer_link_page(buffer, page, new_page);
+					page = new_page;
+				}
+				
+				line_in_page = page->line_count;
+				page->line_count += 1;
+				buffer->line_count += 1;
+			} else {
+				ED_Page_I64 rel = ed_page_insert_line(buffer, page, line_in_page + 1);
+				page = rel.page;
+				line_in_page = rel.i;
+			}
+			line = &page->lines[line_in_page];
+			
+			span = ed_alloc_span(buffer);
+			line->first_span = span;
+			line->last_span  = span;
+			first_touched_span = span;
+		}
+	}
+	
+	// Copy the backup back into the line, followed by the spans we detached
+	span = ed_span_append_text_without_newlines(buffer, line, span, temp);
+	scratch_end(scratch);
+	
+	if (tail_first) {
+		span->next = tail_first;
+		tail_first->prev = span;
+		line->last_span = tail_last;
+	}
+	
+	ed_line_coalesce_spans(buffer, line, first_touched_span, tail_first ? tail_first : span);
+	
+	if (newline_count > 0) {
+		point.x = 0;
+	}
+	
+	Point new_cursor = {
+		.x = point.x + cast(i32) len_after_last_newline,
+		.y = point.y + cast(i32) newline_count,
+	};
+	
+	assert(ed_text_point_exists(buffer, new_cursor)); // Otherwise the logic is wrong
+	
+	return new_cursor;
+}
+
+static Point
+ed_buffer_replace_range(ED_Buffer *buffer, Text_Range range, String text) {
+	// Validate arguments
+	assert(!text_point_less_than(range.end, range.start));
+	
+	Point result = range.start;
+	
+	bool range_is_empty = (range.start.x == range.end.x && range.start.y == range.end.y);
+	
+	if (range_is_empty && text.len == 0) {
+		// Nothing to do (cursor movement)
+	} else if (text.len == 0) {
+		ed_buffer_remove_range(buffer, range);
+	} else if (range.start.y != range.end.y || string_find_first(text, '\n') >= 0) {
+		// Lines are added or removed, so do the two steps separately
+		if (!range_is_empty) {
+			ed_buffer_remove_range(buffer, range);
+		}
+		result = ed_buffer_insert_text_at_point(buffer, range.start, text);
+	} else {
+		// Everything happens inside a single line, find it only once
+		assert(ed_text_point_exists(buffer, range.start));
+		assert(ed_text_point_exists(buffer, range.end));
+		
+		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.start.y);
+		rel.page = ed_buffer_own_page(buffer, rel.page, range.start.y - rel.i);
+		ED_Line *line = &rel.page->lines[rel.i];
+		
+		ed_buffer_mark_touched(buffer, rel.page, rel.i + 1);
+		ed_buffer_line_indexes_edit(buffer, range.start, 0, 0);
+		ed_buffer_highlight_edit(buffer, range.start.y, 1, 1);
+		buffer->edit_count += 1;
+		
+		i64 removed_len   = range.end.x - range.start.x;
+		i64 overwrite_len = min(removed_len, text.len);
+		
+		// 1: Overwrite the bytes that the range and the text have in common
+		if (overwrite_len > 0) {
+			ED_Span_I64 at = ed_relative_span_from_line_and_pos(line, range.start.x);
+			ED_Span *span = at.span;
+			i64 in_span = at.i;
+			
+			i64 written = 0;
+			while (written < overwrite_len) {
+				if (in_span == span->len) {
+					span = span->next;
+					in_span = 0;
+				} else {
+					i64 to_copy_now = min(span->len - in_span, overwrite_len - written);
+					memcpy(span->data + in_span, text.data + written, to_copy_now);
+					in_span += to_copy_now;
+					written += to_copy_now;
+				}
+			}
+		}
+		
+		// 2: Remove what is left of the range, or insert what is left of the text
+		if (removed_len > overwrite_len) {
+			ed_line_remove_range(buffer, line, range.start.x + overwrite_len, range.end.x);
+		} else if (text.len > overwrite_len) {
+			ed_line_insert_text(buffer, line, range.start.x + overwrite_len, string_skip(text, overwrite_len));
+		}
+		
+		buffer->byte_count += text.len - removed_len;
+		result.x += cast(i32) text.len;
+		
+		assert(ed_text_point_exists(buffer, result)); // Otherwise the logic is wrong
+	}
+	
+	return result;
+}
+
+//- Buffer modification helper functions
+
+static ED_Page_I64
+ed_page_insert_line(ED_Buffer *buffer, ED_Page *page, i64 index) {
+	// Makes room for a line at 'index' (which can be page->line_count, to append),
+	// splitting the page in two if it is full. The new line isn't initialized.
+	assert(index >= 0 && index <= page->line_count); // Validate args
+	
+	if (page->line_count == ED_PAGE_SIZE) {
+		ED_Page *new_page = ed_alloc_page(buffer);
+		ed_buffer_link_page(buffer, page, new_page);
+		
+		if (index == page->line_count) {
+			// Appending: start the new page instead of moving lines around
+			page  = new_page;
+			index = 0;
+		} else {
+			// Keep the first half and move the second half to the new page. Both halves
+			// have room for one more line, even with ED_PAGE_SIZE == 1.
+			i64 keep = ED_PAGE_SIZE / 2;
+			i64 move = page->line_count - keep;
+			memcpy(new_page->lines, page->lines + keep, move * sizeof(ED_Line));
+			new_page->line_count = move;
+			page->line_count = keep;
+			
+			if (index > keep) {
+				page   = new_page;
+				index -= keep;
+			}
+		}
+	}
+	
+	memmove(page->lines + index + 1, page->lines + index, (page->line_count - index) * sizeof(ED_Line));
+	page->line_count += 1;
+	buffer->line_count += 1;
+	
+	ED_Page_I64 result = {page, index};
+	return result;
+}
+
+static ED_Page *
+ed_page_split(ED_Buffer *buffer, ED_Page *page, i64 index) {
+	// Moves the lines from 'index' on to a new page right after this one. Returns the new
+	// page, or NULL if there was nothing to move.
+	assert(index >= 0 && index <= page->line_count); // Validate args
+	
+	ED_Page *new_page = NULL;
+	
+	if (index < page->line_count) {
+		new_page = ed_alloc_page(buffer);
+		ed_buffer_link_page(buffer, page, new_page);
+		
+		i64 move = page->line_count - index;
+		memcpy(new_page->lines, page->lines + index, move * sizeof(ED_Line));
+		new_page->line_count = move;
+		page->line_count = index;
+	}
+	
+	return new_page;
+}
+
+static void
+ed_page_remove_lines(ED_Buffer *buffer, ED_Page *page, i64 index, i64 count) {
+	// Removes 'count' lines starting at 'index', continuing on the next pages if needed.
+	// Pages that lose all their lines are unlinked together and become zombies, so removing
+	// a large range costs a few operations per page instead of freeing every line.
+	while (count > 0) {
+		if (index == page->line_count) {
+			page  = page->next;
+			index = 0;
+		}
+		
+		if (index == 0 && count >= page->line_count) {
+			// Find the run of pages that go as a whole and unlink it in one go. The page
+			// before it is never removed: the start of the range is in a page before this one
+			ED_Page *first = page;
+			ED_Page *last  = page;
+			i64 run_page_count = 0;
+			
+			while (page && count >= page->line_count) {
+				count -= page->line_count;
+				buffer->line_count -= page->line_count;
+				run_page_count += 1;
+				
+				last = page;
+				page = page->next;
+			}
+			
+			ed_zombify_pages(buffer, first, last, run_page_count);
+		} else {
+			// Some lines stay, so the page does too (the end of the range is in a regular page:
+			// finding it materialized it)
+			assert(page->lines);
+			page->source = NULL;
+			
+			i64 to_remove_now = min(count, page->line_count - index);
+			for (i64 i = 0; i < to_remove_now; i += 1) {
+				ed_free_line(buffer, &page->lines[index + i]);
+			}
+			
+			memmove(page->lines + index, page->lines + index + to_remove_now,
+					(page->line_count - index - to_remove_now) * sizeof(ED_Line));
+			page->line_count -= to_remove_now;
+			buffer->line_count -= to_remove_now;
+			count -= to_remove_now;
+		}
+	}
+}
+
+static void
+ed_line_remove_range(ED_Buffer *buffer, ED_Line *line, i64 start, i64 end) {
+	assert(start <= end); // Validate args
+	
+	ED_Span_I64 start_rel = ed_relative_span_from_line_and_pos(line, start);
+	ED_Span_I64 end_rel   = ed_relative_span_from_line_and_pos(line, end);
+	
+	ED_Span *start_span = start_rel.span;
+	ED_Span *end_span   = end_rel.span;
+	
+	if (start_span == end_span) {
+		memmove(start_span->data + start_rel.i, end_span->data + end_rel.i, end_span->len - end_rel.i);
+		start_span->len -= end_rel.i - start_rel.i;
+	} else {
+		// Remove spans in between
+		while (start_span->next != end_span) {
+			ED_Span *span_to_free = start_span->next;
+			
+			dll_remove(line->first_span, line->last_span, span_to_free);
+			ed_free_span(buffer, span_to_free);
+		}
+		
+		start_span->len = start_rel.i;
+		
+		memmove(end_span->data, end_span->data + end_rel.i, end_span->len - end_rel.i);
+		end_span->len -= end_rel.i;
+	}
+	
+	ed_line_coalesce_spans(buffer, line, start_span, end_span);
+}
+
+static void
+ed_line_insert_text(ED_Buffer *buffer, ED_Line *line, i64 pos, String text) {
+	assert(string_find_first(text, '\n') < 0); // Validate args
+	
+	ED_Span_I64 rel = ed_relative_span_from_line_and_pos(line, pos);
+	ED_Span *span = rel.span;
+	
+	if (span->len + text.len <= ED_SPAN_SIZE) {
+		// Fits in the span: make room and copy it in
+		memmove(span->data + rel.i + text.len, span->data + rel.i, span->len - rel.i);
+		memcpy(span->data + rel.i, text.data, text.len);
+		span->len += text.len;
+	} else {
+		// Move what comes after 'pos' to a span of its own, then append the text in between
+		ED_Span *first = span;
+		ED_Span *last  = NULL;
+		
+		i64 after_len = span->len - rel.i;
+		if (after_len > 0) {
+			last = ed_alloc_span(buffer);
+			dll_insert(line->first_span, line->last_span, span, last);
+			
+			memcpy(last->data, span->data + rel.i, after_len);
+			last->len = after_len;
+			span->len = rel.i;
+		}
+		
+		span = ed_span_append_text_without_newlines(buffer, line, span, text);
+		
+		ed_line_coalesce_spans(buffer, line, first, last ? last : span);
+	}
+}
+
+static void
+ed_free_line(ED_Buffer *buffer, ED_Line *line) {
+	if (line->first_span) {
+		buffer->byte_count -= ed_line_len(line);
+		ed_free_span_chain(buffer, line->first_span, line->last_span, ed_span_chain_count(line->first_span));
+	}
+	
+	
+	line->first_span = NULL;
+	line->last_span  = NULL;
+}
+
+static void
+ed_line_fill(ED_Buffer *buffer, ED_Line *line, String text) {
+	// Stores the text in new spans as the line's contents
+	assert(string_find_first(text, '\n') < 0); // Validate args
+	
+	line->first_span = NULL;
+	line->last_span  = NULL;
+	
+	i64 copied = 0;
+	while (copied < text.len || !line->first_span) {
+		ED_Span *span = ed_alloc_span(buffer);
+		dll_push_back(line->first_span, line->last_span, span);
+		
+		// No need to subtract the length (we just allocated it so it will be 0)
+		i64 to_copy_now = min(ED_SPAN_SIZE, text.len - copied);
+		memcpy(span->data, text.data + copied, to_copy_now);
+		span->len = to_copy_now;
+		
+		copied += to_copy_now;
+	}
+	
+	buffer->byte_count += text.len;
+}
+
+static ED_Span *
+ed_span_append_text_without_newlines(ED_Buffer *buffer, ED_Line *line, ED_Span *span, String text) {
+	assert(string_find_first(text, '\n') < 0); // Validate args
+	
+	i64 appended = 0;
+	
+	while (appended < text.len) {
+		if (span->len == ED_SPAN_SIZE) {
+			ED_Span *new_span = ed_alloc_span(buffer);
+			dll_insert(line->first_span, line->last_span, span, new_span);
+			
+			span = new_span;
+		}
+		
+		i64 space   = ED_SPAN_SIZE - span->len;
+		i64 to_copy = text.len - appended;
+		i64 to_copy_now = min(space, to_copy);
+		memcpy(span->data + span->len, text.data + appended, to_copy_now);
+		span->len += to_copy_now;
+		
+		appended  += to_copy_now;
+	}
+	
+	return span;
+}
+
+static void
+ed_line_coalesce_spans(ED_Buffer *buffer, ED_Line *line, ED_Span *first, ED_Span *last) {
+	// Merges adjacent spans from the one before 'first' up to the one after 'last' whenever
+	// their contents fit in a single span, so that edits don't leave a trail of short and
+	// empty spans behind.
+	
+	ED_Span *span = first->prev ? first->prev : first;
+	ED_Span *stop = last->next; // The last span that may be merged into its predecessor
+	
+	bool done = false;
+	while (!done && span->next) {
+		ED_Span *next = span->next;
+		done = (next == stop);
+		
+		if (span->len + next->len <= ED_SPAN_SIZE) {
+			memcpy(span->data + span->len, next->data, next->len);
+			span->len += next->len;
+			
+			dll_remove(line->first_span, line->last_span, next);
+			ed_free_span(buffer, next);
+		} else {
+			span = next;
+		}
+	}
+}
+
+//- General helper functions
+
+static i64
+ed_span_chain_count(ED_Span *first) {
+	i64 count = 0;
+	for (ED_Span *span = first; span; span = span->next) {
+		count += 1;
+	}
+	return count;
+}
+
+ed_function i64
+ed_line_len(ED_Line *line) {
+	i64 len = 0;
+	ED_Span *span = line->first_span;
+	while (span) {
+		len += span->len;
+		span = span->next;
+	}
+	return len;
+}
+
+static i64
+ed_buffer_range_byte_count(ED_Buffer *buffer, Text_Range range) {
+	// Stored bytes only, the newlines between the lines aren't counted
+	i64 result = 0;
+	
+	if (range.start.y == range.end.y) {
+		result = range.end.x - range.start.x;
+	} else {
+		ED_Page_I64 rel = ed_relative_from_absolute_line(buffer, range.start.y);
+		ED_Page *page = rel.page;
+		i64 line_in_page = rel.i;
+		
+		for (i64 y = range.start.y; y < range.end.y; y += 1) {
+			result += ed_line_len(&page->lines[line_in_page]);
+			
+			line_in_page += 1;
+			if (line_in_page == page->line_count) {
+				page = page->next;
+				line_in_page = 0;
+				
+				if (!page->lines) {
+					page = ed_buffer_materialize_page(buffer, page);
+				}
+			}
+		}
+		
+		result += range.end.x - range.start.x;
+	}
+	
+	return result;
+}
+
+static String
+ed_string_from_line(Arena *arena, ED_Line *line) {
+	i64 len = ed_line_len(line);
+	String result = push_string(arena, len);
+	i64 at = 0;
+	ED_Span *span = line->first_span;
+	while (span) {
+		memcpy(result.data + at, span->data, span->len);
+		at += span->len;
+		
+		span = span->next;
+	}
+	return result;
+}
+
+static ED_Span_I64
+ed_relative_span_from_line_and_pos(ED_Line *line, i64 pos) {
+	assert(pos < ed_line_len(line) + 1); // Validate args
+	
+	ED_Span_I64 result = {0};
+	
+	ED_Span *span = line->first_span;
+	while (span) {
+		// We need to add 1 here because empty spans (and therefore empty lines) are allowed.
+		if (pos < span->len + 1) {
+			result.span = span;
+			result.i    = pos;
+			break;
+		}
+		
+		pos -= span->len;
+		span = span->next;
+	}
+	
+	assert(result.span && result.span->data);
+	
+	return result;
+}
+
+ed_function ED_Page_I64
+ed_relative_from_absolute_line(ED_Buffer *buffer, i64 absolute_line) {
+	assert(absolute_line < buffer->line_count); // Validate args
+	
+	// Lines in the last page are found from the end, so that appending stays cheap
+	ED_Page *page = buffer->first_page;
+	i64 line = absolute_line;
+	if (absolute_line >= buffer->line_count - buffer->last_page->line_count) {
+		page = buffer->last_page;
+		line = absolute_line - (buffer->line_count - buffer->last_page->line_count);
+	}
+	
+	ED_Page_I64 result = ed_relative_from_page_and_line(buffer, page, line);
+	return result;
+}
+
+static ED_Page_I64
+ed_relative_from_page_and_line(ED_Buffer *buffer, ED_Page *page, i64 line) {
+	// 'line' counts from the first line of 'page'. A source page holding it is materialized.
+	ED_Page_I64 result = {0};
+	
+	while (page) {
+		// We *DON'T* add 1 here because a file must contain at least 1 page with at least 1 line.
+		if (line < page->line_count) {
+			result.page = page;
+			result.i    = line;
+			break;
+		}
+		
+		line -= page->line_count;
+		page  = page->next;
+	}
+	
+	if (result.page && !result.page->lines) {
+		ED_Page *first = ed_buffer_materialize_page(buffer, result.page);
+		result = ed_relative_from_page_and_line(buffer, first, result.i);
+	}
+	
+	assert(result.page && result.page->lines);
+	
+	return result;
+}
+
+ed_function ED_Line *
+ed_line_from_line_number(ED_Buffer *buffer, i64 line_number) {
+	ED_Page_I64 pair = ed_relative_from_absolute_line(buffer, line_number);
+	ED_Line  *result = &pair.page->lines[pair.i];
+	return result;
+}
+
+//- Line position functions
+
+static i64
+ed_codepoint_columns(u32 codepoint) {
+	i64 result = 1;
+	if (codepoint == '\t') {
+		result = ED_TAB_WIDTH;
+	} else if (codepoint >= 0x80) {
+		result = utf8_codepoint_width(codepoint);
+	}
+	return result;
+}
+
+static ED_Line_Position
+ed_line_position_normalize(ED_Line_Position position) {
+	// Moves a position at the end of a span to the start of the next one, so that its span
+	// holds the byte at the position (unless it's the end of the line)
+	while (position.in_span == position.span->len && position.span->next) {
+		position.span    = position.span->next;
+		position.in_span = 0;
+	}
+	return position;
+}
+
+static bool
+ed_line_position_is_end(ED_Line_Position position) {
+	position = ed_line_position_normalize(position);
+	return position.in_span == position.span->len;
+}
+
+static UTF8_Decode
+ed_line_decode_at(ED_Line_Position position) {
+	// The codepoint that starts at the position. Its bytes can be spread over several spans.
+	position = ed_line_position_normalize(position);
+	
+	ED_Span *span = position.span;
+	assert(position.in_span < span->len); // Not the end of the line
+	
+	UTF8_Decode result = {0};
+	
+	u8 first_byte = span->data[position.in_span];
+	i64 available = span->len - position.in_span;
+	
+	if (first_byte < 0x80) {
+		result.codepoint = first_byte;
+		result.len       = 1;
+	} else if (available >= 4 || !span->next) {
+		result = utf8_decode(span->data + position.in_span, available);
+	} else {
+		u8 bytes[4];
+		i64 count = 0;
+		i64 in_span = position.in_span;
+		while (count < array_count(bytes) && span) {
+			if (in_span < span->len) {
+				bytes[count] = span->data[in_span];
+				count   += 1;
+				in_span += 1;
+			} else {
+				span    = span->next;
+				in_span = 0;
+			}
+		}
+		result = utf8_decode(bytes, count);
+	}
+	
+	return result;
+}
+
+static ED_Line_Position
+ed_line_next_position(ED_Line_Position position) {
+	// One codepoint to the right. The end of the line stays where it is.
+	if (!ed_line_position_is_end(position)) {
+		UTF8_Decode decode = ed_line_decode_at(position);
+		position.column += ed_codepoint_columns(decode.codepoint);
+		position.x      += decode.len;
+		
+		i64 to_skip = decode.len;
+		while (to_skip > 0) {
+			if (position.in_span == position.span->len) {
+				position.span    = position.span->next;
+				position.in_span = 0;
+			}
+			
+			i64 skip_now = min(to_skip, position.span->len - position.in_span);
+			position.in_span += skip_now;
+			to_skip          -= skip_now;
+		}
+	}
+	
+	return position;
+}
+
+static ED_Line_Position
+ed_line_prev_position(ED_Line_Position position) {
+	// One codepoint to the left. The start of the line stays where it is.
+	if (position.x > 0) {
+		// Go back one byte, then over the continuation bytes before it, up to a whole codepoint
+		ED_Line_Position last_byte = {0};
+		ED_Line_Position start = position;
+		i64 back = 0;
+		
+		bool done = false;
+		while (!done) {
+			while (start.in_span == 0) {
+				start.span    = start.span->prev;
+				start.in_span = start.span->len;
+			}
+			start.in_span -= 1;
+			start.x       -= 1;
+			back          += 1;
+			
+			if (back == 1) {
+				last_byte = start;
+			}
+			
+			done = (!utf8_is_continuation(start.span->data[start.in_span]) || back == 4 || start.x == 0);
+		}
+		
+		UTF8_Decode decode = ed_line_decode_at(start);
+		if (decode.len != back) {
+			// Not a whole codepoint: the last byte is an invalid one on its own, as it is
+			// when going to the right
+			start  = last_byte;
+			decode = ed_line_decode_at(start);
+		}
+		
+		start.column = position.column - ed_codepoint_columns(decode.codepoint);
+		position = start;
+	}
+	
+	return position;
+}
+
+static ED_Line_Position
+ed_line_position_from_x(ED_Line *line, i64 x) {
+	assert(x >= 0 && x <= ed_line_len(line)); // Validate args
+	
+	ED_Line_Position start = {line->first_span, 0, 0, 0};
+	return ed_line_position_advance_to_x(start, x);
+}
+
+ed_function ED_Line_Position
+ed_line_position_from_column(ED_Line *line, i64 column) {
+	// The last codepoint that starts at or before the column, or the end of the line
+	ED_Line_Position start = {line->first_span, 0, 0, 0};
+	return ed_line_position_advance_to_column(start, column);
+}
+
+ed_function ED_Line_Position
+ed_buffer_position_from_point(ED_Buffer *buffer, Point point) {
+	ED_Line_Position result = buffer->cached_position;
+	
+	bool cached = (result.span &&
+				   buffer->cached_edit_count == buffer->edit_count &&
+				   buffer->cached_point.x == point.x &&
+				   buffer->cached_point.y == point.y);
+	
+	if (!cached) {
+		ED_Line *line = ed_line_from_line_number(buffer, point.y);
+		result = ed_buffer_line_position_from_x(buffer, line, point.y, point.x);
+		ed_buffer_cache_position(buffer, point, result);
+	}
+	
+	return result;
+}
+
+static void
+ed_buffer_cache_position(ED_Buffer *buffer, Point point, ED_Line_Position position) {
+	buffer->cached_edit_count = buffer->edit_count;
+	buffer->cached_point      = point;
+	buffer->cached_position   = position;
+}
+
+static ED_Line_Position
+ed_line_position_advance_to_x(ED_Line_Position position, i64 x) {
+	// Walks right from a position on a codepoint boundary up to the byte offset 'x'
+	assert(x >= position.x); // Validate args
+	
+	while (position.x < x) {
+		position = ed_line_position_normalize(position);
+		
+		u8 *data = position.span->data + position.in_span;
+		i64 available = min(position.span->len - position.in_span, x - position.x);
+		assert(available > 0); // Past the end of the line
+		
+		// Runs of ASCII take a column per byte, except for tabs
+		i64 ascii_len = utf8_ascii_prefix_len(data, available);
+		if (ascii_len > 0) {
+			i64 tab_count = string_count_occurrences(string(data, ascii_len), '\t');
+			position.column  += ascii_len + tab_count * (ED_TAB_WIDTH - 1);
+			position.x       += ascii_len;
+			position.in_span += ascii_len;
+		} else {
+			ED_Line_Position next = ed_line_next_position(position);
+			if (next.x <= x) {
+				position = next;
+			} else {
+				// x is in the middle of a codepoint (which happens while one is being typed)
+				position.x       += available;
+				position.in_span += available;
+			}
+		}
+	}
+	
+	return position;
+}
+
+static ED_Line_Position
+ed_line_position_advance_to_column(ED_Line_Position position, i64 column) {
+	// Walks right from a position on a codepoint boundary up to the last codepoint that starts
+	// at or before the column, or the end of the line
+	bool done = false;
+	while (!done) {
+		position = ed_line_position_normalize(position);
+		
+		// Fast path: runs of ASCII without tabs take a column per byte
+		u8 *data = position.span->data + position.in_span;
+		i64 run_len = utf8_ascii_prefix_len(data, clamp(0, column - position.column, position.span->len - position.in_span));
+		i64 tab_index = string_find_first(string(data, run_len), '\t');
+		if (tab_index >= 0) {
+			run_len = tab_index;
+		}
+		
+		position.in_span += run_len;
+		position.x       += run_len;
+		position.column  += run_len;
+		
+		ED_Line_Position next = ed_line_next_position(position);
+		done = (next.x == position.x || next.column > column);
+		if (!done) {
+			position = next;
+		}
+	}
+	
+	return position;
+}
+
+//- Line index functions
+
+static ED_Line_Index *
+ed_buffer_line_index(ED_Buffer *buffer, i64 line_number) {
+	// The index of the line, or a new one in an unused slot or else in the one used least
+	// recently
+	ED_Line_Index *result = NULL;
+	ED_Line_Index *reused = &buffer->line_indexes[0];
+	
+	for (i64 i = 0; i < ED_LINE_INDEX_COUNT && !result; i += 1) {
+		ED_Line_Index *index = &buffer->line_indexes[i];
+		if (index->first_block && index->line_number == line_number) {
+			result = index;
+		} else if (reused->first_block && (!index->first_block || index->last_used < reused->last_used)) {
+			reused = index;
+		}
+	}
+	
+	if (!result) {
+		result = reused;
+		ed_buffer_free_line_index(buffer, result);
+		result->line_number = line_number;
+	}
+	
+	buffer->line_index_clock += 1;
+	result->last_used = buffer->line_index_clock;
+	
+	return result;
+}
+
+static void
+ed_buffer_free_line_index(ED_Buffer *buffer, ED_Line_Index *index) {
+	if (index->first_block) {
+		pool_free_chain(&buffer->pool, index->first_block, index->last_block, sizeof(ED_Checkpoint_Block));
+	}
+	index->first_block = NULL;
+	index->last_block  = NULL;
+}
+
+static void
+ed_buffer_line_indexes_edit(ED_Buffer *buffer, Point start, i64 removed_line_count, i64 added_line_count) {
+	// Called before an edit that starts at 'start', removes the line breaks of the next
+	// 'removed_line_count' lines and adds 'added_line_count' new ones.
+	//
+	// In the edited line, the checkpoints in spans before the one holding 'start' stay
+	// where they are (edits only ever merge spans into the one before them), and so do the
+	// codepoint boundaries more than a sequence length before it.
+	i64 keep_before_x = start.x - max(ED_SPAN_SIZE, 4);
+	
+	for (i64 i = 0; i < ED_LINE_INDEX_COUNT; i += 1) {
+		ED_Line_Index *index = &buffer->line_indexes[i];
+		
+		if (!index->first_block || index->line_number < start.y) {
+			// Before the edit
+		} else if (index->line_number == start.y) {
+			// Keep the blocks up to the first checkpoint that goes, free the rest
+			ED_Checkpoint_Block *prev  = NULL;
+			ED_Checkpoint_Block *block = index->first_block;
+			while (block && block->checkpoints[block->count - 1].x < keep_before_x) {
+				prev  = block;
+				block = block->next;
+			}
+			
+			if (block) {
+				i64 keep_count = 0;
+				while (block->checkpoints[keep_count].x < keep_before_x) {
+					keep_count += 1;
+				}
+				
+				ED_Checkpoint_Block *first_freed = block;
+				if (keep_count > 0) {
+					block->count = keep_count;
+					prev = block;
+					first_freed = block->next;
+				}
+				
+				if (first_freed) {
+					pool_free_chain(&buffer->pool, first_freed, index->last_block, sizeof(ED_Checkpoint_Block));
+				}
+				
+				if (prev) {
+					prev->next = NULL;
+					index->last_block = prev;
+				} else {
+					index->first_block = NULL;
+					index->last_block  = NULL;
+				}
+			}
+		} else if (index->line_number <= start.y + removed_line_count) {
+			// Joined to the edited line
+			ed_buffer_free_line_index(buffer, index);
+		} else {
+			index->line_number += added_line_count - removed_line_count;
+		}
+	}
+}
+
+static ED_Line_Position
+ed_buffer_line_checkpoint(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 x, i64 column) {
+	// The last checkpoint of the line at or before both 'x' and 'column' (INT64_MAX for the
+	// one that doesn't matter). The first time, checkpoints are added on the way there.
+	ED_Line_Position result = {line->first_span, 0, 0, 0};
+	
+	// Near the start of the line, walking from there is just as fast
+	if (x >= ED_LINE_CHECKPOINT_SPACING && column >= ED_LINE_CHECKPOINT_SPACING) {
+		ED_Line_Index *index = ed_buffer_line_index(buffer, line_number);
+		
+		// Find it
+		bool is_last = true;
+		for (ED_Checkpoint_Block *block = index->first_block; block && is_last; block = block->next) {
+			ED_Line_Position block_last = block->checkpoints[block->count - 1];
+			if (block_last.x <= x && block_last.column <= column) {
+				result = block_last; // The whole block is before it
+			} else {
+				for (i64 i = 0; i < block->count && block->checkpoints[i].x <= x && block->checkpoints[i].column <= column; i += 1) {
+					result = block->checkpoints[i];
+				}
+				is_last = false;
+			}
+		}
+		
+		// Add the ones up to it, and one past it so that the walk from there is shorter
+		bool done = !is_last;
+		while (!done) {
+			ED_Line_Position next = ed_line_position_advance_to_column(result, result.column + ED_LINE_CHECKPOINT_SPACING);
+			done = (next.x == result.x); // End of the line
+			
+			if (!done) {
+				ED_Checkpoint_Block *block = index->last_block;
+				if (!block || block->count == ED_CHECKPOINT_BLOCK_COUNT) {
+					block = pool_alloc(&buffer->pool, sizeof(ED_Checkpoint_Block));
+					block->next  = NULL;
+					block->count = 0;
+					queue_push(index->first_block, index->last_block, block);
+				}
+				block->checkpoints[block->count] = next;
+				block->count += 1;
+				
+				if (next.x <= x && next.column <= column) {
+					result = next;
+				} else {
+					done = true;
+				}
+			}
+		}
+	}
+	
+	return result;
+}
+
+static ED_Line_Position
+ed_buffer_line_position_from_x(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 x) {
+	ED_Line_Position checkpoint = ed_buffer_line_checkpoint(buffer, line, line_number, x, INT64_MAX);
+	return ed_line_position_advance_to_x(checkpoint, x);
+}
+
+ed_function ED_Line_Position
+ed_buffer_line_position_from_column(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 column) {
+	// The last codepoint that starts at or before the column, or the end of the line
+	ED_Line_Position checkpoint = ed_buffer_line_checkpoint(buffer, line, line_number, INT64_MAX, column);
+	return ed_line_position_advance_to_column(checkpoint, column);
+}
+
+//- Editor input processing
+
+ed_function ED_Text_Action
+ed_text_action_from_key(ED_Key key) {
+	ED_Text_Action action = {0};
+	
+	action.delta.direction = -1; // To make sure every case sets it.
+	
+	if (key == ED_Key_ARROW_LEFT  ||
+		key == ED_Key_ARROW_RIGHT ||
+		key == ED_Key_ARROW_UP    ||
+		key == ED_Key_ARROW_DOWN) {
+		action.delta.cross_lines = true;
+	}
+	
+	if (key == ED_Key_PAGE_UP ||
+		key == ED_Key_PAGE_DOWN) {
+		action.delta.clamp_by_window = true;
+	}
+	
+	switch (key) {
+		
+		// Navigation
+		case ED_Key_ARROW_LEFT:  { action.delta.delta = -1; action.delta.direction = Direction_HORIZONTAL; } break;
+		case ED_Key_ARROW_RIGHT: { action.delta.delta = +1; action.delta.direction = Direction_HORIZONTAL; } break;
+		
+		case ED_Key_ARROW_UP:    { action.delta.delta = -1; action.delta.direction = Direction_VERTICAL; } break;
+		case ED_Key_ARROW_DOWN:  { action.delta.delta = +1; action.delta.direction = Direction_VERTICAL; } break;
+		
+		case ED_Key_PAGE_UP:     { action.delta.delta = -1000; action.delta.direction = Direction_VERTICAL; } break;
+		case ED_Key_PAGE_DOWN:   { action.delta.delta = +1000; action.delta.direction = Direction_VERTICAL; } break;
+		
+		case ED_Key_HOME:        { action.delta.delta = -1000; action.delta.direction = Direction_HORIZONTAL; } break; // TODO: I64_MAX
+		case ED_Key_END:         { action.delta.delta = +1000; action.delta.direction = Direction_HORIZONTAL; } break; // TODO: I64_MAX
+		
+		// Deletion
+		case ED_Key_BACKSPACE: {
+			action.flags |= ED_Text_Action_Flags_DELETE;
+			action.delta.delta = -1;
+			action.delta.direction = Direction_HORIZONTAL;
+			action.delta.cross_lines = true;
+		} break;
+		
+		case CTRL_KEY('h'):
+		case ED_Key_DELETE: {
+			action.flags |= ED_Text_Action_Flags_DELETE;
+			action.delta.delta = +1;
+			action.delta.direction = Direction_HORIZONTAL;
+			action.delta.cross_lines = true;
+		} break;
+		
+		// Nothing
+		case CTRL_KEY('l'):
+		case '\x1b': {
+			allow_break();
+			action.delta.direction = Direction_HORIZONTAL; // Just to set it to something
+		} break;
+		
+		// Insertion
+		default: {
+			// Bytes past ASCII are pieces of UTF-8 sequences, inserted one at a time
+			if (isprint(key) || key == '\t' || key == '\n' || (key >= 0x80 && key <= 0xFF)) {
+				action.character = cast(u8) key;
+				action.delta.direction = Direction_HORIZONTAL;
+			}
+		} break;
+	}
+	
+	return action;
+}
+
+ed_function ED_Text_Operation
+ed_text_operation_from_action(Arena *arena, ED_Buffer *buffer, ED_Text_Action action) {
+	ED_Text_Operation op = {0};
+	
+	// Set defaults
+	op.new_cursor     = buffer->cursor;
+	op.delete_range   = make_text_range(op.new_cursor, op.new_cursor);
+	op.replace_string = string_from_lit("");
+	
+	// Apply delta
+	op.new_cursor = ed_buffer_clamp_delta(buffer, op.new_cursor, action.delta);
+	
+	if (action.flags & ED_Text_Action_Flags_DELETE) {
+		// Mark whole region to be deleted
+		op.delete_range = make_text_range(buffer->cursor, op.new_cursor);
+		
+		// Reset the cursor
+		op.new_cursor = op.delete_range.start;
+	}
+	
+	// Insert text
+	if (action.character != 0) {
+		op.replace_string = string_clone(arena, string(&action.character, 1));
+	}
+	
+	return op;
+}
+
+ed_function void
+ed_buffer_apply_operation(ED_Buffer *buffer, ED_Text_Operation operation) {
+	// Cursor navigation
+	buffer->cursor = operation.new_cursor;
+	
+	// Replace the range with the string; plain cursor movements leave the buffer alone
+	buffer->cursor = ed_buffer_replace_range(buffer, operation.delete_range, operation.replace_string);
+	
+	if (operation.replace_string.len > 0 || text_point_less_than(operation.delete_range.start, operation.delete_range.end)) {
+		buffer->has_unsaved_edits = true;
+	}
+	
+	return;
+}
+
+//- Editor helper functions
+
+static bool
+ed_buffer_is_in_use(ED_Buffer *buffer) {
+	return buffer->name.len > 0;
+}
+
+ed_function Point
+ed_buffer_clamp_delta(ED_Buffer *buffer, Point point, ED_Delta delta) {
+	Point result = point;
+	
+	// TODO: What if the delta is encoded as a point instead of a scalar + direction?
+	
+	if (delta.delta != 0) { // If this is fast enough we can eliminate this check
+		switch (delta.direction) {
+			case Direction_HORIZONTAL: {
+				// Move by codepoints, starting from the cached position when there is one
+				ED_Line_Position position = ed_buffer_position_from_point(buffer, point);
+				
+				if (delta.delta < 0) {
+					if (position.x == 0) {
+						if (delta.cross_lines && result.y > 0) {
+							// Move to end of previous line
+							result.y -= 1;
+							ED_Line *line = ed_line_from_line_number(buffer, result.y);
+							position = ed_buffer_line_position_from_column(buffer, line, result.y, INT64_MAX);
+						}
+					} else {
+						for (i32 i = 0; i < -delta.delta && position.x > 0; i += 1) {
+							position = ed_line_prev_position(position);
+						}
+					}
+				} else {
+					if (ed_line_position_is_end(position)) {
+						if (delta.cross_lines && result.y < buffer->line_count - 1) {
+							// Move to start of next line
+							result.y += 1;
+							ED_Line *line = ed_line_from_line_number(buffer, result.y);
+							position = ed_line_position_from_x(line, 0);
+						}
+					} else {
+						for (i32 i = 0; i < delta.delta && !ed_line_position_is_end(position); i += 1) {
+							position = ed_line_next_position(position);
+						}
+					}
+				}
+				
+				result.x = cast(i32) position.x;
+				ed_buffer_cache_position(buffer, result, position);
+				
+			} break;
+			
+			case Direction_VERTICAL: {
+				i32 actual_delta = delta.delta;
+				
+				if (delta.clamp_by_window) {
+					actual_delta = clamp(-buffer->viewport_height, delta.delta, +buffer->viewport_height);
+				}
+				
+				// Keep the column, not the byte offset
+				i64 column = ed_buffer_position_from_point(buffer, point).column;
+				
+				result.y += actual_delta;
+				result.y = clamp(0, result.y, cast(i32) buffer->line_count - 1);
+				
+				ED_Line *line = ed_line_from_line_number(buffer, result.y);
+				ED_Line_Position position = ed_buffer_line_position_from_column(buffer, line, result.y, column);
+				
+				result.x = cast(i32) position.x;
+				ed_buffer_cache_position(buffer, result, position);
+				
+			} break;
+			
+			default: {
+				result.x = 0;
+				result.y = 0;
+				
+				panic();
+			} break;
+		}
+	}
+	
+	return result;
+}
+
+//- Editor load/save functions
+
+static void
+ed_buffer_clear(ED_Buffer *buffer) {
+	// Leaves the buffer without any pages, ready to be filled again
+	assert(buffer->arena.ptr);
+	
+	buffer->cursor.x = 0;
+	buffer->cursor.y = 0;
+	buffer->vscroll = 0;
+	buffer->hscroll = 0;
+	buffer->page_count = 0;
+	buffer->line_count = 0;
+	buffer->span_count = 0;
+	buffer->byte_count = 0;
+	buffer->source_byte_count = 0;
+	buffer->first_page = NULL;
+	buffer->last_page  = NULL;
+	buffer->first_zombie_page = NULL;
+	buffer->zombie_page_count = 0;
+	buffer->first_retired_page = NULL;
+	buffer->last_retired_page  = NULL;
+	buffer->edit_count += 1;
+	buffer->has_unsaved_edits = false;
+	buffer->highlight.frontier = 0;
+	buffer->highlight.compare_from = 0;
+	buffer->highlight.valid_line_count = 0;
+	
+	// Their blocks go with the pool
+	memset(buffer->line_indexes, 0, sizeof(buffer->line_indexes));
+	
+	pool_init(&buffer->pool, &buffer->arena);
+}
+
+ed_function void
+ed_init_buffer_contents(ED_Buffer *buffer, SliceU8 contents) {
+	// Assumes that the raw contents encode line breaks as LF.
+	ed_buffer_clear(buffer);
+	
+	ED_Page *page = NULL;
+	{
+		page = ed_alloc_page(buffer);
+		dll_push_back(buffer->first_page, buffer->last_page, page);
+	}
+	
+	i64 line_start = 0;
+	i64 line_end = 0;
+	for (i64 byte_index = 0; byte_index <= contents.len; byte_index += 1) {
+		if (byte_index == contents.len || contents.data[byte_index] == '\n') {
+			line_end = byte_index;
+			
+			// Get line
+			ED_Line *line = NULL;
+			{
+				if (page->line_count >= ED_PAGE_SIZE) {
+					page = ed_alloc_page(buffer);
+					dll_push_back(buffer->first_page, buffer->last_page, page);
+				}
+				
+				line = &page->lines[page->line_count];
+				page->line_count += 1;
+				buffer->line_count += 1;
+			}
+			
+			// Fill line. The pool was reset above, so the spans come out of the slabs one
+			// after the other, in document order.
+			ed_line_fill(buffer, line, string(contents.data + line_start, line_end - line_start));
+			
+			// Prepare for next iteration
+			line_start = line_end + 1;
+		}
+	}
+	
+	return;
+}
+
+static void
+ed_init_buffer_source(ED_Buffer *buffer, SliceU8 source) {
+	// Only finds where the lines are: the buffer is made of source pages of about
+	// ED_SOURCE_CHUNK_SIZE bytes, cut after a line break, that read from 'source' (which must
+	// outlive them). buffer->line_ending must already be set.
+	ed_buffer_clear(buffer);
+	
+	buffer->source = source;
+	
+	i64 chunk_start = 0;
+	bool done = false;
+	while (!done) {
+		i64 chunk_end = ed_source_chunk_end(source, chunk_start);
+		
+		// The last chunk also has the line after the last line break (maybe empty)
+		done = (chunk_end == source.len);
+		String chunk = string(source.data + chunk_start, chunk_end - chunk_start);
+		i64 line_count = string_count_occurrences(chunk, '\n') + (done ? 1 : 0);
+		
+		ED_Page *page = ed_alloc_source_page(buffer, chunk.data, chunk.len, line_count);
+		dll_push_back(buffer->first_page, buffer->last_page, page);
+		buffer->line_count += line_count;
+		
+		chunk_start = chunk_end;
+	}
+}
+
+static i64
+ed_source_chunk_end(SliceU8 source, i64 start) {
+	// Up to the first line break after ED_SOURCE_CHUNK_SIZE bytes, or the end of the file
+	i64 result = source.len;
+	
+	if (source.len - start > ED_SOURCE_CHUNK_SIZE) {
+		u8 *line_break = memchr(source.data + start + ED_SOURCE_CHUNK_SIZE, '\n',
+								source.len - start - ED_SOURCE_CHUNK_SIZE);
+		if (line_break) {
+			result = line_break + 1 - source.data;
+		}
+	}
+	
+	return result;
+}
+
+//- Background loading functions
+
+static void
+ed_loader_proc(void *data) {
+	// Cuts the file into chunks like ed_init_buffer_source, checking the line breaks and the
+	// UTF-8 on the way. Chunks end after a line break, so neither a CRLF nor a codepoint is
+	// ever split between two of them.
+	ED_Loader *loader = data;
+	SliceU8 source = loader->source;
+	
+	trace_begin("index file");
+	
+	i64 chunk_start = 0;
+	bool done = false;
+	while (!done && !atomic_load_u64(&loader->should_stop)) {
+		i64 chunk_end = ed_source_chunk_end(source, chunk_start);
+		
+		done = (chunk_end == source.len);
+		String chunk = string(source.data + chunk_start, chunk_end - chunk_start);
+		i64 line_break_count = string_count_occurrences(chunk, '\n');
+		
+		if (line_break_count > 0) {
+			atomic_store_u64(&loader->saw_lf, 1);
+			if (ed_detect_line_ending(sliceu8_from_string(chunk)) != ED_Line_Ending_CRLF) {
+				atomic_store_u64(&loader->saw_lone_lf, 1);
+			}
+		}
+		if (!utf8_validate(chunk)) {
+			atomic_store_u64(&loader->saw_invalid_utf8, 1);
+		}
+		
+		u64 chunk_index = loader->chunk_count;
+		loader->chunks[chunk_index].len        = chunk.len;
+		loader->chunks[chunk_index].line_count = line_break_count + (done ? 1 : 0);
+		atomic_store_u64(&loader->chunk_count, chunk_index + 1);
+		
+		chunk_start = chunk_end;
+	}
+	
+	atomic_store_u64(&loader->is_done, 1);
+	
+	trace_end("index file");
+}
+
+ed_function void
+ed_buffer_start_loading(ED_Buffer *buffer, SliceU8 source) {
+	// Starts finding the lines of 'source' (which must outlive the buffer's use of it) and
+	// returns once the first chunk is in the buffer
+	assert(source.len > 0); // Validate args
+	
+	ed_buffer_clear(buffer);
+	buffer->source = source;
+	
+	// Chunks are at least ED_SOURCE_CHUNK_SIZE long, except the last one
+	i64 max_chunk_count = source.len / ED_SOURCE_CHUNK_SIZE + 1;
+	u64 size = sizeof(ED_Loader) + max_chunk_count * sizeof(ED_Source_Chunk);
+	
+	ED_Loader *loader = mem_reserve_and_commit(size);
+	assert(loader);
+	memset(loader, 0, sizeof(ED_Loader));
+	loader->source = source;
+	loader->chunks = cast(ED_Source_Chunk *) (loader + 1);
+	loader->was_read_only = buffer->is_read_only;
+	
+	buffer->loader = loader;
+	buffer->is_read_only = true;
+	
+	loader->thread = thread_start(ed_loader_proc, loader);
+	
+	while (!atomic_load_u64(&loader->chunk_count) && !atomic_load_u64(&loader->is_done)) {
+		sleep_ms(1);
+	}
+	ed_buffer_update_loading(buffer);
+}
+
+ed_function bool
+ed_buffer_update_loading(ED_Buffer *buffer) {
+	// Appends the chunks found since the last call as source pages. Returns whether the
+	// buffer changed.
+	bool changed = false;
+	ED_Loader *loader = buffer->loader;
+	
+	if (loader) {
+		// Done first: if it is, the count read next has every chunk
+		bool is_done = atomic_load_u64(&loader->is_done);
+		i64 chunk_count = atomic_load_u64(&loader->chunk_count);
+		
+		for (i64 i = loader->taken_chunk_count; i < chunk_count; i += 1) {
+			ED_Source_Chunk chunk = loader->chunks[i];
+			
+			ED_Page *page = ed_alloc_source_page(buffer, buffer->source.data + loader->taken_byte_count, chunk.len, chunk.line_count);
+			ed_buffer_link_page(buffer, buffer->last_page, page);
+			buffer->line_count += chunk.line_count;
+			
+			loader->taken_byte_count += chunk.len;
+			changed = true;
+		}
+		loader->taken_chunk_count = chunk_count;
+		
+		// Only CRLF until a lone LF shows up. The pages built so far were all read from the file
+		// (nothing can be edited yet), so they can be built again with the CRs left in.
+		ED_Line_Ending line_ending = ED_Line_Ending_LF;
+		if (atomic_load_u64(&loader->saw_lf) && !atomic_load_u64(&loader->saw_lone_lf)) {
+			line_ending = ED_Line_Ending_CRLF;
+		}
+		if (line_ending != buffer->line_ending) {
+			buffer->line_ending = line_ending;
+			ed_buffer_evict_pages_outside(buffer, 0, 0);
+			changed = true;
+		}
+		
+		buffer->has_invalid_utf8 = atomic_load_u64(&loader->saw_invalid_utf8);
+		
+		if (is_done) {
+			assert(loader->taken_byte_count == buffer->source.len);
+			
+			ed_buffer_stop_loading(buffer);
+			changed = true;
+		}
+	}
+	
+	return changed;
+}
+
+ed_function void
+ed_buffer_finish_loading(ED_Buffer *buffer) {
+	// Waits for the rest of the file
+	if (buffer->loader) {
+		thread_join(buffer->loader->thread);
+		buffer->loader->thread = (Thread){0};
+		ed_buffer_update_loading(buffer);
+	}
+}
+
+ed_function void
+ed_buffer_stop_loading(ED_Buffer *buffer) {
+	// Leaves the buffer with the chunks it has already taken
+	ED_Loader *loader = buffer->loader;
+	
+	if (loader) {
+		atomic_store_u64(&loader->should_stop, 1);
+		if (loader->thread.handle) {
+			thread_join(loader->thread);
+		}
+		
+		buffer->is_read_only = loader->was_read_only;
+		
+		u64 size = sizeof(ED_Loader) + (loader->source.len / ED_SOURCE_CHUNK_SIZE + 1) * sizeof(ED_Source_Chunk);
+		mem_release(loader, size);
+		buffer->loader = NULL;
+	}
+}
+
+ed_function f32
+ed_buffer_load_progress(ED_Buffer *buffer) {
+	// From 0 to 1, for the bytes in the buffer already
+	f32 result = 1;
+	
+	if (buffer->loader) {
+		result = cast(f32) buffer->loader->taken_byte_count / cast(f32) buffer->source.len;
+	}
+	
+	return result;
+}
+
+//- Stream functions
+
+static void
+ed_stream_proc(void *data) {
+	// Reads straight into the free part of the ring, up to where it wraps around
+	ED_Stream *stream = data;
+	
+	bool done = false;
+	while (!done && !atomic_load_u64(&stream->should_stop)) {
+		u64 write_pos = stream->write_pos;
+		u64 free_len = ED_STREAM_RING_SIZE - (write_pos - atomic_load_u64(&stream->read_pos));
+		
+		if (free_len == 0) {
+			sleep_ms(1);
+		} else {
+			u64 offset = write_pos % ED_STREAM_RING_SIZE;
+			u64 len = min(free_len, ED_STREAM_RING_SIZE - offset);
+			
+			i64 read_len = input_stream_read(stream->input, stream->ring + offset, len);
+			if (read_len > 0) {
+				atomic_store_u64(&stream->write_pos, write_pos + read_len);
+			} else {
+				done = true;
+			}
+		}
+	}
+	
+	input_stream_close(stream->input);
+	atomic_store_u64(&stream->is_done, 1);
+	
+	ed_stream_release(stream);
+}
+
+static void
+ed_stream_release(ED_Stream *stream) {
+	// Called once by each thread, the second call frees it
+	if (atomic_add_u64(&stream->release_count, 1) == 1) {
+		mem_release(stream, sizeof(ED_Stream));
+	}
+}
+
+ed_function void
+ed_buffer_start_streaming(ED_Buffer *buffer, Input_Stream input, String name) {
+	// Overwrites whatever the buffer had before with an empty buffer that has no file to save
+	// to. The text shows up as ed_buffer_update_streaming is called.
+	assert(input.ok); // Validate args
+	
+	ed_buffer_reset_arena(buffer);
+	
+	ed_buffer_release_source(buffer);
+	ed_buffer_stop_streaming(buffer);
+	
+	ed_init_buffer_contents(buffer, (SliceU8){0});
+	buffer->line_ending = ED_Line_Ending_LF; // CRs stay in the text
+	buffer->has_invalid_utf8 = false;
+	buffer->file_read_len = 0;
+	buffer->file_name = (String){0};
+	buffer->name = string_clone(&buffer->arena, name);
+	buffer->highlight.language = ED_Language_NONE;
+	
+	ED_Stream *stream = mem_reserve_and_commit(sizeof(ED_Stream));
+	assert(stream);
+	memset(stream, 0, sizeof(ED_Stream) - sizeof(stream->ring)); // The ring is only touched as it fills up
+	stream->input = input;
+	
+	buffer->stream = stream;
+	
+	stream->thread = thread_start(ed_stream_proc, stream);
+}
+
+ed_function bool
+ed_buffer_update_streaming(ED_Buffer *buffer) {
+	// Appends what came in since the last call. Returns whether the buffer changed.
+	bool changed = false;
+	ED_Stream *stream = buffer->stream;
+	
+	if (stream) {
+		// Done first: if it is, the position read next has everything
+		bool is_done  = atomic_load_u64(&stream->is_done);
+		u64 write_pos = atomic_load_u64(&stream->write_pos);
+		u64 read_pos  = stream->read_pos;
+		
+		if (write_pos > read_pos) {
+			Scratch scratch = scratch_begin(0, 0);
+			
+			trace_begin("append stream");
+			
+			// In one piece, even where it wraps around the end of the ring
+			i64 len = write_pos - read_pos;
+			u8 *text = push_nozero(scratch.arena, len);
+			
+			i64 offset    = read_pos % ED_STREAM_RING_SIZE;
+			i64 first_len = min(len, ED_STREAM_RING_SIZE - offset);
+			memcpy(text, stream->ring + offset, first_len);
+			memcpy(text + first_len, stream->ring, len - first_len);
+			
+			// A codepoint cut in two waits for the rest of it, unless nothing else is coming
+			if (!is_done) {
+				len = utf8_complete_prefix_len(text, len);
+			}
+			
+			if (len > 0) {
+				String s = string(text, len);
+				buffer->has_invalid_utf8 = buffer->has_invalid_utf8 || !utf8_validate(s);
+				ed_buffer_append_text(buffer, s);
+				
+				atomic_store_u64(&stream->read_pos, read_pos + len);
+				changed = true;
+			}
+			
+			trace_end("append stream");
+			
+			scratch_end(scratch);
+		}
+		
+		if (is_done) {
+			ed_buffer_stop_streaming(buffer);
+			changed = true;
+		}
+	}
+	
+	return changed;
+}
+
+static void
+ed_buffer_stop_streaming(ED_Buffer *buffer) {
+	// Leaves the buffer with what it has already taken. A reader still waiting for the writer
+	// isn't waited for: it stops (and frees the stream) after its read returns.
+	ED_Stream *stream = buffer->stream;
+	
+	if (stream) {
+		atomic_store_u64(&stream->should_stop, 1);
+		if (atomic_load_u64(&stream->is_done)) {
+			thread_join(stream->thread);
+		}
+		
+		ed_stream_release(stream);
+		buffer->stream = NULL;
+	}
+}
+
+ed_function bool
+ed_buffer_load_file(ED_Buffer *buffer, String file_name) {
+	// Overwrites whatever the buffer had before.
+	
+	bool ok = false;
+	
+	ed_buffer_reset_arena(buffer);
+	
+	// The old mapping goes with the pages that read from it
+	ed_buffer_release_source(buffer);
+	ed_buffer_stop_streaming(buffer);
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	trace_begin("map file");
+	Read_File_Result map_file_result = map_file(file_name);
+	trace_end("map file");
+	
+	if (map_file_result.ok && map_file_result.contents.len >= ED_LAZY_MIN_FILE_SIZE) {
+		// Big files are read from the mapping, only for the parts that get looked at. Their
+		// lines are found in the background: the buffer grows as ed_buffer_update_loading is
+		// called, and can't be edited until the whole file is in.
+		trace_begin("init buffer");
+		ed_buffer_start_loading(buffer, map_file_result.contents);
+		buffer->source_is_mapped = true;
+		buffer->file_read_len = map_file_result.contents.len;
+		buffer->file_info = file_info(file_name);
+		trace_end("init buffer");
+		
+		buffer->file_name = string_clone(&buffer->arena, file_name);
+		buffer->name      = buffer->file_name;
+		buffer->highlight.language = ed_language_from_file_name(file_name);
+		
+		ok = true;
+	} else {
+		unmap_file(map_file_result.contents);
+		
+		trace_begin("read file");
+		Read_File_Result read_file_result = read_file(scratch.arena, file_name);
+		trace_end("read file");
+		
+		if (read_file_result.ok) {
+			// The buffer only stores LFs: CRLF files lose their CRs here and get them back on save
+			SliceU8 contents = read_file_result.contents;
+			buffer->file_read_len = contents.len;
+			buffer->file_info = file_info(file_name);
+			
+			trace_begin("line endings");
+			ED_Line_Ending line_ending = ed_detect_line_ending(contents);
+			if (line_ending == ED_Line_Ending_CRLF) {
+				contents.len = ed_strip_crlf(contents);
+			}
+			trace_end("line endings");
+			
+			trace_begin("init buffer");
+			ed_init_buffer_contents(buffer, contents);
+			trace_end("init buffer");
+			
+			buffer->line_ending = line_ending;
+			
+			trace_begin("validate utf-8");
+			buffer->has_invalid_utf8 = !utf8_validate(string_from_sliceu8(contents));
+			trace_end("validate utf-8");
+			
+			buffer->file_name = string_clone(&buffer->arena, file_name);
+			buffer->name      = buffer->file_name;
+			buffer->highlight.language = ed_language_from_file_name(file_name);
+			
+			ok = true;
+		} else {
+			;
+		}
+	}
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+ed_function void
+ed_buffer_release_source(ED_Buffer *buffer) {
+	// Only once nothing reads from it anymore
+	ed_buffer_stop_loading(buffer);
+	
+	// Snapshots may still read from it
+	if (buffer->source.data) {
+		ed_buffer_collect_snapshots(buffer);
+		if (buffer->snapshot_count > 0) {
+			ED_Retired_Memory *retired = ed_buffer_retire_memory(buffer);
+			retired->source = buffer->source;
+			retired->source_is_mapped = buffer->source_is_mapped;
+		} else {
+			ed_release_source_memory(buffer->source, buffer->source_is_mapped);
+		}
+	}
+	
+	buffer->source = (SliceU8){0};
+	buffer->source_is_mapped = false;
+}
+
+static void
+ed_release_source_memory(SliceU8 source, bool is_mapped) {
+	if (is_mapped) {
+		unmap_file(source);
+	} else {
+		mem_release(source.data, max(source.len, 1));
+	}
+}
+
+ed_function bool
+ed_buffer_save_file(ED_Buffer *buffer, String file_name) {
+	// Writes the lines back with the line breaks the file was loaded with
+	ed_buffer_finish_loading(buffer);
+	
+	String line_break = string_from_lit("\n");
+	if (buffer->line_ending == ED_Line_Ending_CRLF) {
+		line_break = string_from_lit("\r\n");
+	}
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	// The byte counts can include zombie pages, so this may be a bit more than needed
+	String_Builder builder = {0};
+	string_builder_init(&builder, push_sliceu8(scratch.arena, buffer->byte_count + buffer->source_byte_count + buffer->line_count * line_break.len));
+	
+	// Where each page starts in the file, to point them at it afterwards
+	i64 *page_offsets = push_array(scratch.arena, i64, buffer->page_count + 1);
+	i64 page_index = 0;
+	
+	trace_begin("save file");
+	
+	for (ED_Page *page = buffer->first_page; page; page = page->next) {
+		page_offsets[page_index] = builder.len;
+		page_index += 1;
+		
+		if (page->source) {
+			// Unedited, with its line breaks
+			string_builder_append(&builder, string(page->source, page->source_len));
+		} else {
+			for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+				for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+					string_builder_append(&builder, string(span->data, span->len));
+				}
+				
+				bool last_line = (!page->next && line_index == page->line_count - 1);
+				if (!last_line) {
+					string_builder_append(&builder, line_break);
+				}
+			}
+		}
+	}
+	page_offsets[page_index] = builder.len;
+	
+	String contents = string_from_builder(builder);
+	
+	// Sources are about to be rewritten, and Windows can't write to a mapped file anyway. So
+	// are the pages' sources, which snapshots read. A copy saved under another name leaves
+	// them as they are: they still have to match the buffer's own file.
+	bool same_file = string_equals(file_name, buffer->file_name);
+	if (!same_file && buffer->source.data) {
+		File_Info info = file_info(file_name);
+		same_file = (info.ok && info.id == buffer->file_info.id);
+	}
+	
+	bool lazy = (buffer->source.data != NULL && same_file);
+	if (lazy) {
+		ed_buffer_wait_for_snapshots(buffer);
+		ed_buffer_release_source(buffer);
+	}
+	
+	bool ok = write_file(file_name, contents);
+	if (ok && string_equals(file_name, buffer->file_name)) {
+		buffer->file_read_len = contents.len;
+		buffer->file_info = file_info(file_name);
+		buffer->has_unsaved_edits = false;
+	}
+	
+	if (lazy) {
+		// Every page now matches a part of the file that was just written, so they can all be
+		// evicted again. If it can't be mapped back, the pages read from a copy instead.
+		Read_File_Result map_file_result = {0};
+		if (ok) {
+			map_file_result = map_file(file_name);
+		}
+		
+		if (map_file_result.ok && map_file_result.contents.data && map_file_result.contents.len == contents.len) {
+			buffer->source = map_file_result.contents;
+			buffer->source_is_mapped = true;
+		} else {
+			unmap_file(map_file_result.contents);
+			buffer->source.data = mem_reserve_and_commit(max(contents.len, 1)); // Never NULL, even if empty
+			buffer->source.len  = contents.len;
+			buffer->source_is_mapped = false;
+			memcpy(buffer->source.data, contents.data, contents.len);
+		}
+		
+		u8 *base = buffer->source.data;
+		page_index = 0;
+		for (ED_Page *page = buffer->first_page; page; page = page->next) {
+			i64 source_len = page_offsets[page_index + 1] - page_offsets[page_index];
+			if (!page->lines) {
+				buffer->source_byte_count += source_len - page->source_len;
+			}
+			
+			page->source     = base + page_offsets[page_index];
+			page->source_len = source_len;
+			page_index += 1;
+		}
+	}
+	
+	trace_end("save file");
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+static i64
+ed_page_file_len(ED_Buffer *buffer, ED_Page *page) {
+	// Bytes the page takes up in the file, line breaks included
+	i64 result = 0;
+	
+	if (page->source) {
+		result = page->source_len;
+	} else {
+		i64 line_break_len = (buffer->line_ending == ED_Line_Ending_CRLF) ? 2 : 1;
+		for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+			result += ed_line_len(&page->lines[line_index]);
+		}
+		result += line_break_len * (page->line_count - (page->next ? 0 : 1));
+	}
+	
+	return result;
+}
+
+static bool
+ed_page_matches_text(ED_Buffer *buffer, ED_Page *page, SliceU8 text, i64 at) {
+	// Whether the page would be saved as the text from 'at' on. The last page also has to
+	// reach the end of the text, or its last line would go on in it.
+	bool result = true;
+	
+	if (page->source) {
+		result = (at + page->source_len <= text.len && memcmp(page->source, text.data + at, page->source_len) == 0);
+		at += page->source_len;
+	} else {
+		String line_break = string_from_lit("\n");
+		if (buffer->line_ending == ED_Line_Ending_CRLF) {
+			line_break = string_from_lit("\r\n");
+		}
+		
+		for (i64 line_index = 0; result && line_index < page->line_count; line_index += 1) {
+			for (ED_Span *span = page->lines[line_index].first_span; result && span; span = span->next) {
+				result = (at + span->len <= text.len && memcmp(span->data, text.data + at, span->len) == 0);
+				at += span->len;
+			}
+			
+			if (result && (page->next || line_index < page->line_count - 1)) {
+				result = (at + line_break.len <= text.len && memcmp(line_break.data, text.data + at, line_break.len) == 0);
+				at += line_break.len;
+			}
+		}
+	}
+	
+	if (result && !page->next) {
+		result = (at == text.len);
+	}
+	
+	return result;
+}
+
+ed_function bool
+ed_buffer_reload_file(ED_Buffer *buffer) {
+	// Catches up with a file that another program wrote. The pages that still match the start
+	// and the end of the file are kept, with their lines and spans (and whatever was edited in
+	// them); only the ones in between are built again, from the new contents. The cursor and
+	// the scroll stay on the same lines of text.
+	//
+	// The whole file is loaded again instead when no page is kept, when its line breaks
+	// changed, when it moved to the other side of ED_LAZY_MIN_FILE_SIZE, while it is still
+	// loading, when the mapped file was written in place (its old contents are gone), and when
+	// snapshots may read the pages' sources of a mapped file (they are all pointed elsewhere).
+	bool ok = false;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	trace_begin("reload file");
+	
+	String file_name = string_clone(scratch.arena, buffer->file_name); // Loading resets the arena
+	File_Info info = file_info(file_name);
+	bool lazy = (buffer->source.data != NULL);
+	ed_buffer_collect_snapshots(buffer);
+	bool full = (!info.ok || buffer->loader || lazy != (info.size >= ED_LAZY_MIN_FILE_SIZE) ||
+				 (lazy && (info.id == buffer->file_info.id || buffer->snapshot_count > 0)));
+	
+	SliceU8 text = {0};
+	bool have_text = false;
+	if (!full && lazy) {
+		Read_File_Result map_file_result = map_file(file_name);
+		if (map_file_result.ok && map_file_result.contents.data) {
+			text = map_file_result.contents;
+			have_text = true;
+		}
+	} else if (!full) {
+		Read_File_Result read_file_result = read_file(scratch.arena, file_name);
+		if (read_file_result.ok) {
+			text = read_file_result.contents;
+			have_text = true;
+			full = (ed_detect_line_ending(text) != buffer->line_ending);
+		}
+	}
+	
+	// Where the cursor is, before any page is picked: it may have to be read from the source,
+	// which replaces its page
+	Point cursor  = buffer->cursor;
+	i64   vscroll = buffer->vscroll;
+	i64   column  = ed_buffer_position_from_point(buffer, cursor).column;
+	
+	// Pages that match from the start, then from the end. The kept pages end with a line break,
+	// so the text left in between is made of whole lines.
+	ED_Page *first_changed = NULL;
+	ED_Page *last_changed  = NULL;
+	i64 prefix_len = 0;
+	i64 prefix_line_count = 0;
+	i64 suffix_start = text.len;
+	
+	if (!full && have_text) {
+		first_changed = buffer->first_page;
+		while (first_changed && ed_page_matches_text(buffer, first_changed, text, prefix_len)) {
+			prefix_len        += ed_page_file_len(buffer, first_changed);
+			prefix_line_count += first_changed->line_count;
+			first_changed = first_changed->next;
+		}
+		
+		if (first_changed) {
+			bool matching = true;
+			last_changed = buffer->last_page;
+			while (matching && last_changed != first_changed->prev) {
+				i64 start = suffix_start - ed_page_file_len(buffer, last_changed);
+				matching = (start >= prefix_len && (start == 0 || text.data[start - 1] == '\n') &&
+							ed_page_matches_text(buffer, last_changed, text, start));
+				if (matching) {
+					suffix_start = start;
+					last_changed = last_changed->prev;
+				}
+			}
+		}
+		
+		SliceU8 middle = make_sliceu8(text.data + prefix_len, suffix_start - prefix_len);
+		bool lone_lf = (buffer->line_ending == ED_Line_Ending_CRLF && string_find_first(string_from_sliceu8(middle), '\n') >= 0 &&
+						ed_detect_line_ending(middle) != ED_Line_Ending_CRLF);
+		full = (first_changed && ((prefix_len == 0 && suffix_start == text.len) || lone_lf));
+	}
+	
+	if (full) {
+		if (lazy && have_text) {
+			unmap_file(text);
+		}
+		
+		ok = ed_buffer_load_file(buffer, file_name);
+		if (ok) {
+			cursor.y = clamp(0, cursor.y, cast(i32) buffer->line_count - 1);
+			ED_Line *line = ed_line_from_line_number(buffer, cursor.y);
+			cursor.x = cast(i32) ed_buffer_line_position_from_column(buffer, line, cursor.y, column).x;
+			
+			buffer->cursor  = cursor;
+			buffer->vscroll = clamp(0, vscroll, buffer->line_count - 1);
+		}
+	} else if (have_text) {
+		if (first_changed) {
+			SliceU8 middle = make_sliceu8(text.data + prefix_len, suffix_start - prefix_len);
+			bool ends_file = (last_changed == buffer->last_page); // The last line is in the new text
+			
+			// Out with the old lines...
+			ED_Page *kept_page = first_changed->prev; // The last one before them
+			ED_Page *prev      = kept_page;
+			ED_Page *end       = last_changed ? last_changed->next : buffer->first_page;
+			i64 old_line_count = 0;
+			i64 old_page_count = 0;
+			for (ED_Page *page = first_changed; page != end; page = page->next) {
+				old_line_count += page->line_count;
+				old_page_count += 1;
+			}
+			
+			i64 old_end_line = prefix_line_count + old_line_count;
+			ed_buffer_line_indexes_edit(buffer, (Point){0, cast(i32) prefix_line_count}, old_line_count, 0);
+			if (old_page_count > 0) {
+				ed_zombify_pages(buffer, first_changed, last_changed, old_page_count);
+			}
+			
+			// ...in with the new ones, as source pages or regular ones like when loading
+			i64 new_line_count = 0;
+			if (lazy) {
+				SliceU8 source = make_sliceu8(text.data, suffix_start);
+				i64 chunk_start = prefix_len;
+				bool done = (middle.len == 0 && !ends_file);
+				while (!done) {
+					i64 chunk_end = ed_source_chunk_end(source, chunk_start);
+					
+					done = (chunk_end == source.len);
+					String chunk = string(source.data + chunk_start, chunk_end - chunk_start);
+					i64 line_count = string_count_occurrences(chunk, '\n') + ((done && ends_file) ? 1 : 0);
+					
+					ED_Page *page = ed_alloc_source_page(buffer, chunk.data, chunk.len, line_count);
+					ed_buffer_link_page(buffer, prev, page);
+					prev = page;
+					new_line_count += line_count;
+					
+					chunk_start = chunk_end;
+				}
+			} else {
+				SliceU8 contents = push_sliceu8(scratch.arena, middle.len);
+				memcpy(contents.data, middle.data, middle.len);
+				if (buffer->line_ending == ED_Line_Ending_CRLF) {
+					contents.len = ed_strip_crlf(contents);
+				}
+				
+				ED_Page *page = NULL;
+				i64 line_start = 0;
+				for (i64 byte_index = 0; byte_index <= contents.len; byte_index += 1) {
+					bool line_ends = (byte_index < contents.len) ? (contents.data[byte_index] == '\n') : ends_file;
+					if (line_ends) {
+						if (!page || page->line_count >= ED_PAGE_SIZE) {
+							page = ed_alloc_page(buffer);
+							ed_buffer_link_page(buffer, prev, page);
+							prev = page;
+						}
+						
+						ED_Line *line = &page->lines[page->line_count];
+						page->line_count += 1;
+						ed_line_fill(buffer, line, string(contents.data + line_start, byte_index - line_start));
+						
+						new_line_count += 1;
+						line_start = byte_index + 1;
+					}
+				}
+			}
+			
+			buffer->line_count += new_line_count - old_line_count;
+			buffer->edit_count += 1;
+			ed_buffer_highlight_edit(buffer, prefix_line_count, old_line_count, new_line_count);
+			buffer->has_invalid_utf8 = buffer->has_invalid_utf8 || !utf8_validate(string_from_sliceu8(middle));
+			
+			buffer->touched_page       = kept_page ? kept_page : buffer->first_page;
+			buffer->touched_line_count = buffer->touched_page->line_count + new_line_count + 1;
+			
+			// The lines after the changed ones moved by as many lines as it grew, the ones in it
+			// stay in it
+			i64 line_delta = new_line_count - old_line_count;
+			if (cursor.y >= old_end_line) {
+				cursor.y += cast(i32) line_delta;
+			} else if (cursor.y >= prefix_line_count) {
+				cursor.y = cast(i32) min(cursor.y, prefix_line_count + max(new_line_count - 1, 0));
+			}
+			cursor.y = clamp(0, cursor.y, cast(i32) buffer->line_count - 1);
+			
+			ED_Line *line = ed_line_from_line_number(buffer, cursor.y);
+			cursor.x = cast(i32) ed_buffer_line_position_from_column(buffer, line, cursor.y, column).x;
+			buffer->cursor = cursor;
+			
+			if (vscroll >= old_end_line) {
+				vscroll += line_delta;
+			}
+			buffer->vscroll = clamp(0, vscroll, buffer->line_count - 1);
+		}
+		
+		if (lazy) {
+			// Every page with a source now gets it from the new mapping
+			i64 offset = 0;
+			for (ED_Page *page = buffer->first_page; page; page = page->next) {
+				i64 len = ed_page_file_len(buffer, page);
+				if (page->source) {
+					page->source = text.data + offset;
+				}
+				offset += len;
+			}
+			assert(offset == text.len);
+			
+			ed_buffer_release_source(buffer);
+			buffer->source = text;
+			buffer->source_is_mapped = true;
+		}
+		
+		buffer->file_info = info;
+		buffer->file_read_len = text.len;
+		buffer->has_unsaved_edits = false;
+		ok = true;
+	}
+	
+	trace_end("reload file");
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+static void
+ed_buffer_append_text(ED_Buffer *buffer, String text) {
+	// At the end of the last line, wherever the cursor is
+	if (text.len > 0) {
+		ED_Line *last_line = ed_line_from_line_number(buffer, buffer->line_count - 1);
+		Point end = { cast(i32) ed_line_len(last_line), cast(i32) (buffer->line_count - 1) };
+		ed_buffer_insert_text_at_point(buffer, end, text);
+	}
+}
+
+ed_function i64
+ed_buffer_append_file_tail(ED_Buffer *buffer) {
+	// Adds what was written at the end of the file since it was read to the end of the buffer,
+	// whatever was edited in the meantime. Returns the bytes taken, or -1 if the file got
+	// shorter (it was truncated or replaced): then only loading it again makes sense.
+	i64 result = 0;
+	
+	i64 size = file_size(buffer->file_name);
+	if (size < buffer->file_read_len) {
+		result = -1;
+	} else if (size > buffer->file_read_len && !buffer->loader) {
+		Scratch scratch = scratch_begin(0, 0);
+		
+		trace_begin("append file tail");
+		
+		Read_File_Result read_file_result = read_file_range(scratch.arena, buffer->file_name, buffer->file_read_len,
+															size - buffer->file_read_len);
+		if (read_file_result.ok) {
+			SliceU8 text = read_file_result.contents;
+			i64 taken = text.len;
+			
+			if (buffer->line_ending == ED_Line_Ending_CRLF) {
+				// A CR at the very end may be half of a CRLF: leave it for next time
+				if (text.len > 0 && text.data[text.len - 1] == '\r') {
+					text.len -= 1;
+					taken    -= 1;
+				}
+				text.len = ed_strip_crlf(text);
+			}
+			
+			ed_buffer_append_text(buffer, string_from_sliceu8(text));
+			
+			buffer->file_read_len += taken;
+			result = taken;
+		}
+		
+		trace_end("append file tail");
+		
+		scratch_end(scratch);
+	}
+	
+	return result;
+}
+
+static ED_Line_Ending
+ed_detect_line_ending(SliceU8 contents) {
+	// CRLF only if every LF comes after a CR. Files that mix both keep their CRs in the
+	// text, so they still save back exactly as they were.
+	bool seen_lf = false;
+	bool seen_lone_lf = false;
+	
+	u8 *data = contents.data;
+	i64 i = 0;
+	
+	if (contents.len > 0 && data[0] == '\n') {
+		seen_lf = true;
+		seen_lone_lf = true;
+	}
+	i = 1;
+	
+#if ARCH_X64
+	// 16 bytes at a time, comparing each byte with the one before it
+	__m128i lf = _mm_set1_epi8('\n');
+	__m128i cr = _mm_set1_epi8('\r');
+	for (; !seen_lone_lf && i + 16 <= contents.len; i += 16) {
+		__m128i here = _mm_loadu_si128(cast(__m128i *) (data + i));
+		__m128i prev = _mm_loadu_si128(cast(__m128i *) (data + i - 1));
+		
+		int lf_mask   = _mm_movemask_epi8(_mm_cmpeq_epi8(here, lf));
+		int crlf_mask = lf_mask & _mm_movemask_epi8(_mm_cmpeq_epi8(prev, cr));
+		
+		seen_lf      = seen_lf || (lf_mask != 0);
+		seen_lone_lf = (lf_mask != crlf_mask);
+	}
+#endif
+	
+	for (; !seen_lone_lf && i < contents.len; i += 1) {
+		if (data[i] == '\n') {
+			seen_lf = true;
+			seen_lone_lf = (data[i - 1] != '\r');
+		}
+	}
+	
+	ED_Line_Ending result = ED_Line_Ending_LF;
+	if (seen_lf && !seen_lone_lf) {
+		result = ED_Line_Ending_CRLF;
+	}
+	
+	return result;
+}
+
+static i64
+ed_strip_crlf(SliceU8 contents) {
+	// Turns every CRLF into an LF, in place. Returns the new length.
+	u8 *data = contents.data;
+	i64 read  = 0;
+	i64 write = 0;
+	
+#if ARCH_X64
+	// Blocks without a CRLF are moved down in one go, the others byte by byte. The block
+	// is loaded before the store, and 'write' never passes 'read', so nothing unread is
+	// overwritten.
+	__m128i lf = _mm_set1_epi8('\n');
+	__m128i cr = _mm_set1_epi8('\r');
+	for (; read + 17 <= contents.len; read += 16) {
+		__m128i here = _mm_loadu_si128(cast(__m128i *) (data + read));
+		__m128i next = _mm_loadu_si128(cast(__m128i *) (data + read + 1));
+		
+		int cr_mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, cr), _mm_cmpeq_epi8(next, lf)));
+		if (cr_mask == 0) {
+			_mm_storeu_si128(cast(__m128i *) (data + write), here);
+			write += 16;
+		} else {
+			for (i64 j = 0; j < 16; j += 1) {
+				data[write] = data[read + j];
+				write += ((cr_mask >> j) & 1) ^ 1;
+			}
+		}
+	}
+#endif
+	
+	for (; read < contents.len; read += 1) {
+		bool is_crlf = (data[read] == '\r' && read + 1 < contents.len && data[read + 1] == '\n');
+		if (!is_crlf) {
+			data[write] = data[read];
+			write += 1;
+		}
+	}
+	
+	return write;
+}
+
+//- Autosave functions
+
+ed_function String
+ed_swap_file_name(Arena *arena, String file_name) {
+	// Next to the file
+	return push_stringf(arena, "%.*s.swp", string_expand(file_name));
+}
+
+ed_function void
+ed_buffer_start_autosave(ED_Buffer *buffer) {
+	// From now on, ed_buffer_update_autosave writes the buffer to its swap file when due. The
+	// first run replaces whatever swap file there was, and it goes once there's nothing unsaved.
+	assert(buffer->file_name.len > 0); // Validate args
+	
+	if (!buffer->autosave) {
+		ED_Autosave *autosave = mem_reserve_and_commit(sizeof(ED_Autosave));
+		assert(autosave);
+		
+		arena_init(&autosave->arena);
+		arena_init(&autosave->record_arenas[0]);
+		arena_init(&autosave->record_arenas[1]);
+		autosave->swap_file_name     = ed_swap_file_name(&autosave->arena, buffer->file_name);
+		autosave->new_swap_file_name = push_stringf(&autosave->arena, "%.*s.new", string_expand(autosave->swap_file_name));
+		autosave->edit_count = buffer->edit_count;
+		autosave->start_ns   = get_time_ns();
+		autosave->has_swap   = file_info(autosave->swap_file_name).ok;
+		
+		buffer->autosave = autosave;
+	}
+}
+
+ed_function void
+ed_buffer_update_autosave(ED_Buffer *buffer, bool idle) {
+	// Starts a run if one is due: when the buffer changed since the last one and has unsaved
+	// edits, ED_AUTOSAVE_INTERVAL_MS after the last one, or right away if the editor is idle.
+	// Costs a snapshot and starting a thread. Once the edits are saved, the swap file goes.
+	ED_Autosave *autosave = buffer->autosave;
+	
+	if (autosave && autosave->thread.handle && atomic_load_u64(&autosave->is_done)) {
+		thread_join(autosave->thread);
+		autosave->thread  = (Thread){0};
+		autosave->is_done = 0;
+		
+		autosave->retry = !autosave->ok;
+	}
+	
+	if (autosave && !autosave->thread.handle) {
+		u64 now = get_time_ns();
+		bool due = (idle || now - autosave->start_ns >= ED_AUTOSAVE_INTERVAL_MS * 1000000ULL);
+		
+		if (!buffer->has_unsaved_edits) {
+			if (autosave->has_swap) {
+				delete_file(autosave->swap_file_name);
+				autosave->has_swap = false;
+			}
+		} else if (due && (autosave->edit_count != buffer->edit_count || autosave->retry) && !buffer->loader) {
+			ED_Snapshot *snapshot = ed_buffer_take_snapshot(buffer);
+			if (snapshot) {
+				// Parts of the file can only be pointed at while it is the one that was loaded.
+				// Once another program wrote to it, every page is copied.
+				File_Info info = file_info(buffer->file_name);
+				if (!info.ok || info.size != buffer->file_info.size ||
+					info.modified_time != buffer->file_info.modified_time || info.id != buffer->file_info.id) {
+					info = (File_Info){0};
+				}
+				
+				// The entries reading from the file would be wrong once it changed, and a swap
+				// file that is mostly garbage is better written again
+				File_Info saved_info = autosave->saved_file_info;
+				i64 garbage_len = autosave->swap_len - cast(i64) sizeof(ED_Swap_Header) - autosave->live_len;
+				autosave->start_over = (!autosave->has_swap || saved_info.ok != info.ok ||
+										saved_info.size != info.size ||
+										saved_info.modified_time != info.modified_time ||
+										saved_info.id != info.id ||
+										garbage_len > max(autosave->live_len, ED_AUTOSAVE_MIN_GARBAGE));
+				
+				autosave->snapshot   = snapshot;
+				autosave->file_info  = info;
+				autosave->edit_count = buffer->edit_count;
+				autosave->start_ns   = now;
+				autosave->retry      = false;
+				autosave->thread = thread_start(ed_autosave_proc, autosave);
+			}
+		}
+	}
+}
+
+ed_function void
+ed_buffer_stop_autosave(ED_Buffer *buffer) {
+	// Waits for the run going on, if any. The swap file stays if it has edits that weren't saved.
+	ED_Autosave *autosave = buffer->autosave;
+	
+	if (autosave) {
+		if (autosave->thread.handle) {
+			thread_join(autosave->thread);
+		}
+		
+		if (!buffer->has_unsaved_edits && autosave->has_swap) {
+			delete_file(autosave->swap_file_name);
+		}
+		
+		arena_fini(&autosave->arena);
+		arena_fini(&autosave->record_arenas[0]);
+		arena_fini(&autosave->record_arenas[1]);
+		mem_release(autosave, sizeof(ED_Autosave));
+		buffer->autosave = NULL;
+	}
+}
+
+static void
+ed_autosave_proc(void *data) {
+	// One run: the pages that changed since the last one are appended to the swap file, then
+	// an index of the whole text, then the header is pointed at it. When starting over, every
+	// page is written to a new swap file, which then replaces the old one.
+	ED_Autosave *autosave = data;
+	ED_Snapshot *snapshot = autosave->snapshot;
+	SliceU8 source = snapshot->source;
+	
+	trace_begin("autosave");
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	String line_break = string_from_lit("\n");
+	if (snapshot->line_ending == ED_Line_Ending_CRLF) {
+		line_break = string_from_lit("\r\n");
+	}
+	
+	bool start_over = autosave->start_over;
+	String swap_file_name = start_over ? autosave->new_swap_file_name : autosave->swap_file_name;
+	
+	ED_Swap_Record *old_records = autosave->records;
+	i64 old_record_count = start_over ? 0 : autosave->record_count;
+	i64 old_record_index = 0;
+	
+	i64 page_count = 0;
+	for (ED_Page *page = ed_snapshot_next_page(snapshot, NULL); page; page = ed_snapshot_next_page(snapshot, page)) {
+		page_count += 1;
+	}
+	
+	// The records of this run go in the other arena, the last run's are still needed
+	Arena *record_arena = &autosave->record_arenas[autosave->record_arena_index ^ 1];
+	arena_reset(record_arena);
+	ED_Swap_Record *records = push_array(record_arena, ED_Swap_Record, page_count);
+	i64 record_count = 0;
+	i64 live_len = 0;
+	
+	ED_Swap_Entry *entries = push_array(scratch.arena, ED_Swap_Entry, page_count);
+	i64 entry_count = 0;
+	
+	ED_Swap_Writer writer = {0};
+	writer.file   = open_file_for_writing(swap_file_name, start_over);
+	writer.offset = start_over ? cast(i64) sizeof(ED_Swap_Header) : autosave->swap_len;
+	writer.ok     = writer.file.ok;
+	string_builder_init(&writer.builder, push_sliceu8(scratch.arena, ED_AUTOSAVE_WRITE_SIZE));
+	i64 start_offset = writer.offset;
+	
+	ED_Page *page      = ed_snapshot_next_page(snapshot, NULL);
+	ED_Page *last_page = NULL;
+	while (page && writer.ok && !atomic_load_u64(&snapshot->should_stop)) {
+		ED_Page *next = ed_snapshot_next_page(snapshot, page);
+		ED_Swap_Entry entry = {0};
+		
+		if (autosave->file_info.ok && page->source && page->source >= source.data &&
+			page->source + page->source_len <= source.data + source.len) {
+			// Unedited, the file has it
+			entry.offset    = page->source - source.data;
+			entry.len       = page->source_len;
+			entry.from_file = 1;
+		} else {
+			// The pages that are still in the swap file as they were come in the same order as
+			// their records, so the search for each one goes on from the last one found
+			bool found = false;
+			if (page->epoch <= autosave->saved_epoch && page != autosave->last_page && next) {
+				i64 record_index = old_record_index;
+				while (record_index < old_record_count && old_records[record_index].page != page) {
+					record_index += 1;
+				}
+				
+				if (record_index < old_record_count) {
+					entry.offset = old_records[record_index].offset;
+					entry.len    = old_records[record_index].len;
+					old_record_index = record_index + 1;
+					found = true;
+				}
+			}
+			
+			if (!found) {
+				entry.offset = writer.offset + writer.builder.len;
+				if (page->source) {
+					// Unedited, but the file changed since: its bytes as they were loaded, which
+					// the snapshot keeps mapped. Possibly never split into lines.
+					ed_swap_writer_append(&writer, string(page->source, page->source_len));
+				} else {
+					for (i64 line_index = 0; line_index < page->line_count; line_index += 1) {
+						for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+							ed_swap_writer_append(&writer, string(span->data, span->len));
+						}
+						
+						if (next || line_index < page->line_count - 1) {
+							ed_swap_writer_append(&writer, line_break);
+						}
+					}
+				}
+				entry.len = writer.offset + writer.builder.len - entry.offset;
+			}
+			
+			records[record_count].page   = page;
+			records[record_count].offset = entry.offset;
+			records[record_count].len    = entry.len;
+			record_count += 1;
+			live_len += entry.len;
+		}
+		
+		// Right after the last one, in the same file: one entry for both
+		ED_Swap_Entry *last = (entry_count > 0) ? &entries[entry_count - 1] : NULL;
+		if (last && last->from_file == entry.from_file && last->offset + last->len == entry.offset) {
+			last->len += entry.len;
+		} else {
+			entries[entry_count] = entry;
+			entry_count += 1;
+		}
+		
+		last_page = page;
+		page = next;
+	}
+	bool complete = (page == NULL);
+	
+	ed_swap_writer_flush(&writer);
+	i64 index_offset = writer.offset;
+	ed_swap_writer_append(&writer, string(cast(u8 *) entries, entry_count * sizeof(ED_Swap_Entry)));
+	ed_swap_writer_flush(&writer);
+	
+	ED_Swap_Header header = {0};
+	header.magic        = ED_SWAP_MAGIC;
+	header.version      = ED_SWAP_VERSION;
+	header.index_offset = index_offset;
+	header.index_count  = entry_count;
+	header.file_size          = autosave->file_info.size;
+	header.file_modified_time = autosave->file_info.modified_time;
+	
+	bool ok = (complete && writer.ok && write_file_range(writer.file, 0, string(cast(u8 *) &header, sizeof(header))));
+	if (writer.file.ok) {
+		ok = close_file(writer.file) && ok;
+	}
+	
+	if (start_over) {
+		if (ok) {
+			ok = replace_file(autosave->new_swap_file_name, autosave->swap_file_name);
+		} else {
+			delete_file(autosave->new_swap_file_name);
+		}
+	}
+	
+	// A run that didn't go through leaves the last one's records as they were. What it
+	// appended is written over by the next one.
+	if (ok) {
+		autosave->records      = records;
+		autosave->record_count = record_count;
+		autosave->record_arena_index ^= 1;
+		autosave->last_page       = last_page;
+		autosave->saved_epoch     = snapshot->epoch;
+		autosave->saved_file_info = autosave->file_info;
+		autosave->swap_len = writer.offset;
+		autosave->live_len = live_len;
+		autosave->has_swap = true;
+	}
+	autosave->ok = ok;
+	autosave->written_len = writer.offset - start_offset;
+	
+	scratch_end(scratch);
+	
+	trace_end("autosave");
+	
+	ed_snapshot_release(snapshot);
+	atomic_store_u64(&autosave->is_done, 1);
+}
+
+static void
+ed_swap_writer_append(ED_Swap_Writer *writer, String text) {
+	// Writes what was gathered first if the text doesn't fit, and the text right away if it
+	// wouldn't fit anyway
+	if (writer->builder.len + text.len > writer->builder.cap) {
+		ed_swap_writer_flush(writer);
+	}
+	
+	if (text.len > writer->builder.cap) {
+		writer->ok = writer->ok && write_file_range(writer->file, writer->offset, text);
+		writer->offset += text.len;
+	} else {
+		string_builder_append(&writer->builder, text);
+	}
+}
+
+static void
+ed_swap_writer_flush(ED_Swap_Writer *writer) {
+	if (writer->builder.len > 0) {
+		writer->ok = writer->ok && write_file_range(writer->file, writer->offset, string_from_builder(writer->builder));
+		writer->offset += writer->builder.len;
+		writer->builder.len = 0;
+	}
+}
+
+ed_function Read_File_Result
+ed_swap_file_contents(Arena *arena, String file_name) {
+	// The text of the last autosave of the file, as it would have been saved. Fails if there's
+	// no swap file or it is damaged, or if it needs parts of the file and the file changed.
+	Read_File_Result result = {0};
+	
+	Scratch scratch = scratch_begin(&arena, 1);
+	
+	Read_File_Result swap = read_file(scratch.arena, ed_swap_file_name(scratch.arena, file_name));
+	u64 swap_len = swap.contents.len;
+	
+	ED_Swap_Header header = {0};
+	bool ok = (swap.ok && swap_len >= sizeof(ED_Swap_Header));
+	if (ok) {
+		memcpy(&header, swap.contents.data, sizeof(ED_Swap_Header));
+		ok = (header.magic == ED_SWAP_MAGIC && header.version == ED_SWAP_VERSION && header.index_offset <= swap_len &&
+			  header.index_count <= (swap_len - header.index_offset) / sizeof(ED_Swap_Entry));
+	}
+	
+	// Copied out, the index may not be aligned in the file
+	ED_Swap_Entry *entries = NULL;
+	u64 len = 0;
+	bool reads_file = false;
+	if (ok) {
+		entries = push_array(scratch.arena, ED_Swap_Entry, header.index_count);
+		memcpy(entries, swap.contents.data + header.index_offset, header.index_count * sizeof(ED_Swap_Entry));
+		
+		for (u64 i = 0; ok && i < header.index_count; i += 1) {
+			ED_Swap_Entry entry = entries[i];
+			u64 end = entry.from_file ? cast(u64) header.file_size : swap_len;
+			ok = (entry.len <= end && entry.offset <= end - entry.len);
+			reads_file = reads_file || entry.from_file;
+			len += entry.len;
+		}
+	}
+	
+	Read_File_Result map_file_result = {0};
+	if (ok && reads_file) {
+		File_Info info = file_info(file_name);
+		ok = (info.ok && info.size == header.file_size && info.modified_time == header.file_modified_time);
+		if (ok) {
+			map_file_result = map_file(file_name);
+			ok = (map_file_result.ok && map_file_result.contents.len == header.file_size);
+		}
+	}
+	
+	if (ok) {
+		result.contents = push_sliceu8(arena, len);
+		
+		u8 *at = result.contents.data;
+		for (u64 i = 0; i < header.index_count; i += 1) {
+			ED_Swap_Entry entry = entries[i];
+			if (entry.len > 0) {
+				u8 *from = entry.from_file ? map_file_result.contents.data : swap.contents.data;
+				memcpy(at, from + entry.offset, entry.len);
+				at += entry.len;
+			}
+		}
+		result.ok = true;
+	}
+	
+	unmap_file(map_file_result.contents);
+	scratch_end(scratch);
+	
+	return result;
+}
+
+ed_function bool
+ed_buffer_recover_file(ED_Buffer *buffer, String file_name) {
+	// Like ed_buffer_load_file, with the text of the last autosave instead of the file's, read
+	// as a whole even if it is big. The buffer still saves to the file, and has unsaved edits.
+	bool ok = false;
+	
+	Scratch scratch = scratch_begin(0, 0);
+	
+	Read_File_Result swap_file_contents = ed_swap_file_contents(scratch.arena, file_name);
+	if (swap_file_contents.ok) {
+		ed_buffer_reset_arena(buffer);
+		ed_buffer_release_source(buffer);
+		ed_buffer_stop_streaming(buffer);
+		
+		SliceU8 contents = swap_file_contents.contents;
+		ED_Line_Ending line_ending = ed_detect_line_ending(contents);
+		if (line_ending == ED_Line_Ending_CRLF) {
+			contents.len = ed_strip_crlf(contents);
+		}
+		
+		ed_init_buffer_contents(buffer, contents);
+		buffer->line_ending = line_ending;
+		buffer->has_invalid_utf8 = !utf8_validate(string_from_sliceu8(contents));
+		
+		buffer->file_name = string_clone(&buffer->arena, file_name);
+		buffer->name      = buffer->file_name;
+		buffer->highlight.language = ed_language_from_file_name(file_name);
+		buffer->file_info = file_info(file_name);
+		buffer->file_read_len = max(buffer->file_info.size, 0);
+		buffer->has_unsaved_edits = true;
+		
+		ok = true;
+	}
+	
+	scratch_end(scratch);
+	return ok;
+}
+
+//- Buffer maintenance functions
+
+ed_function f32
+ed_buffer_fragmentation(ED_Buffer *buffer) {
+	// Ratio between the spans in use and the spans a freshly loaded copy of the buffer
+	// would need (each line takes at least one): 1 means perfectly packed.
+	f32 result = 1;
+	
+	i64 ideal_span_count = buffer->line_count + buffer->byte_count / ED_SPAN_SIZE;
+	if (ideal_span_count > 0) {
+		result = cast(f32) buffer->span_count / cast(f32) ideal_span_count;
+	}
+	
+	return result;
+}
+
+ed_function bool
+ed_buffer_should_compact(ED_Buffer *buffer, bool idle) {
+	bool result = false;
+	
+	// The null buffer lives in the global arena, there's nothing to release. The snapshots
+	// alive read from the arena.
+	if (buffer->arena.ptr && buffer->span_count >= ED_COMPACT_MIN_SPAN_COUNT && buffer->snapshot_count == 0) {
+		f32 threshold = idle ? ED_COMPACT_IDLE_FRAGMENTATION : ED_COMPACT_FRAGMENTATION;
+		
+		// Spans given back to the pool still hold on to their arena memory
+		u64 live_bytes = (cast(u64) buffer->span_count * ED_SPAN_BLOCK_SIZE +
+						  cast(u64) buffer->page_count * ED_PAGE_BLOCK_SIZE);
+		
+		result = (ed_buffer_fragmentation(buffer) > threshold ||
+				  cast(f32) buffer->arena.pos > threshold * cast(f32) live_bytes);
+	}
+	
+	return result;
+}
+
+ed_function void
+ed_buffer_compact(ED_Buffer *buffer) {
+	// Rewrite all the pages, lines and spans into a fresh arena, in document order and
+	// with every page and span filled up, then throw the old arena away.
+	
+	trace_begin("compact");
+	
+	// The old arena goes away, but the counts must add up
+	ed_buffer_collect_snapshots(buffer);
+	assert(buffer->snapshot_count == 0 && !buffer->first_retired_page && !buffer->first_retired_memory);
+	ed_buffer_reclaim_zombie_pages(buffer, buffer->zombie_page_count);
+	
+	ED_Buffer compact = {0};
+	arena_init_flags(&compact.arena, buffer->arena.cap, buffer->arena.flags);
+	pool_init(&compact.pool, &compact.arena);
+	compact.epoch = buffer->epoch;
+	compact.snapshot_epoch = buffer->snapshot_epoch;
+	
+	ED_Page *dest_page = NULL;
+	
+	for (ED_Page *page = buffer->first_page; page; page = page->next) {
+		// Unedited pages keep to themselves, so that they can go back to their part of the source
+		if (page->source) {
+			dest_page = NULL;
+		}
+		
+		if (!page->lines) {
+			// Source pages have nothing to compact
+			ED_Page *source_page = ed_alloc_source_page(&compact, page->source, page->source_len, page->line_count);
+			dll_push_back(compact.first_page, compact.last_page, source_page);
+			compact.line_count += page->line_count;
+		}
+		
+		for (i64 line_index = 0; line_index < page->line_count && page->lines; line_index += 1) {
+			ED_Line *src_line = &page->lines[line_index];
+			
+			if (!dest_page || dest_page->line_count == ED_PAGE_SIZE) {
+				dest_page = ed_alloc_page(&compact);
+				dll_push_back(compact.first_page, compact.last_page, dest_page);
+			}
+			
+			ED_Line *dest_line = &dest_page->lines[dest_page->line_count];
+			dest_page->line_count += 1;
+			compact.line_count += 1;
+			
+			ED_Span *dest_span = ed_alloc_span(&compact);
+			dest_line->first_span = dest_span;
+			dest_line->last_span  = dest_span;
+			dest_line->lex_state  = src_line->lex_state;
+			
+			// Empty and half-empty spans disappear here
+			for (ED_Span *src_span = src_line->first_span; src_span; src_span = src_span->next) {
+				dest_span = ed_span_append_text_without_newlines(&compact, dest_line, dest_span,
+																 string(src_span->data, src_span->len));
+			}
+			
+			compact.byte_count += ed_line_len(dest_line);
+		}
+		
+		if (page->source && page->lines) {
+			dest_page->source     = page->source;
+			dest_page->source_len = page->source_len;
+			dest_page = NULL;
+		}
+	}
+	
+	assert(compact.line_count == buffer->line_count);
+	assert(compact.byte_count == buffer->byte_count);
+	assert(compact.source_byte_count == buffer->source_byte_count);
+	
+	compact.file_name = string_clone(&compact.arena, buffer->file_name);
+	compact.name      = compact.file_name;
+	if (buffer->name.data != buffer->file_name.data) {
+		compact.name = string_clone(&compact.arena, buffer->name);
+	}
+	
+	compact.is_read_only = buffer->is_read_only;
+	compact.line_ending  = buffer->line_ending;
+	compact.has_invalid_utf8 = buffer->has_invalid_utf8;
+	compact.file_read_len = buffer->file_read_len;
+	compact.file_info = buffer->file_info;
+	compact.has_unsaved_edits = buffer->has_unsaved_edits;
+	compact.source = buffer->source;
+	compact.source_is_mapped = buffer->source_is_mapped;
+	compact.loader = buffer->loader;
+	compact.stream = buffer->stream;
+	compact.autosave = buffer->autosave;
+	compact.highlight = buffer->highlight;
+	compact.edit_count = buffer->edit_count + 1; // The lines moved
+	compact.cursor  = buffer->cursor;
+	compact.vscroll = buffer->vscroll;
+	compact.hscroll = buffer->hscroll;
+	compact.viewport_height = buffer->viewport_height;
+	compact.oldest_snapshot_epoch = buffer->oldest_snapshot_epoch;
+	
+	arena_fini(&buffer->arena);
+	*buffer = compact;
+	buffer->pool.arena = &buffer->arena; // It pointed to the local copy
+	
+	trace_end("compact");
+}
+
+//- Layout functions
+
+// Expands tab characters to spaces
+static String
+ed_render_string_from_stored_string(Arena *arena, String stored_string) {
+	int tab_count = 0;
+	for (i64 i = 0; i < stored_string.len; i += 1) {
+		if (stored_string.data[i] == '\t') {
+			tab_count += 1;
+		}
+	}
+	
+	String result;
+	result.len  = stored_string.len + tab_count*(ED_TAB_WIDTH - 1);
+	result.data = push_nozero(arena, result.len * sizeof(u8));
+	
+	i64 write_index = 0;
+	for (i64 read_index = 0; read_index < stored_string.len; read_index += 1) {
+		if (stored_string.data[read_index] == '\t') {
+			for (i64 i = 0; i < ED_TAB_WIDTH; i += 1) {
+				result.data[write_index + i] = ' ';
+			}
+			write_index += ED_TAB_WIDTH;
+		} else {
+			result.data[write_index] = stored_string.data[read_index];
+			write_index += 1;
+		}
+	}
+	
+	return result;
+}
+
+static i64
+ed_render_x_from_stored_x(String stored_string, i64 stored_x) {
+	// Columns before the byte, counting tabs and wide characters
+	i64 result = 0;
+	
+	i64 i = 0;
+	while (i < stored_x) {
+		UTF8_Decode decode = utf8_decode(stored_string.data + i, stored_string.len - i);
+		result += ed_codepoint_columns(decode.codepoint);
+		i      += decode.len;
+	}
+	
+	return result;
+}
+
+ed_function String
+ed_render_line_window(Arena *arena, ED_Line_Position start, i64 first_column, i64 column_count) {
+	// What the terminal shows of a line from 'first_column', at most 'column_count' columns
+	// wide, starting from the position of that column (as given by ed_buffer_line_position_from_column).
+	// Tabs become spaces, invalid bytes U+FFFD, and wide characters cut by the edges of the
+	// window are replaced by spaces.
+	// Room for the widest encoding per column (zero width codepoints are cut when it runs out).
+	// Only the written part is read back, so it isn't cleared.
+	String_Builder builder = {0};
+	string_builder_init(&builder, make_sliceu8(push_nozero(arena, 4 * column_count), 4 * column_count));
+	
+	ed_render_line_run(&builder, start, INT64_MAX, first_column, column_count);
+	
+	return string_from_builder(builder);
+}
+
+ed_function ED_Line_Position
+ed_render_line_run(String_Builder *builder, ED_Line_Position position, i64 end_x, i64 first_column, i64 column_count) {
+	// Appends the part of the window that the bytes from 'position' up to 'end_x' take, and
+	// returns where it stopped, which the next part goes on from. Parts must end on codepoint
+	// boundaries.
+	String replacement = string_from_lit("\xEF\xBF\xBD");
+	
+	i64 column = max(first_column, position.column);
+	i64 end_column = first_column + column_count;
+	
+	while (column < end_column && position.x < end_x && !ed_line_position_is_end(position)) {
+		position = ed_line_position_normalize(position);
+		
+		// Fast path: ASCII is copied as it is and tabs are expanded in place, up to the end of
+		// the span or the first byte of a multi-byte sequence
+		i64 run_len = 0;
+		if (position.column >= first_column) {
+			u8 *data = position.span->data + position.in_span;
+			i64 available = min(position.span->len - position.in_span, end_x - position.x);
+			
+			// Written straight into the builder while there's room for a whole tab (zero width
+			// codepoints take bytes but no columns, so the room isn't guaranteed)
+			while (run_len < available && column < end_column && data[run_len] < 0x80 &&
+				   builder->cap - builder->len >= ED_TAB_WIDTH) {
+				if (data[run_len] == '\t') {
+					// Only the visible part of a tab cut by the right edge
+					i64 visible_len = min(ED_TAB_WIDTH, end_column - column);
+					memset(builder->data + builder->len, ' ', visible_len);
+					builder->len += visible_len;
+					column       += ED_TAB_WIDTH;
+				} else {
+					builder->data[builder->len] = data[run_len];
+					builder->len += 1;
+					column       += 1;
+				}
+				run_len += 1;
+			}
+		}
+		
+		if (run_len > 0) {
+			position.in_span += run_len;
+			position.x       += run_len;
+			position.column   = column;
+		} else {
+			UTF8_Decode decode = ed_line_decode_at(position);
+			ED_Line_Position next = ed_line_next_position(position);
+			
+			bool whole = (position.column >= first_column && next.column <= end_column);
+			bool is_invalid = (decode.len == 1 && decode.codepoint == UTF8_REPLACEMENT_CHARACTER);
+			
+			if (decode.codepoint == '\t' || !whole) {
+				// Only the visible part of tabs and cut characters
+				i64 visible_end = min(next.column, end_column);
+				for (i64 c = column; c < visible_end; c += 1) {
+					string_builder_append(builder, string_from_lit(" "));
+				}
+			} else if (is_invalid) {
+				string_builder_append(builder, replacement);
+			} else if (position.in_span + decode.len <= position.span->len) {
+				string_builder_append(builder, string(position.span->data + position.in_span, decode.len));
+			} else {
+				// The bytes are split between spans
+				ED_Line_Position byte_position = position;
+				for (i64 i = 0; i < decode.len; i += 1) {
+					byte_position = ed_line_position_normalize(byte_position);
+					string_builder_append(builder, string(byte_position.span->data + byte_position.in_span, 1));
+					byte_position.in_span += 1;
+				}
+			}
+			
+			column   = max(column, next.column);
+			position = next;
+		}
+	}
+	
+	return position;
+}
+
+//- Highlighting functions
+
+static ED_Language
+ed_language_from_file_name(String file_name) {
+	String extensions[] = {
+		string_from_lit(".c"),   string_from_lit(".h"),   string_from_lit(".cpp"), string_from_lit(".hpp"),
+		string_from_lit(".cc"),  string_from_lit(".hh"),  string_from_lit(".cxx"), string_from_lit(".hxx"),
+		string_from_lit(".inl"), string_from_lit(".m"),
+	};
+	
+	ED_Language result = ED_Language_NONE;
+	for (i64 i = 0; i < array_count(extensions); i += 1) {
+		String extension = extensions[i];
+		if (file_name.len > extension.len &&
+			string_equals(string(file_name.data + file_name.len - extension.len, extension.len), extension)) {
+			result = ED_Language_C;
+		}
+	}
+	
+	return result;
+}
+
+static ED_Token_Kind
+ed_token_kind_from_word(String word) {
+	static String keywords[] = {
+		string_lit_init("auto"), string_lit_init("break"), string_lit_init("case"), string_lit_init("const"),
+		string_lit_init("continue"), string_lit_init("default"), string_lit_init("do"), string_lit_init("else"),
+		string_lit_init("enum"), string_lit_init("extern"), string_lit_init("for"), string_lit_init("goto"),
+		string_lit_init("if"), string_lit_init("inline"), string_lit_init("register"), string_lit_init("restrict"),
+		string_lit_init("return"), string_lit_init("sizeof"), string_lit_init("static"), string_lit_init("struct"),
+		string_lit_init("switch"), string_lit_init("typedef"), string_lit_init("union"), string_lit_init("volatile"),
+		string_lit_init("while"), string_lit_init("_Alignas"), string_lit_init("_Alignof"), string_lit_init("_Atomic"),
+		string_lit_init("_Generic"), string_lit_init("_Noreturn"), string_lit_init("_Static_assert"),
+		string_lit_init("_Thread_local"), string_lit_init("alignas"), string_lit_init("alignof"),
+		string_lit_init("catch"), string_lit_init("class"), string_lit_init("constexpr"), string_lit_init("decltype"),
+		string_lit_init("delete"), string_lit_init("explicit"), string_lit_init("false"), string_lit_init("friend"),
+		string_lit_init("mutable"), string_lit_init("namespace"), string_lit_init("new"), string_lit_init("noexcept"),
+		string_lit_init("nullptr"), string_lit_init("operator"), string_lit_init("private"), string_lit_init("protected"),
+		string_lit_init("public"), string_lit_init("static_assert"), string_lit_init("template"), string_lit_init("this"),
+		string_lit_init("thread_local"), string_lit_init("throw"), string_lit_init("true"), string_lit_init("try"),
+		string_lit_init("typename"), string_lit_init("using"), string_lit_init("virtual"), string_lit_init("NULL"),
+	};
+	static String types[] = {
+		string_lit_init("void"), string_lit_init("char"), string_lit_init("short"), string_lit_init("int"),
+		string_lit_init("long"), string_lit_init("float"), string_lit_init("double"), string_lit_init("signed"),
+		string_lit_init("unsigned"), string_lit_init("bool"), string_lit_init("_Bool"), string_lit_init("_Complex"),
+		string_lit_init("size_t"), string_lit_init("ptrdiff_t"), string_lit_init("intptr_t"), string_lit_init("uintptr_t"),
+		string_lit_init("int8_t"), string_lit_init("int16_t"), string_lit_init("int32_t"), string_lit_init("int64_t"),
+		string_lit_init("uint8_t"), string_lit_init("uint16_t"), string_lit_init("uint32_t"), string_lit_init("uint64_t"),
+		string_lit_init("i8"), string_lit_init("i16"), string_lit_init("i32"), string_lit_init("i64"),
+		string_lit_init("u8"), string_lit_init("u16"), string_lit_init("u32"), string_lit_init("u64"),
+		string_lit_init("f32"), string_lit_init("f64"),
+	};
+	
+	ED_Token_Kind result = ED_Token_Kind_TEXT;
+	for (i64 i = 0; i < array_count(keywords) && result == ED_Token_Kind_TEXT; i += 1) {
+		if (string_equals(word, keywords[i])) {
+			result = ED_Token_Kind_KEYWORD;
+		}
+	}
+	for (i64 i = 0; i < array_count(types) && result == ED_Token_Kind_TEXT; i += 1) {
+		if (string_equals(word, types[i])) {
+			result = ED_Token_Kind_TYPE;
+		}
+	}
+	
+	return result;
+}
+
+static void
+ed_tokens_mark(ED_Line_Tokens *tokens, i64 x, ED_Token_Kind kind) {
+	// The bytes from 'x' on are of this kind, until the next mark. Marks come in the order of
+	// their bytes; a mark at the same byte as the last one takes its place.
+	ED_Token *last = tokens->count > 0 ? &tokens->tokens[tokens->count - 1] : NULL;
+	
+	if (last && last->x == x) {
+		last->kind = kind;
+		if (tokens->count > 1 && tokens->tokens[tokens->count - 2].kind == kind) {
+			tokens->count -= 1;
+		}
+	} else if (!last || last->kind != kind) {
+		tokens->tokens[tokens->count].x    = x;
+		tokens->tokens[tokens->count].kind = kind;
+		tokens->count += 1;
+	}
+}
+
+ed_function ED_Lex_State
+ed_lex_line(ED_Line *line, ED_Lex_State state, ED_Line_Tokens *tokens, i64 first_x, i64 end_x) {
+	// Lexes a line as C, from the state the line before ended in, and returns the state it ends
+	// in. With 'tokens', also adds the runs of the bytes in [first_x, end_x) (the one holding
+	// 'first_x' starts there), which takes room for as many tokens as there are bytes there.
+	// Runs start and end next to ASCII bytes, so on codepoint boundaries.
+	if (!tokens || first_x >= end_x) {
+		first_x = INT64_MAX;
+		end_x   = 0;
+	}
+	
+	ED_Lex_State inner = state & ED_Lex_State_INNER_MASK;
+	bool directive = (state & ED_Lex_State_DIRECTIVE) != 0;
+	
+	// Outside comments and strings
+	ED_Token_Kind code_kind = directive ? ED_Token_Kind_PREPROCESSOR : ED_Token_Kind_TEXT;
+	
+	u8   quote     = '"';
+	bool escaped   = false; // By a backslash, in a string
+	bool star      = false; // In a block comment, the byte before was a star
+	bool at_start  = true;  // Only whitespace so far
+	bool in_number = false;
+	i64  slash_x   = -1;    // Of the last slash in the code, which the next byte can turn into a comment
+	i64  word_x    = -1;    // Of the identifier going on, which is marked once it ends
+	i64  word_len  = 0;
+	u8   word[16];          // Longer than any keyword
+	u8   prev      = 0;
+	
+	if (first_x < end_x) {
+		ED_Token_Kind start_kind = code_kind;
+		if (inner == ED_Lex_State_BLOCK_COMMENT || inner == ED_Lex_State_LINE_COMMENT) {
+			start_kind = ED_Token_Kind_COMMENT;
+		} else if (inner == ED_Lex_State_STRING) {
+			start_kind = ED_Token_Kind_STRING;
+		}
+		ed_tokens_mark(tokens, first_x, start_kind);
+	}
+	
+	i64 x = 0;
+	for (ED_Span *span = line->first_span; span; span = span->next) {
+		for (i64 i = 0; i < span->len; i += 1) {
+			u8 c = span->data[i];
+			
+			ED_Token_Kind mark_kind = ED_Token_Kind_COUNT; // None
+			i64 mark_x = x;
+			
+			if (inner == ED_Lex_State_CODE) {
+				bool digit     = (c >= '0' && c <= '9');
+				bool word_char = (digit || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80);
+				
+				if (word_x >= 0 && !word_char) {
+					// Keywords are only looked up where they show
+					if (x > first_x && word_x < end_x && word_len <= array_count(word)) {
+						ED_Token_Kind word_kind = ed_token_kind_from_word(string(word, word_len));
+						if (word_kind != ED_Token_Kind_TEXT) {
+							ed_tokens_mark(tokens, max(word_x, first_x), word_kind);
+						}
+					}
+					word_x = -1;
+				}
+				
+				in_number = in_number && (word_char || c == '.' ||
+										  ((c == '+' || c == '-') && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P')));
+				
+				if (slash_x >= 0 && slash_x == x - 1 && (c == '*' || c == '/')) {
+					inner     = (c == '*') ? ED_Lex_State_BLOCK_COMMENT : ED_Lex_State_LINE_COMMENT;
+					star      = false;
+					mark_kind = ED_Token_Kind_COMMENT;
+					mark_x    = slash_x;
+				} else if (c == '"' || c == '\'') {
+					inner     = ED_Lex_State_STRING;
+					quote     = c;
+					escaped   = false;
+					mark_kind = ED_Token_Kind_STRING;
+				} else if (c == '#' && at_start && !directive) {
+					directive = true;
+					code_kind = ED_Token_Kind_PREPROCESSOR;
+					mark_kind = code_kind;
+				} else if (in_number || word_x >= 0) {
+					// Still going
+				} else if (digit && !directive) {
+					in_number = true;
+					mark_kind = ED_Token_Kind_NUMBER;
+				} else if (word_char && !directive) {
+					word_x    = x;
+					word_len  = 0;
+					mark_kind = code_kind;
+				} else {
+					mark_kind = code_kind;
+				}
+				
+				if (word_x >= 0) {
+					if (word_len < array_count(word)) {
+						word[word_len] = c;
+					}
+					word_len += 1;
+				}
+				
+				slash_x  = (c == '/' && inner == ED_Lex_State_CODE) ? x : -1;
+				at_start = at_start && (c == ' ' || c == '\t');
+			} else if (inner == ED_Lex_State_BLOCK_COMMENT) {
+				if (star && c == '/') {
+					inner = ED_Lex_State_CODE;
+					c = 0; // Doesn't start another comment
+				}
+				star = (c == '*');
+			} else if (inner == ED_Lex_State_STRING) {
+				if (escaped) {
+					escaped = false;
+				} else if (c == '\\') {
+					escaped = true;
+				} else if (c == quote) {
+					inner = ED_Lex_State_CODE;
+				}
+			}
+			
+			// Marks before the window go to its first byte, the ones after it are dropped
+			if (mark_kind != ED_Token_Kind_COUNT && mark_x < end_x) {
+				ed_tokens_mark(tokens, max(mark_x, first_x), mark_kind);
+			}
+			
+			prev = c;
+			x += 1;
+		}
+	}
+	
+	if (word_x >= 0 && x > first_x && word_x < end_x && word_len <= array_count(word)) {
+		ED_Token_Kind word_kind = ed_token_kind_from_word(string(word, word_len));
+		if (word_kind != ED_Token_Kind_TEXT) {
+			ed_tokens_mark(tokens, max(word_x, first_x), word_kind);
+		}
+	}
+	
+	// Line comments, strings and directives go on in the next line after a backslash, block
+	// comments until they are closed (a directive with them)
+	bool continued = (prev == '\\');
+	ED_Lex_State result = ED_Lex_State_CODE;
+	if (inner == ED_Lex_State_BLOCK_COMMENT ||
+		(inner == ED_Lex_State_LINE_COMMENT && continued) ||
+		(inner == ED_Lex_State_STRING && escaped && quote == '"')) {
+		result = inner;
+	}
+	if (directive && (result != ED_Lex_State_CODE || continued)) {
+		result |= ED_Lex_State_DIRECTIVE;
+	}
+	
+	return result;
+}
+
+static void
+ed_buffer_highlight_edit(ED_Buffer *buffer, i64 first_line, i64 old_line_count, i64 new_line_count) {
+	// Called when the lines [first_line, first_line + old_line_count) are replaced by
+	// 'new_line_count' lines (a line whose text changed counts as replaced)
+	ED_Highlight *highlight = &buffer->highlight;
+	
+	if (first_line < highlight->valid_line_count) {
+		i64 old_end = first_line + old_line_count;
+		i64 new_end = first_line + new_line_count;
+		i64 delta   = new_end - old_end;
+		
+		// The lines after the replaced ones only move. States waiting to be compared within them
+		// can't be anymore.
+		i64 compare_from = new_end;
+		if (highlight->frontier < highlight->valid_line_count) {
+			if (highlight->compare_from >= old_end) {
+				compare_from = highlight->compare_from + delta;
+			}
+			
+			// Lexing stopped at the frontier before catching up with an earlier edit: the lines
+			// above it hold the states that edit gave them, only the ones after it can be compared
+			i64 frontier = (highlight->frontier >= old_end) ? highlight->frontier + delta : new_end;
+			compare_from = max(compare_from, frontier);
+		}
+		
+		highlight->valid_line_count = (highlight->valid_line_count >= old_end) ? highlight->valid_line_count + delta : new_end;
+		highlight->frontier         = min(highlight->frontier, first_line);
+		highlight->compare_from     = compare_from;
+	}
+}
+
+static void
+ed_buffer_highlight_forget(ED_Buffer *buffer, i64 line_number) {
+	// The states of the lines from 'line_number' on are gone (their page was evicted)
+	ED_Highlight *highlight = &buffer->highlight;
+	highlight->valid_line_count = min(highlight->valid_line_count, line_number);
+	highlight->frontier         = min(highlight->frontier, highlight->valid_line_count);
+	highlight->compare_from     = min(highlight->compare_from, highlight->valid_line_count);
+}
+
+static void
+ed_buffer_highlight_store(ED_Buffer *buffer, ED_Line *line, i64 line_number, ED_Lex_State state) {
+	// Keeps the state that the line at the frontier ends in, which moves the frontier past it,
+	// or up to the end of the valid lines if the line ends as it did before
+	ED_Highlight *highlight = &buffer->highlight;
+	assert(line_number == highlight->frontier); // Validate args
+	
+	bool converged = (line_number >= highlight->compare_from && line_number < highlight->valid_line_count &&
+					  line->lex_state == state);
+	line->lex_state = cast(u8) state;
+	
+	if (converged) {
+		highlight->frontier = highlight->valid_line_count;
+	} else {
+		highlight->frontier = line_number + 1;
+		highlight->valid_line_count = max(highlight->valid_line_count, highlight->frontier);
+	}
+}
+
+ed_function ED_Line_Tokens *
+ed_buffer_highlight_lines(Arena *arena, ED_Buffer *buffer, i64 first_line, i64 line_count, i64 first_column, i64 column_count) {
+	// The tokens of the part of the lines [first_line, first_line + line_count) that shows
+	// between the given columns, or NULL if the buffer isn't highlighted. The lines before them
+	// are only lexed for their end states, which are kept on the way when they can be trusted.
+	ED_Line_Tokens *result = NULL;
+	ED_Highlight *highlight = &buffer->highlight;
+	
+	if (highlight->language != ED_Language_NONE && first_line < buffer->line_count) {
+		trace_begin("highlight");
+		
+		line_count = min(line_count, buffer->line_count - first_line);
+		result = push_array(arena, ED_Line_Tokens, line_count);
+		
+		// Start from the frontier, or from the line before the screen if the states are right up
+		// to there (it is read, not lexed)
+		i64 start_line = min(highlight->frontier, first_line);
+		bool exact = true;
+		
+		ED_Page *page = buffer->first_page;
+		i64 page_first_line = 0;
+		while (page_first_line + page->line_count <= max(start_line - 1, 0)) {
+			page_first_line += page->line_count;
+			page = page->next;
+		}
+		
+		if (first_line - start_line > ED_HIGHLIGHT_SYNC_LINE_COUNT) {
+			// Too far to catch up on for this frame, or would read from the source: from a little
+			// above the screen, without keeping anything
+			exact = (first_line - start_line <= ED_HIGHLIGHT_CATCH_UP_LINE_COUNT);
+			i64 line_number = page_first_line;
+			for (ED_Page *check = page; check && line_number < first_line && exact; check = check->next) {
+				exact = (check->lines != NULL);
+				line_number += check->line_count;
+			}
+			
+			if (!exact) {
+				start_line = first_line - ED_HIGHLIGHT_SYNC_LINE_COUNT;
+				while (page_first_line + page->line_count <= start_line) {
+					page_first_line += page->line_count;
+					page = page->next;
+				}
+			}
+		}
+		
+		i64 line_number = (exact && start_line > 0) ? start_line - 1 : start_line;
+		i64 end_line = first_line + line_count;
+		
+		ED_Page_I64 rel = ed_relative_from_page_and_line(buffer, page, line_number - page_first_line);
+		page = rel.page;
+		i64 line_index = rel.i;
+		
+		ED_Lex_State state = ED_Lex_State_CODE;
+		while (line_number < end_line) {
+			ED_Line *line = &page->lines[line_index];
+			
+			if (line_number < first_line && exact && line_number < highlight->frontier) {
+				state = line->lex_state;
+			} else {
+				ED_Line_Tokens *tokens = NULL;
+				i64 first_x = 0;
+				i64 end_x   = 0;
+				if (line_number >= first_line) {
+					// With the byte that the right edge may cut
+					first_x = ed_buffer_line_position_from_column(buffer, line, line_number, first_column).x;
+					end_x   = ed_buffer_line_position_from_column(buffer, line, line_number, first_column + column_count).x + 1;
+					end_x   = max(first_x, min(end_x, ed_line_len(line)));
+					
+					tokens = &result[line_number - first_line];
+					tokens->tokens = push_nozero_aligned(arena, (end_x - first_x) * sizeof(ED_Token), alignof(ED_Token));
+				}
+				
+				ED_Lex_State end_state = ed_lex_line(line, state, tokens, first_x, end_x);
+				if (exact && line_number == highlight->frontier) {
+					ed_buffer_highlight_store(buffer, line, line_number, end_state);
+				}
+				state = end_state;
+			}
+			
+			line_number += 1;
+			line_index  += 1;
+			if (line_index == page->line_count && line_number < end_line) {
+				page = page->next;
+				line_index = 0;
+				
+				if (!page->lines) {
+					page = ed_buffer_materialize_page(buffer, page);
+				}
+			}
+		}
+		
+		trace_end("highlight");
+	}
+	
+	return result;
+}
+
+//- Editor debug functions
+
+static bool
+ed_text_point_exists(ED_Buffer *buffer, Point point) {
+	bool exists = true;
+	
+	if (point.y < 0 || point.y > buffer->line_count) {
+		exists = false;
+	}
+	
+	if (exists) {
+		ED_Line *line = ed_line_from_line_number(buffer, point.y);
+		if (point.x < 0 || point.x > ed_line_len(line)) {
+			exists = false;
+		}
+	}
+	
+	return exists;
+}
+
+static void
+ed_buffer_mark_touched(ED_Buffer *buffer, ED_Page *page, i64 line_count) {
+	// Every edit starts here. The page no longer matches the file.
+	page->source = NULL;
+	
+	// Edits that start on the same page add up (a replace is a remove and an insert at the
+	// same point), otherwise the latest one wins.
+	if (buffer->touched_page == page) {
+		buffer->touched_line_count = max(buffer->touched_line_count, line_count);
+	} else {
+		buffer->touched_page       = page;
+		buffer->touched_line_count = line_count;
+	}
+}
+
+static void
+ed_validate_page(ED_Buffer *buffer, ED_Page *page) {
+	// Links to the neighbouring pages. Source pages can have any number of lines, but no
+	// line is stored in them.
+	assert(page->line_count > 0);
+	assert(page->lines ? page->line_count <= ED_PAGE_SIZE : page->source != NULL);
+	assert(page->prev ? page->prev->next == page : buffer->first_page == page);
+	assert(page->next ? page->next->prev == page : buffer->last_page  == page);
+	
+	// Every line has a well-formed span chain
+	for (i64 line_index = 0; line_index < page->line_count && page->lines; line_index += 1) {
+		ED_Line *line = &page->lines[line_index];
+		assert(line->first_span);
+		assert(line->last_span);
+		assert(!line->first_span->prev);
+		assert(!line->last_span->next);
+		
+		ED_Span *span = line->first_span;
+		while (span->next) {
+			assert(span->len >= 0 && span->len <= ED_SPAN_SIZE);
+			assert(span->next->prev == span);
+			span = span->next;
+		}
+		assert(span->len >= 0 && span->len <= ED_SPAN_SIZE);
+		assert(span == line->last_span);
+	}
+}
+
+ed_function void
+ed_validate_buffer(ED_Buffer *buffer, ED_Validation_Level level) {
+	if (level != ED_Validation_Level_OFF) {
+		// Cheap checks that hold at every level
+		assert(buffer->first_page);
+		assert(buffer->last_page);
+		assert(buffer->first_page->line_count > 0);
+		assert(buffer->line_count > 0);
+		assert(buffer->highlight.frontier <= buffer->highlight.valid_line_count);
+		assert(buffer->highlight.compare_from <= buffer->highlight.valid_line_count);
+		assert(buffer->highlight.valid_line_count <= buffer->line_count);
+	}
+	
+	if (level == ED_Validation_Level_FULL) {
+		// Check every page, and that the buffer's counts add up
+		i64 page_count = 0;
+		i64 line_count = 0;
+		i64 span_count = 0;
+		i64 byte_count = 0;
+		i64 source_byte_count = 0;
+		
+		for (ED_Page *page = buffer->first_page; page; page = page->next) {
+			ed_validate_page(buffer, page);
+			
+			page_count += 1;
+			line_count += page->line_count;
+			if (!page->lines) {
+				source_byte_count += page->source_len;
+			}
+			for (i64 line_index = 0; line_index < page->line_count && page->lines; line_index += 1) {
+				for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+					span_count += 1;
+					byte_count += span->len;
+				}
+			}
+		}
+		
+		// Zombie and retired pages are still counted, their lines aren't
+		for (ED_Retired_Page *retired = buffer->first_retired_page; retired; retired = retired->next) {
+			ED_Page *page = retired->page;
+			page_count += 1;
+			if (!page->lines) {
+				source_byte_count += page->source_len;
+			}
+			for (i64 line_index = 0; line_index < page->line_count && page->lines; line_index += 1) {
+				for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+					span_count += 1;
+					byte_count += span->len;
+				}
+			}
+		}
+		
+		for (ED_Page *page = buffer->first_zombie_page; page; page = page->next) {
+			page_count += 1;
+			if (!page->lines) {
+				source_byte_count += page->source_len;
+			}
+			for (i64 line_index = 0; line_index < page->line_count && page->lines; line_index += 1) {
+				for (ED_Span *span = page->lines[line_index].first_span; span; span = span->next) {
+					span_count += 1;
+					byte_count += span->len;
+				}
+			}
+		}
+		
+		assert(page_count == buffer->page_count);
+		assert(line_count == buffer->line_count);
+		assert(span_count == buffer->span_count);
+		assert(byte_count == buffer->byte_count);
+		assert(source_byte_count == buffer->source_byte_count);
+	} else if (level != ED_Validation_Level_OFF) {
+		// The pages the edits went through, plus one past them where the page splits and
+		// merges happen
+		i64 lines_left = buffer->touched_line_count;
+		for (ED_Page *page = buffer->touched_page; page; page = page->next) {
+			ed_validate_page(buffer, page);
+			
+			if (lines_left <= 0) {
+				break;
+			}
+			lines_left -= page->line_count;
+		}
+		
+		if (level == ED_Validation_Level_SAMPLED) {
+			for (i64 i = 0; i < ED_VALIDATE_SAMPLE_PAGE_COUNT; i += 1) {
+				ED_Page *page = buffer->next_sample_page ? buffer->next_sample_page : buffer->first_page;
+				ed_validate_page(buffer, page);
+				buffer->next_sample_page = page->next;
+			}
+		}
+	}
+	
+	buffer->touched_page       = NULL;
+	buffer->touched_line_count = 0;
+	
+	allow_break();
+}
+
+#endif
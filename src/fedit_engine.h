@@ -0,0 +1,687 @@
+#ifndef FEDIT_ENGINE_H
+#define FEDIT_ENGINE_H
+
+////////////////////////////////
+//~ Buffer engine
+
+// The functions declared at the end of this file are the engine's interface, the rest are
+// static in fedit_engine.c. They are static too when the engine is included in the same
+// translation unit as its front end (as fedit.c and fedit_bench.c do). Define
+// ED_ENGINE_LIBRARY to give them external linkage, both when building libfedit_engine.a and
+// in the code that links to it.
+#if ED_ENGINE_LIBRARY
+# define ed_function
+#else
+# define ed_function static
+#endif
+
+//- Engine constants
+
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+// Bytes of text per span and lines per page. Both can be set from the command line
+// (see bench_geometry.sh) and can be anything from 1 up.
+#if !defined(ED_SPAN_SIZE)
+#define ED_SPAN_SIZE 64
+#endif
+
+#if !defined(ED_PAGE_SIZE)
+#define ED_PAGE_SIZE  4
+#endif
+
+#if ED_SPAN_SIZE < 1 || ED_PAGE_SIZE < 1
+# error ED_SPAN_SIZE and ED_PAGE_SIZE must be at least 1.
+#endif
+
+#define ED_TAB_WIDTH 4
+
+// The arena of a buffer holds its pages and spans, which grow to about twice the size of the
+// file: it commits in growing steps, backed by large pages where the OS has them.
+#if !defined(ED_BUFFER_ARENA_FLAGS)
+#define ED_BUFFER_ARENA_FLAGS (Arena_Flags_COMMIT_GROWTH|Arena_Flags_LARGE_PAGES)
+#endif
+
+// A buffer is compacted when it uses this many times the spans it would need if it was
+// loaded again from scratch (a lower threshold applies once the user stops typing).
+#define ED_COMPACT_FRAGMENTATION      3.0f
+#define ED_COMPACT_IDLE_FRAGMENTATION 1.5f
+#define ED_COMPACT_MIN_SPAN_COUNT     4096
+
+// Pages whose lines and spans are given back to the pool every time the editor is idle
+#define ED_RECLAIM_IDLE_PAGE_COUNT 4096
+
+// Pages checked on top of the touched ones by each ED_Validation_Level_SAMPLED pass
+#define ED_VALIDATE_SAMPLE_PAGE_COUNT 64
+
+// Files at least this big are mapped and loaded lazily, in source pages of about
+// ED_SOURCE_CHUNK_SIZE bytes each. When the editor is idle, the unedited pages further than
+// ED_SOURCE_KEEP_LINE_COUNT lines from the screen go back to being source pages.
+#if !defined(ED_LAZY_MIN_FILE_SIZE)
+#define ED_LAZY_MIN_FILE_SIZE (64 * 1024 * 1024)
+#endif
+#define ED_SOURCE_CHUNK_SIZE      (64 * 1024)
+#define ED_SOURCE_KEEP_LINE_COUNT 4096
+
+// Text read from a stream (e.g. piped into stdin) goes through a ring of this many bytes on
+// its way from the reader thread to the buffer
+#define ED_STREAM_RING_SIZE (16 * 1024 * 1024)
+
+// Long lines keep a checkpoint every this many columns, so that finding a column or a byte
+// offset in them only walks the line from the nearest one. Only this many lines have them at
+// a time (more than fit on the screen, so that rendering with a horizontal scroll doesn't
+// throw them away every frame).
+#define ED_LINE_CHECKPOINT_SPACING 4096
+#define ED_LINE_INDEX_COUNT        64
+
+// Snapshots of a buffer that can be alive at the same time
+#define ED_SNAPSHOT_COUNT 8
+
+// A buffer with unsaved edits is written to its swap file at most this often while it is
+// being edited, and whenever the editor is idle. Autosaves gather this many bytes per write,
+// and the swap file is written again from scratch once the parts of it that are no longer
+// used outgrow the ones that are (and ED_AUTOSAVE_MIN_GARBAGE).
+#define ED_AUTOSAVE_INTERVAL_MS 4000
+#define ED_AUTOSAVE_WRITE_SIZE  (1024 * 1024)
+#define ED_AUTOSAVE_MIN_GARBAGE (4 * 1024 * 1024)
+
+#define ED_SWAP_MAGIC   0x50575346 // "FSWP" when read as bytes on a little-endian machine
+#define ED_SWAP_VERSION 1
+
+// Highlighting lexes forward from the last line whose end state it knows, to the screen. When
+// that means going through more than ED_HIGHLIGHT_CATCH_UP_LINE_COUNT lines, or through source
+// pages, it starts ED_HIGHLIGHT_SYNC_LINE_COUNT lines above the screen instead, as if nothing
+// was open there (only comments and strings longer than that come out wrong).
+#define ED_HIGHLIGHT_CATCH_UP_LINE_COUNT (64 * 1024)
+#define ED_HIGHLIGHT_SYNC_LINE_COUNT     256
+
+//- Engine types
+
+enum ED_Validation_Level {
+	ED_Validation_Level_OFF,
+	ED_Validation_Level_TOUCHED, // Only the pages changed since the last validation
+	ED_Validation_Level_SAMPLED, // Touched pages plus a few more, cycling through the buffer
+	ED_Validation_Level_FULL,
+};
+typedef enum ED_Validation_Level ED_Validation_Level;
+
+enum ED_Line_Ending {
+	ED_Line_Ending_LF,
+	ED_Line_Ending_CRLF, // Only when every line break in the file is a CRLF
+};
+typedef enum ED_Line_Ending ED_Line_Ending;
+
+enum ED_Language {
+	ED_Language_NONE, // Not highlighted
+	ED_Language_C,    // C and C++
+};
+typedef enum ED_Language ED_Language;
+
+// What the lexer carries from the end of a line into the next one: what it is in the middle of,
+// and whether that is part of a preprocessor directive
+enum ED_Lex_State {
+	ED_Lex_State_CODE,
+	ED_Lex_State_BLOCK_COMMENT,
+	ED_Lex_State_LINE_COMMENT, // Only when ended by a backslash, like strings and directives
+	ED_Lex_State_STRING,
+	ED_Lex_State_INNER_MASK = 0x3,
+	
+	ED_Lex_State_DIRECTIVE = (1<<2),
+};
+typedef enum ED_Lex_State ED_Lex_State;
+
+enum ED_Token_Kind {
+	ED_Token_Kind_TEXT,
+	ED_Token_Kind_KEYWORD,
+	ED_Token_Kind_TYPE,
+	ED_Token_Kind_NUMBER,
+	ED_Token_Kind_STRING,
+	ED_Token_Kind_COMMENT,
+	ED_Token_Kind_PREPROCESSOR,
+	ED_Token_Kind_COUNT,
+};
+typedef enum ED_Token_Kind ED_Token_Kind;
+
+enum ED_Key {
+	ED_Key_NONE      = 0, // Returned when waiting for a key times out
+	ED_Key_BACKSPACE = 127,
+	ED_Key_ARROW_UP  = 256 + 1,
+	ED_Key_ARROW_LEFT,
+	ED_Key_ARROW_DOWN,
+	ED_Key_ARROW_RIGHT,
+	ED_Key_PAGE_UP,
+	ED_Key_PAGE_DOWN,
+	ED_Key_HOME,
+	ED_Key_END,
+	ED_Key_DELETE,
+};
+typedef enum ED_Key ED_Key;
+
+
+enum ED_Text_Action_Flags {
+	ED_Text_Action_Flags_COPY   = (1<<0),
+	ED_Text_Action_Flags_PASTE  = (1<<1),
+	ED_Text_Action_Flags_DELETE = (1<<2),
+};
+typedef enum ED_Text_Action_Flags ED_Text_Action_Flags;
+
+typedef struct ED_Delta ED_Delta;
+struct ED_Delta {
+	i32 delta;
+	Direction direction;
+	
+	// TODO: Make flags
+	bool cross_lines;
+	bool clamp_by_window;
+};
+
+typedef struct ED_Text_Action ED_Text_Action;
+struct ED_Text_Action {
+	ED_Text_Action_Flags flags;
+	ED_Delta delta;
+	u8 character;
+};
+
+typedef struct ED_Text_Operation ED_Text_Operation;
+struct ED_Text_Operation {
+	Text_Range delete_range;
+	String     replace_string;
+	Point      new_cursor;
+};
+
+
+typedef struct ED_Span ED_Span;
+struct ED_Span {
+	ED_Span *next;
+	ED_Span *prev;
+	
+	u8  *data;
+	i64  len;
+};
+
+typedef struct ED_Line ED_Line;
+struct ED_Line {
+	ED_Span *first_span;
+	ED_Span *last_span;
+	
+	// ED_Lex_State at the end of the line, see ED_Highlight. Written in place even in the pages
+	// that snapshots see, which never read it.
+	u8 lex_state;
+};
+
+typedef struct ED_Page ED_Page;
+
+// What a page's 'next' was until the given epoch, for the snapshots taken before it changed
+typedef struct ED_Page_Link ED_Page_Link;
+struct ED_Page_Link {
+	ED_Page_Link *older; // First, so that a chain of them can be freed in one go
+	u64      until_epoch;
+	ED_Page *next;
+};
+
+struct ED_Page {
+	ED_Page *next;
+	ED_Page *prev;
+	
+	ED_Line *lines; // NULL for source pages, see below
+	i64 line_count;
+	
+	// The bytes of the file its lines came from, line breaks included, for as long as none of
+	// them is edited. Lazily loaded files start out as "source pages" that have only this and
+	// stand for any number of lines: the first time one of those lines is needed, the page is
+	// replaced by regular pages built from it.
+	u8 *source;
+	i64 source_len;
+	
+	// The epochs in which its lines and its 'next' last changed, and the links that snapshots
+	// older than that still follow, newest first (see ed_buffer_take_snapshot)
+	u64 epoch;
+	u64 link_epoch;
+	ED_Page_Link *links;
+};
+
+// A place in a line, along with the span holding it, so that moving from it is cheap
+typedef struct ED_Line_Position ED_Line_Position;
+struct ED_Line_Position {
+	ED_Span *span;
+	i64 in_span;
+	i64 x;      // Bytes from the start of the line
+	i64 column; // Columns from the start of the line, tabs and wide characters expanded
+};
+
+// Checkpoints are stored in blocks from the buffer's pool (63 of them make a 2 KB block)
+#define ED_CHECKPOINT_BLOCK_COUNT 63
+
+typedef struct ED_Checkpoint_Block ED_Checkpoint_Block;
+struct ED_Checkpoint_Block {
+	ED_Checkpoint_Block *next; // First, so that a chain of blocks can be freed in one go
+	i64 count;
+	ED_Line_Position checkpoints[ED_CHECKPOINT_BLOCK_COUNT];
+};
+
+// Positions on codepoint boundaries of a line, in order, one every ED_LINE_CHECKPOINT_SPACING
+// columns from the start of the line (which isn't stored) up to as far as it has been walked.
+// Unused when it has no blocks.
+typedef struct ED_Line_Index ED_Line_Index;
+struct ED_Line_Index {
+	i64 line_number;
+	u64 last_used;
+	ED_Checkpoint_Block *first_block;
+	ED_Checkpoint_Block *last_block;
+};
+
+// A run of bytes of a line that are highlighted the same, up to the next one
+typedef struct ED_Token ED_Token;
+struct ED_Token {
+	i64 x;
+	ED_Token_Kind kind;
+};
+
+typedef struct ED_Line_Tokens ED_Line_Tokens;
+struct ED_Line_Tokens {
+	ED_Token *tokens;
+	i64 count;
+};
+
+// Which of the end states kept in the lines can be trusted. The ones before 'frontier' are
+// right. The ones after it, up to 'valid_line_count', were right before the edits that changed
+// the lines in [frontier, compare_from): lexing picks up from the frontier, and as soon as a line
+// from 'compare_from' on ends in the state it had, the rest of them are right again. Each edit
+// only costs lexing the lines it changed and the ones whose state it changed, up to the screen.
+typedef struct ED_Highlight ED_Highlight;
+struct ED_Highlight {
+	ED_Language language;
+	i64 frontier;
+	i64 compare_from;
+	i64 valid_line_count;
+};
+
+// Size of the pool blocks holding a header together with its data
+#define ED_SPAN_BLOCK_SIZE (sizeof(ED_Span) + ED_SPAN_SIZE)
+#define ED_PAGE_BLOCK_SIZE (sizeof(ED_Page) + ED_PAGE_SIZE * sizeof(ED_Line))
+#define ED_SOURCE_PAGE_BLOCK_SIZE sizeof(ED_Page)
+
+// Where a source page would end, found by the loader thread
+typedef struct ED_Source_Chunk ED_Source_Chunk;
+struct ED_Source_Chunk {
+	i64 len;
+	i64 line_count;
+};
+
+// Finds the lines of a mapped file on a background thread. The buffer turns the chunks into
+// source pages as they come in, so the first screen shows up right away. Lives in memory of
+// its own (the buffer's arena moves when it is compacted).
+typedef struct ED_Loader ED_Loader;
+struct ED_Loader {
+	Thread  thread;
+	SliceU8 source;
+	
+	// Written by the loader thread. A chunk is ready once the count includes it, the flags
+	// cover at least the chunks counted.
+	ED_Source_Chunk *chunks;
+	u64 chunk_count;
+	u64 saw_lf;
+	u64 saw_lone_lf;
+	u64 saw_invalid_utf8;
+	u64 is_done;
+	
+	u64 should_stop; // Written by the main thread
+	
+	// Only used by the main thread
+	i64  taken_chunk_count;
+	i64  taken_byte_count;
+	bool was_read_only;
+};
+
+// Reads a stream on a background thread into a ring, as much at a time as there is room for.
+// The buffer appends whatever is in the ring whenever it looks, so a slow writer shows up right
+// away and a fast one is taken in big pieces. The reader waits while the ring is full. Lives in
+// memory of its own, which whichever of the two threads lets go of it last gives back: the
+// reader can be stuck in a read for as long as the writer stays quiet.
+typedef struct ED_Stream ED_Stream;
+struct ED_Stream {
+	Thread       thread;
+	Input_Stream input;
+	
+	// Bytes that went through the ring so far, only ever growing: the ring holds the ones
+	// between read_pos and write_pos.
+	u64 write_pos; // Written by the reader thread, like is_done
+	u64 is_done;
+	u64 read_pos;  // Written by the main thread, like should_stop
+	u64 should_stop;
+	
+	u64 release_count; // Bumped by each thread once it is done with the stream
+	
+	u8 ring[ED_STREAM_RING_SIZE];
+};
+
+// The text of a buffer as it was when the snapshot was taken, which other threads can read
+// while the buffer keeps changing: go through its pages with ed_snapshot_next_page, and
+// release it once done. The pages it sees, with their lines and spans, aren't changed or freed
+// until then. Lives in the buffer.
+typedef struct ED_Snapshot ED_Snapshot;
+struct ED_Snapshot {
+	u64 is_alive;    // Cleared by ed_snapshot_release, from any thread
+	u64 should_stop; // Set when the buffer is waiting for it, long readers should give up
+	
+	u64 epoch;
+	ED_Page *first_page;
+	i64 line_count;
+	ED_Line_Ending line_ending;
+	String file_name;
+	SliceU8 source; // The pages that have one read it from here
+};
+
+// A page that went out of the buffer while a snapshot could see it, until the snapshots older
+// than 'epoch' are released. It is still counted, like the zombie pages.
+typedef struct ED_Retired_Page ED_Retired_Page;
+struct ED_Retired_Page {
+	ED_Retired_Page *next;
+	ED_Page *page;
+	u64      epoch;
+};
+
+// The same for a whole arena (when the buffer is loaded again) or a source. Lives in memory of
+// its own.
+typedef struct ED_Retired_Memory ED_Retired_Memory;
+struct ED_Retired_Memory {
+	ED_Retired_Memory *next;
+	u64 epoch;
+	
+	Arena   arena;
+	SliceU8 source;
+	bool    source_is_mapped;
+};
+
+// Swap files hold the text of a buffer as it would be saved, so that its edits survive a
+// crash. After the header come the records written by each autosave (the bytes of one or
+// more pages) and the index written by the last one, which lists where the text is, in
+// order: in the swap file, or in the file itself for the parts that weren't edited since it
+// was loaded. Autosaves append to the swap file and only then overwrite the header, so one
+// that stops halfway leaves the one before in place. All in the byte order of the machine
+// that wrote it.
+typedef struct ED_Swap_Header ED_Swap_Header;
+struct ED_Swap_Header {
+	u32 magic;
+	u32 version;
+	u64 index_offset;
+	u64 index_count;
+	
+	// The file as it was loaded, which the entries reading from it need unchanged (zero if
+	// none do)
+	i64 file_size;
+	u64 file_modified_time;
+};
+
+typedef struct ED_Swap_Entry ED_Swap_Entry;
+struct ED_Swap_Entry {
+	u64 offset; // In the swap file, or in the file if 'from_file'
+	u64 len;
+	u64 from_file;
+};
+
+// Where a page was written in the swap file, which stays true for as long as its lines don't
+// change
+typedef struct ED_Swap_Record ED_Swap_Record;
+struct ED_Swap_Record {
+	ED_Page *page;
+	i64 offset;
+	i64 len;
+};
+
+// Gathers what goes at the end of the swap file, ED_AUTOSAVE_WRITE_SIZE bytes at a time
+typedef struct ED_Swap_Writer ED_Swap_Writer;
+struct ED_Swap_Writer {
+	File_Handle    file;
+	i64            offset; // Of the first byte gathered
+	String_Builder builder;
+	bool           ok;
+};
+
+// Writes the buffer to its swap file on a background thread, from a snapshot, so that the
+// editor doesn't wait for the disk. Only the pages whose lines changed since the last run
+// are written. Lives in memory of its own, like the loader.
+typedef struct ED_Autosave ED_Autosave;
+struct ED_Autosave {
+	Thread thread;
+	Arena  arena; // The names
+	String swap_file_name;
+	String new_swap_file_name; // Written instead when starting over, then renamed
+	
+	// Set by the main thread for each run
+	ED_Snapshot *snapshot;
+	File_Info    file_info;
+	bool         start_over; // Writes every page again, into a new swap file
+	
+	u64  is_done; // Written by the thread once the fields below are
+	bool ok;
+	i64  written_len; // By the last run, index included
+	
+	// What the last run that went through left in the swap file: where the pages it wrote
+	// are, in their order (the ones read from the file aren't there), and the epoch of its
+	// snapshot. The pages whose epoch is still at most that one are there as they are, except
+	// for the last page, which was written without its last line break.
+	Arena           record_arenas[2];
+	i64             record_arena_index;
+	ED_Swap_Record *records;
+	i64             record_count;
+	ED_Page        *last_page;
+	u64             saved_epoch;
+	File_Info       saved_file_info;
+	i64             swap_len;
+	i64             live_len; // Bytes of the records the index points to
+	bool            has_swap;
+	
+	// Only used by the main thread
+	u64  edit_count; // Of the buffer when the last run started
+	u64  start_ns;
+	bool retry; // The last run didn't go through, so the next one is due even without edits
+};
+
+typedef struct ED_Buffer ED_Buffer;
+struct ED_Buffer {
+	bool is_read_only;
+	
+	Arena arena;
+	
+	String name;
+	String file_name;
+	Point  cursor;
+	i64    vscroll;
+	i64    hscroll;
+	
+	i32 viewport_height; // Rows shown by the front end, page up/down move by this much
+	
+	ED_Line_Ending line_ending; // Of the file on disk: the spans never hold the CRs
+	bool has_invalid_utf8;      // Found when loading; invalid bytes show up as U+FFFD
+	i64  file_read_len;         // Bytes of the file read so far, anything after was appended since
+	File_Info file_info;        // When it was last loaded, saved or reloaded, to tell other programs' writes from ours
+	bool has_unsaved_edits;     // Since then, not counting the text appended by following a file or a stream
+	
+	ED_Page *first_page;
+	ED_Page *last_page;
+	i64 page_count;
+	i64 line_count;
+	i64 span_count;
+	i64 byte_count; // Text stored in the spans, newlines excluded
+	
+	// The mapped file of a lazily loaded buffer (or a copy of it, if it couldn't be mapped back
+	// after a save), and the bytes of it that are in source pages (zombies included)
+	SliceU8 source;
+	bool    source_is_mapped;
+	i64     source_byte_count;
+	
+	// While the lines of 'source' are still being found. The buffer is read only until then.
+	ED_Loader *loader;
+	
+	// While text is still coming in from a stream, appended at the end as it arrives
+	ED_Stream *stream;
+	
+	// Once autosaving is started, for as long as the buffer has the same file
+	ED_Autosave *autosave;
+	
+	ED_Highlight highlight;
+	
+	Pool pool; // Pages and spans
+	
+	// Pages removed as a whole by a deletion, linked through 'next', with their lines and
+	// spans still attached. They are given back to the pool a few at a time when it runs out
+	// of blocks or when the editor is idle; until then the counts above include them.
+	ED_Page *first_zombie_page;
+	i64      zombie_page_count;
+	
+	// Bumped by every change to the text. The position of the last point moved to (usually
+	// the cursor) is kept for as long as it doesn't change, so that moving the cursor and
+	// finding its column don't have to go through the line from the start.
+	u64 edit_count;
+	u64              cached_edit_count;
+	Point            cached_point;
+	ED_Line_Position cached_position;
+	
+	// Checkpoints of the long lines looked into lately. Edits drop the ones near and after
+	// the edited point, and renumber the indexes of the lines after it.
+	ED_Line_Index line_indexes[ED_LINE_INDEX_COUNT];
+	u64           line_index_clock;
+	
+	// For ed_validate_buffer: where the last edit started, how many lines it covers counting
+	// from the start of that page, and where the next sampled pass picks up.
+	ED_Page *touched_page;
+	i64      touched_line_count;
+	ED_Page *next_sample_page;
+	
+	// Taking a snapshot starts a new epoch. Edits copy the pages that a snapshot can see (the
+	// ones whose epoch is at most the newest snapshot's) instead of changing them, and keep the
+	// old links of the pages they relink. The snapshots released by other threads are only
+	// noticed by ed_buffer_collect_snapshots, so the count and the oldest epoch can be behind.
+	ED_Snapshot snapshots[ED_SNAPSHOT_COUNT];
+	u64 epoch;
+	u64 snapshot_epoch;        // Of the newest snapshot taken
+	u64 oldest_snapshot_epoch; // Of the oldest one alive
+	i64 snapshot_count;
+	
+	ED_Retired_Page   *first_retired_page;
+	ED_Retired_Page   *last_retired_page;
+	ED_Retired_Memory *first_retired_memory;
+	ED_Retired_Memory *last_retired_memory;
+};
+
+//- Sinthetic types only used as return values for functions
+
+typedef struct ED_Page_I64 ED_Page_I64;
+struct ED_Page_I64 {
+	ED_Page *page;
+	i64 i;
+};
+
+typedef struct ED_Span_I64 ED_Span_I64;
+struct ED_Span_I64 {
+	ED_Span *span;
+	i64 i;
+};
+
+#if 0
+typedef struct ED_Page_Line ED_Page_Line;
+struct ED_Page_Line {
+	ED_Page *page;
+	ED_Line *line;
+};
+
+typedef struct ED_Page_Line_Span_Point ED_Page_Line_Span_Point;
+struct ED_Page_Line_Span_Point {
+	ED_Page *page;
+	ED_Line *line;
+	ED_Span *span;
+	Point point;
+};
+#endif
+
+//- Editor elements allocation functions
+
+ed_function ED_Page *ed_buffer_materialize_page(ED_Buffer *buffer, ED_Page *page);
+ed_function void     ed_buffer_evict_cold_pages(ED_Buffer *buffer, i64 first_line, i64 line_count);
+
+ed_function void ed_buffer_reclaim_zombie_pages(ED_Buffer *buffer, i64 max_page_count);
+
+//- Snapshot functions
+
+ed_function ED_Snapshot *ed_buffer_take_snapshot(ED_Buffer *buffer);
+ed_function void         ed_snapshot_release(ED_Snapshot *snapshot);
+ed_function ED_Page     *ed_snapshot_next_page(ED_Snapshot *snapshot, ED_Page *page);
+ed_function void         ed_buffer_collect_snapshots(ED_Buffer *buffer);
+
+//- Main buffer modification functions
+
+ed_function void  ed_buffer_remove_range(ED_Buffer *buffer, Text_Range range);
+ed_function Point ed_buffer_insert_text_at_point(ED_Buffer *buffer, Point point, String text);
+
+//- General helper functions
+
+ed_function i64 ed_line_len(ED_Line *line);
+
+ed_function Point ed_buffer_clamp_delta(ED_Buffer *buffer, Point point, ED_Delta delta);
+
+ed_function ED_Page_I64 ed_relative_from_absolute_line(ED_Buffer *buffer, i64 absolute_line);
+
+ed_function ED_Line *ed_line_from_line_number(ED_Buffer *buffer, i64 line_number);
+
+//- Line position functions
+
+ed_function ED_Line_Position ed_line_position_from_column(ED_Line *line, i64 column);
+ed_function ED_Line_Position ed_buffer_position_from_point(ED_Buffer *buffer, Point point);
+
+//- Line index functions
+
+ed_function ED_Line_Position ed_buffer_line_position_from_column(ED_Buffer *buffer, ED_Line *line, i64 line_number, i64 column);
+
+//- Input processing functions
+
+ed_function ED_Text_Action    ed_text_action_from_key(ED_Key key); // TODO: Replace key with event
+ed_function ED_Text_Operation ed_text_operation_from_action(Arena *arena, ED_Buffer *buffer, ED_Text_Action action);
+
+ed_function void ed_buffer_apply_operation(ED_Buffer *buffer, ED_Text_Operation op);
+
+//- Load/save functions
+
+ed_function void ed_init_buffer_contents(ED_Buffer *buffer, SliceU8 contents);
+ed_function void ed_buffer_start_loading(ED_Buffer *buffer, SliceU8 source);
+ed_function bool ed_buffer_update_loading(ED_Buffer *buffer);
+ed_function void ed_buffer_finish_loading(ED_Buffer *buffer);
+ed_function void ed_buffer_stop_loading(ED_Buffer *buffer);
+ed_function f32  ed_buffer_load_progress(ED_Buffer *buffer);
+ed_function void ed_buffer_start_streaming(ED_Buffer *buffer, Input_Stream input, String name);
+ed_function bool ed_buffer_update_streaming(ED_Buffer *buffer);
+ed_function void ed_buffer_release_source(ED_Buffer *buffer);
+ed_function bool ed_buffer_load_file(ED_Buffer *buffer, String file_name);
+ed_function bool ed_buffer_save_file(ED_Buffer *buffer, String file_name);
+ed_function bool ed_buffer_reload_file(ED_Buffer *buffer);
+ed_function i64  ed_buffer_append_file_tail(ED_Buffer *buffer);
+
+//- Autosave functions
+
+ed_function String ed_swap_file_name(Arena *arena, String file_name);
+ed_function void   ed_buffer_start_autosave(ED_Buffer *buffer);
+ed_function void   ed_buffer_update_autosave(ED_Buffer *buffer, bool idle);
+ed_function void   ed_buffer_stop_autosave(ED_Buffer *buffer);
+ed_function Read_File_Result ed_swap_file_contents(Arena *arena, String file_name);
+ed_function bool   ed_buffer_recover_file(ED_Buffer *buffer, String file_name);
+
+//- Buffer maintenance functions
+
+ed_function f32  ed_buffer_fragmentation(ED_Buffer *buffer);
+ed_function bool ed_buffer_should_compact(ED_Buffer *buffer, bool idle);
+ed_function void ed_buffer_compact(ED_Buffer *buffer);
+
+//- Layout functions
+
+ed_function String ed_render_line_window(Arena *arena, ED_Line_Position start, i64 first_column, i64 column_count);
+ed_function ED_Line_Position ed_render_line_run(String_Builder *builder, ED_Line_Position position, i64 end_x, i64 first_column, i64 column_count);
+
+//- Highlighting functions
+
+ed_function ED_Lex_State    ed_lex_line(ED_Line *line, ED_Lex_State state, ED_Line_Tokens *tokens, i64 first_x, i64 end_x);
+ed_function ED_Line_Tokens *ed_buffer_highlight_lines(Arena *arena, ED_Buffer *buffer, i64 first_line, i64 line_count, i64 first_column, i64 column_count);
+
+//- Editor debug functions
+
+ed_function void ed_validate_buffer(ED_Buffer *buffer, ED_Validation_Level level);
+
+#endif
@@ -186,7 +186,10 @@ clear(void) {
 }
 
 static ED_Key
-wait_for_key(void) {
+wait_for_key(i64 timeout_ms) {
+	u64 start_time = get_time_ns();
+	bool timed_out = false;
+	
 	char c = 0;
 	while (true) {
 		// 'nread' can be 1 (if we read a character) or 0 (if we timed out)
@@ -197,9 +200,18 @@ wait_for_key(void) {
 			// See note on the tutorial about EAGAIN on Cygwin.
 			panic(); // read failed - Temporary; TODO: What to do? The tutorial just quits; NOTE: Maybe set a global 'should_quit' variable
 		}
+		
+		if (timeout_ms >= 0 && get_time_ns() - start_time >= cast(u64) timeout_ms * 1000000) {
+			timed_out = true;
+			break;
+		}
+	}
+	
+	if (timed_out) {
+		return ED_Key_NONE;
 	}
 	
-	ED_Key key = c;
+	ED_Key key = cast(u8) c; // Bytes of UTF-8 sequences are past 127
 	if (key == '\x1b') {
 		// If we read the escape character (\x1b), there's a possibility that
 		// it was the first byte in an escape sequence, so try to read
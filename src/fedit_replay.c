@@ -0,0 +1,392 @@
+// Keystroke replay benchmark. Drives the whole editor, front end included, with streams of
+// keys and throws the rendered frames away instead of writing them to the terminal.
+// Built by the same build scripts as the editor, run as:
+//   fedit_replay [file]                (the file is used as the large corpus, 100 MB of generated text otherwise)
+//   fedit_replay --trace <trace> <file> (replays a session recorded with fedit --record)
+
+#define FEDIT_NO_ENTRY_POINT 1
+#include "fedit.c"
+
+////////////////////////////////
+//~ Replay types
+
+// Keys per scenario. Fewer on the big corpora, every key there is slow
+#define REPLAY_KEY_COUNT_SMALL      2000
+#define REPLAY_KEY_COUNT_LARGE      50
+#define REPLAY_KEY_COUNT_LONG_LINES 200
+
+#define REPLAY_WINDOW_WIDTH  120
+#define REPLAY_WINDOW_HEIGHT 40
+
+enum Replay_Stage {
+	Replay_Stage_ACTION,
+	Replay_Stage_OPERATION,
+	Replay_Stage_APPLY,
+	Replay_Stage_RENDER,
+	Replay_Stage_COUNT,
+};
+typedef enum Replay_Stage Replay_Stage;
+
+typedef struct Replay_Keys Replay_Keys;
+struct Replay_Keys {
+	ED_Key *keys;
+	i64 count;
+};
+
+typedef struct Replay_Result Replay_Result;
+struct Replay_Result {
+	u64 stage_ns[Replay_Stage_COUNT];
+	u64 p50_ns;
+	u64 p99_ns;
+	u64 buffer_peak;
+	u64 scratch_peak;
+	u64 frame_bytes;
+};
+
+////////////////////////////////
+//~ Replay helpers
+
+// xorshift64, so that runs are reproducible across platforms
+static u64 replay_random_state = 0x9E3779B97F4A7C15ULL;
+
+static u64
+replay_random(void) {
+	u64 x = replay_random_state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	replay_random_state = x;
+	return x;
+}
+
+static i64
+replay_random_range(i64 min_value, i64 max_value) {
+	// Inclusive on both ends
+	return min_value + cast(i64) (replay_random() % cast(u64) (max_value - min_value + 1));
+}
+
+static SliceU8
+replay_synthetic_text(Arena *arena, i64 byte_count, i64 max_line_len) {
+	SliceU8 result = push_sliceu8(arena, byte_count);
+	
+	i64 at = 0;
+	while (at < byte_count) {
+		i64 line_len = replay_random_range(0, max_line_len);
+		line_len = min(line_len, byte_count - at);
+		for (i64 i = 0; i < line_len; i += 1) {
+			i64 roll = replay_random_range(0, 15);
+			result.data[at + i] = roll == 0 ? ' ' : roll == 1 ? '\t' : cast(u8) replay_random_range('a', 'z');
+		}
+		at += line_len;
+		
+		if (at < byte_count) {
+			result.data[at] = '\n';
+			at += 1;
+		}
+	}
+	
+	return result;
+}
+
+static int
+replay_compare_u64(const void *a, const void *b) {
+	u64 x = *cast(u64 *) a;
+	u64 y = *cast(u64 *) b;
+	return (x > y) - (x < y);
+}
+
+static double
+replay_us_from_ns(u64 ns) {
+	return cast(double) ns / 1000.0;
+}
+
+static void
+replay_print_header(void) {
+	printf("%dx%d window, times are per key\n", cast(int) state.window_size.width, cast(int) state.window_size.height);
+	printf("%-10s %-12s %6s %9s %9s %9s %9s %9s %9s %10s %10s %10s\n",
+		   "corpus", "scenario", "keys", "action ns", "op ns", "apply ns", "render ns",
+		   "p50 us", "p99 us", "buffer MB", "scratch MB", "frame B");
+}
+
+static void
+replay_print_result(char *corpus_name, char *scenario_name, i64 key_count, Replay_Result r) {
+	printf("%-10s %-12s %6lld %9llu %9llu %9llu %9llu %9.1f %9.1f %10.2f %10.2f %10.1f\n",
+		   corpus_name, scenario_name, cast(long long) key_count,
+		   cast(unsigned long long) r.stage_ns[Replay_Stage_ACTION],
+		   cast(unsigned long long) r.stage_ns[Replay_Stage_OPERATION],
+		   cast(unsigned long long) r.stage_ns[Replay_Stage_APPLY],
+		   cast(unsigned long long) r.stage_ns[Replay_Stage_RENDER],
+		   replay_us_from_ns(r.p50_ns), replay_us_from_ns(r.p99_ns),
+		   cast(double) r.buffer_peak  / (1024.0 * 1024.0),
+		   cast(double) r.scratch_peak / (1024.0 * 1024.0),
+		   cast(double) r.frame_bytes / cast(double) max(key_count, 1));
+	fflush(stdout);
+}
+
+////////////////////////////////
+//~ Scenarios
+
+static Replay_Keys
+replay_keys_typing(Arena *arena, i64 count) {
+	// Words and line breaks, with the odd typo fixed with backspace
+	Replay_Keys result = { push_array(arena, ED_Key, count), count };
+	
+	for (i64 i = 0; i < count; i += 1) {
+		i64 roll = replay_random_range(0, 99);
+		if (roll < 8) {
+			result.keys[i] = ED_Key_BACKSPACE;
+		} else if (roll < 10) {
+			result.keys[i] = '\n';
+		} else if (roll < 25) {
+			result.keys[i] = ' ';
+		} else {
+			result.keys[i] = cast(ED_Key) replay_random_range('a', 'z');
+		}
+	}
+	
+	return result;
+}
+
+static Replay_Keys
+replay_keys_paste(Arena *arena, i64 count, SliceU8 corpus) {
+	// Terminals deliver a paste as one key per character
+	Replay_Keys result = { push_array(arena, ED_Key, count), count };
+	
+	i64 last_start = max(0, corpus.len - count);
+	i64 start = replay_random_range(0, last_start);
+	for (i64 i = 0; i < count; i += 1) {
+		u8 c = start + i < corpus.len ? corpus.data[start + i] : 'x';
+		result.keys[i] = cast(ED_Key) c;
+	}
+	
+	return result;
+}
+
+static Replay_Keys
+replay_keys_scroll(Arena *arena, i64 count) {
+	Replay_Keys result = { push_array(arena, ED_Key, count), count };
+	
+	ED_Key choices[] = {
+		ED_Key_PAGE_DOWN, ED_Key_PAGE_DOWN, ED_Key_PAGE_UP,
+		ED_Key_ARROW_DOWN, ED_Key_ARROW_DOWN, ED_Key_ARROW_DOWN, ED_Key_ARROW_UP,
+		ED_Key_ARROW_RIGHT, ED_Key_ARROW_LEFT, ED_Key_END, ED_Key_HOME,
+	};
+	
+	for (i64 i = 0; i < count; i += 1) {
+		result.keys[i] = choices[replay_random_range(0, array_count(choices) - 1)];
+	}
+	
+	return result;
+}
+
+static Replay_Keys
+replay_keys_bulk_delete(Arena *arena, i64 count) {
+	// Holding down delete, moving down a line now and then
+	Replay_Keys result = { push_array(arena, ED_Key, count), count };
+	
+	for (i64 i = 0; i < count; i += 1) {
+		result.keys[i] = replay_random_range(0, 49) == 0 ? ED_Key_ARROW_DOWN : ED_Key_DELETE;
+	}
+	
+	return result;
+}
+
+static Replay_Keys
+replay_keys_from_trace(Arena *arena, ED_Trace trace) {
+	// Timeouts only matter for the idle work, which is not measured here
+	Replay_Keys result = { push_array(arena, ED_Key, max(trace.event_count, 1)), 0 };
+	
+	for (i64 i = 0; i < trace.event_count; i += 1) {
+		if (trace.events[i].key != ED_Key_NONE) {
+			result.keys[result.count] = cast(ED_Key) trace.events[i].key;
+			result.count += 1;
+		}
+	}
+	
+	return result;
+}
+
+////////////////////////////////
+//~ Replay
+
+static void
+replay_load_buffer(ED_Buffer *buffer, SliceU8 contents) {
+	if (!buffer->arena.ptr) {
+		arena_init_flags(&buffer->arena, max(DEFAULT_ARENA_RESERVE_SIZE, cast(u64) contents.len * 4), ED_BUFFER_ARENA_FLAGS);
+	} else {
+		arena_reset(&buffer->arena);
+	}
+	
+	ed_init_buffer_contents(buffer, contents);
+	buffer->name = string_from_lit("replay");
+	
+	// Start in the middle of the text, so that the line lookups are not free
+	buffer->cursor.y = cast(i32) (buffer->line_count / 2);
+}
+
+static Replay_Result
+replay_keys(Arena *arena, ED_Buffer *buffer, Replay_Keys keys) {
+	// Same steps as the editor's main loop, timed one by one
+	Replay_Result result = {0};
+	
+	u64 *key_ns = push_array(arena, u64, max(keys.count, 1));
+	
+	Arena *scratch_arena = &scratch_arenas[0];
+	buffer->arena.peak = buffer->arena.pos;
+	scratch_arena->peak = scratch_arena->pos;
+	
+	for (i64 key_index = 0; key_index < keys.count; key_index += 1) {
+		ED_Key key = keys.keys[key_index];
+		
+		u64 t0 = get_time_ns();
+		ED_Text_Action action = ed_text_action_from_key(key);
+		
+		u64 t1 = get_time_ns();
+		ED_Text_Operation operation = ed_text_operation_from_action(&state.frame_arena, buffer, action);
+		
+		u64 t2 = get_time_ns();
+		ed_buffer_apply_operation(buffer, operation);
+		if (ed_buffer_should_compact(buffer, false)) {
+			ed_buffer_compact(buffer);
+		}
+		
+		u64 t3 = get_time_ns();
+		ed_buffer_update_scroll(buffer);
+		String frame = ed_render_frame(&state.frame_arena, buffer);
+		result.frame_bytes += frame.len;
+		
+		u64 t4 = get_time_ns();
+		
+		arena_reset(&state.frame_arena);
+		
+		result.stage_ns[Replay_Stage_ACTION]    += t1 - t0;
+		result.stage_ns[Replay_Stage_OPERATION] += t2 - t1;
+		result.stage_ns[Replay_Stage_APPLY]     += t3 - t2;
+		result.stage_ns[Replay_Stage_RENDER]    += t4 - t3;
+		key_ns[key_index] = t4 - t0;
+	}
+	
+	if (keys.count > 0) {
+		qsort(key_ns, keys.count, sizeof(u64), replay_compare_u64);
+		result.p50_ns = key_ns[keys.count / 2];
+		result.p99_ns = key_ns[min(keys.count - 1, keys.count * 99 / 100)];
+		
+		for (i64 stage = 0; stage < Replay_Stage_COUNT; stage += 1) {
+			result.stage_ns[stage] /= keys.count;
+		}
+	}
+	
+	result.buffer_peak  = buffer->arena.peak;
+	result.scratch_peak = scratch_arena->peak;
+	
+	return result;
+}
+
+static void
+replay_corpus(char *corpus_name, SliceU8 contents, i64 key_count) {
+	Scratch scratch = scratch_begin(0, 0);
+	
+	ED_Buffer *buffer = push_type(&state.arena, ED_Buffer);
+	state.current_buffer = buffer;
+	
+	char *scenario_names[] = { "typing", "paste", "scroll", "bulk delete" };
+	for (i64 scenario = 0; scenario < array_count(scenario_names); scenario += 1) {
+		// Every scenario starts from a freshly loaded buffer
+		replay_load_buffer(buffer, contents);
+		buffer->viewport_height = state.window_size.height;
+		
+		Replay_Keys keys = {0};
+		switch (scenario) {
+			case 0: keys = replay_keys_typing(scratch.arena, key_count);                  break;
+			case 1: keys = replay_keys_paste(scratch.arena, key_count, contents);         break;
+			case 2: keys = replay_keys_scroll(scratch.arena, key_count);                  break;
+			case 3: keys = replay_keys_bulk_delete(scratch.arena, key_count);             break;
+		}
+		
+		Replay_Result r = replay_keys(scratch.arena, buffer, keys);
+		
+		replay_print_result(corpus_name, scenario_names[scenario], keys.count, r);
+	}
+	
+	arena_fini(&buffer->arena);
+	state.current_buffer = state.null_buffer;
+	
+	scratch_end(scratch);
+}
+
+////////////////////////////////
+//~ Entry point
+
+int main(int argc, char **argv) {
+	(void)logfile; // Only opened by the editor's main()
+	
+	arena_init(&state.arena);
+	arena_init(&state.frame_arena);
+	
+	state.window_size.width  = REPLAY_WINDOW_WIDTH;
+	state.window_size.height = REPLAY_WINDOW_HEIGHT;
+	
+	Arena corpus_arena = {0};
+	arena_init_size(&corpus_arena, 1ULL << 34);
+	
+	int result = 0;
+	
+	if (argc > 3 && strcmp(argv[1], "--trace") == 0) {
+		// A session recorded with fedit --record, replayed over the file it was recorded on
+		ED_Trace trace = {0};
+		Read_File_Result read_file_result = read_file(&corpus_arena, string_from_cstring(argv[3]));
+		
+		if (!ed_load_trace(&corpus_arena, string_from_cstring(argv[2]), &trace)) {
+			printf("Failed to load the trace '%s'\n", argv[2]);
+			result = 1;
+		} else if (!read_file_result.ok) {
+			printf("Failed to read '%s'\n", argv[3]);
+			result = 1;
+		} else {
+			state.window_size.width  = trace.header.window_width;
+			state.window_size.height = trace.header.window_height;
+			replay_print_header();
+			
+			ED_Buffer *buffer = push_type(&state.arena, ED_Buffer);
+			state.current_buffer = buffer;
+			
+			replay_load_buffer(buffer, read_file_result.contents);
+			buffer->cursor.y = 0; // Where the editor starts
+			buffer->viewport_height = state.window_size.height;
+			
+			Replay_Keys keys = replay_keys_from_trace(&corpus_arena, trace);
+			Replay_Result r = replay_keys(&corpus_arena, buffer, keys);
+			replay_print_result("file", "trace", keys.count, r);
+		}
+	} else {
+		replay_print_header();
+		
+		{
+			SliceU8 small = replay_synthetic_text(&corpus_arena, 64 * 1024, 100);
+			replay_corpus("small", small, REPLAY_KEY_COUNT_SMALL);
+		}
+		
+		{
+			SliceU8 large = {0};
+			if (argc > 1) {
+				Read_File_Result read_file_result = read_file(&corpus_arena, string_from_cstring(argv[1]));
+				if (!read_file_result.ok) {
+					printf("Failed to read '%s'\n", argv[1]);
+					return 1;
+				}
+				large = read_file_result.contents;
+			} else {
+				large = replay_synthetic_text(&corpus_arena, 100 * 1024 * 1024, 100);
+			}
+			replay_corpus("large", large, REPLAY_KEY_COUNT_LARGE);
+		}
+		
+		{
+			SliceU8 long_lines = replay_synthetic_text(&corpus_arena, 4 * 1024 * 1024, 200 * 1024);
+			replay_corpus("long lines", long_lines, REPLAY_KEY_COUNT_LONG_LINES);
+		}
+	}
+	
+	arena_fini(&corpus_arena);
+	return result;
+}
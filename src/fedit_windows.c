@@ -179,13 +179,16 @@ clear(void) {
 }
 
 static ED_Key
-wait_for_key(void) {
+wait_for_key(i64 timeout_ms) {
 	
 	// With the help of:
 	//   https://stackoverflow.com/a/22310673
 	
 	INPUT_RECORD record = {0};
 	
+	u64 start_time = get_time_ns();
+	bool timed_out = false;
+	
 	bool ok = false;
 	while (true) {
 		int n = 0;
@@ -223,6 +226,15 @@ wait_for_key(void) {
 		
 		if (!ok) { panic(); }
 		if (n > 0) break;
+		
+		if (timeout_ms >= 0 && get_time_ns() - start_time >= cast(u64) timeout_ms * 1000000) {
+			timed_out = true;
+			break;
+		}
+	}
+	
+	if (timed_out) {
+		return ED_Key_NONE;
 	}
 	
 	assert(record.EventType == KEY_EVENT);